@@ -6,7 +6,9 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdatomic.h>
 
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -15,6 +17,7 @@
 #define LOG_MODULE "application"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
+#include "arena.h"
 #include "char32.h"
 #include "debug.h"
 #include "xmalloc.h"
@@ -369,6 +372,24 @@ application_execute(const struct application *app, const struct prompt *prompt,
     }
 }
 
+char32_t *
+application_title(struct application *app)
+{
+    if (app->title != NULL || app->dmenu_line == NULL)
+        return app->title;
+
+    /* Validated when the line was loaded */
+    char32_t *title = xmalloc((app->title_len + 1) * sizeof(title[0]));
+    const size_t len = utf8ntoc32(title, app->dmenu_line, app->dmenu_line_len);
+    assert(len == app->title_len);
+    (void)len;
+
+    title[app->title_len] = U'\0';
+    app->title = title;
+    app->title_decoded = true;
+    return title;
+}
+
 struct application_list *
 applications_init(void)
 {
@@ -389,17 +410,25 @@ applications_destroy(struct application_list *apps)
     if (apps == NULL)
         return;
 
+    /* Entries (and some of their strings) may be owned by the arena */
+    const bool in_arena = apps->arena != NULL;
+
+    /* All loaders are done, so there's nothing unpublished */
+    assert(apps->appended == apps->count);
+
     for (size_t i = 0; i < apps->count; i++) {
-        struct application *app = apps->v[i];
+        struct application *app = applications_get(apps, i);
 
         free(app->id);
         free(app->path);
         free(app->exec);
         free(app->app_id);
-        free(app->title);
         if (app->render_title != app->title)
             free(app->render_title);
-        free(app->title_lowercase);
+        if (!in_arena || app->title_decoded)
+            free(app->title);
+        if (!in_arena)
+            free(app->title_lowercase);
         free(app->basename);
         free(app->wexec);
         free(app->generic_name);
@@ -419,8 +448,8 @@ applications_destroy(struct application_list *apps)
         tll_free_and_free(app->keywords, free);
         tll_free_and_free(app->categories, free);
 
-        free(app->dmenu_input);
-        free(app->dmenu_match_nth);
+        if (!in_arena)
+            free(app->dmenu_match_nth);
 
         switch (app->icon.type) {
         case ICON_NONE:
@@ -456,21 +485,58 @@ applications_destroy(struct application_list *apps)
 
         fcft_text_run_destroy(app->shaped);
         fcft_text_run_destroy(app->shaped_bold);
-        free(app);
+        if (!in_arena)
+            free(app);
     }
 
+    arena_destroy(apps->arena);
+
+    if (apps->map != NULL)
+        munmap(apps->map, apps->map_size);
+
     mtx_destroy(&apps->lock);
-    free(apps->v);
+    for (size_t i = 0; i < APPLICATION_SEGMENT_COUNT; i++)
+        free(apps->segments[i]);
     free(apps);
 }
 
+void
+applications_append(struct application_list *apps, struct application *app)
+{
+    size_t offset;
+    const unsigned segment = applications_segment(apps->appended, &offset);
+    assert(segment < APPLICATION_SEGMENT_COUNT);
+
+    if (apps->segments[segment] == NULL) {
+        apps->segments[segment] = xmalloc(
+            (APPLICATION_SEGMENT_BASE << segment) *
+            sizeof(apps->segments[segment][0]));
+    }
+
+    apps->segments[segment][offset] = app;
+    apps->appended++;
+
+    if (app->visible)
+        apps->appended_visible++;
+}
+
+void
+applications_publish(struct application_list *apps)
+{
+    /* Release: the entries must be complete before they're counted */
+    atomic_store_explicit(
+        &apps->visible_count, apps->appended_visible, memory_order_release);
+    atomic_store_explicit(&apps->count, apps->appended, memory_order_release);
+}
+
 void
 applications_flush_text_run_cache(struct application_list *apps)
 {
     for (size_t i = 0; i < apps->count; i++) {
-        fcft_text_run_destroy(apps->v[i]->shaped);
-        fcft_text_run_destroy(apps->v[i]->shaped_bold);
-        apps->v[i]->shaped = NULL;
-        apps->v[i]->shaped_bold = NULL;
+        struct application *app = applications_get(apps, i);
+        fcft_text_run_destroy(app->shaped);
+        fcft_text_run_destroy(app->shaped_bold);
+        app->shaped = NULL;
+        app->shaped_bold = NULL;
     }
 }
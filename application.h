@@ -95,9 +95,20 @@ struct application {
     char32_list_t keywords;    /* Lower cased! */
     char32_list_t categories;  /* Lower cased! */
 
-    char32_t *dmenu_input;     /* Full dmenu input, may contain multiple columns */
     char32_t *dmenu_match_nth; /* What to match against, with --match-nth= */
 
+    /*
+     * dmenu mode: the input line, as read (not NUL terminated), and
+     * may contain multiple columns. Without --with-nth and
+     * --match-nth, in UTF-8 locales, 'title' is decoded from it on
+     * demand (see application_title()), and 'title_lowercase' is
+     * NULL; the lower cased title is 'dmenu_line_lowercase' instead.
+     */
+    const char *dmenu_line;
+    size_t dmenu_line_len;
+    const char *dmenu_line_lowercase;  /* UTF-8, may be 'dmenu_line' */
+    size_t dmenu_line_lowercase_len;
+
     size_t title_len;
     size_t basename_len;
     size_t wexec_len;
@@ -110,6 +121,7 @@ struct application {
     struct icon icon;
     bool visible;
     bool startup_notify;
+    bool title_decoded;  /* 'title' was decoded from 'dmenu_line' */
     unsigned count;
     struct fcft_text_run *shaped;
     struct fcft_text_run *shaped_bold;
@@ -119,13 +131,77 @@ bool application_execute(
     const struct application *app, const struct prompt *prompt,
     const char *launch_prefix, const char *xdg_activation_token);
 
+/* Returns the title, decoding it first if necessary. Not thread safe */
+char32_t *application_title(struct application *app);
+
+/* Safe to call while application_title() may be running */
+static inline bool
+application_has_title(const struct application *app)
+{
+    return app->dmenu_line != NULL || app->title != NULL;
+}
+
+/*
+ * Applications are stored in segments that never move once allocated.
+ * Segment k holds (APPLICATION_SEGMENT_BASE << k) entries.
+ *
+ * A single loader thread appends entries, and then publishes them by
+ * updating 'count'. Other threads can read entries [0..count) without
+ * locking, even while the loader keeps appending. Entries are never
+ * removed before the list is destroyed.
+ */
+#define APPLICATION_SEGMENT_BITS 8
+#define APPLICATION_SEGMENT_BASE ((size_t)1 << APPLICATION_SEGMENT_BITS)
+#define APPLICATION_SEGMENT_COUNT 48
+
 struct application_list {
-    struct application **v;
-    size_t count;
-    size_t visible_count;
+    struct application **segments[APPLICATION_SEGMENT_COUNT];
+    _Atomic size_t count;          /* Published entries */
+    _Atomic size_t visible_count;  /* Published visible entries */
     mtx_t lock;
+
+    /* Loader only: appended entries, published or not */
+    size_t appended;
+    size_t appended_visible;
+
+    /*
+     * dmenu mode: owns the applications, and their title,
+     * title_lowercase, dmenu_line, dmenu_line_lowercase and
+     * dmenu_match_nth strings
+     */
+    struct arena *arena;
+
+    /* dmenu mode: stdin, if mapped. dmenu_line may point into it */
+    void *map;
+    size_t map_size;
 };
 
 struct application_list *applications_init(void);
 void applications_destroy(struct application_list *apps);
+
+/* Loader only. The entry isn't visible to readers until published */
+void applications_append(struct application_list *apps, struct application *app);
+void applications_publish(struct application_list *apps);
+
+/* Maps an entry index to its segment, and its offset in that segment */
+static inline unsigned
+applications_segment(size_t idx, size_t *offset)
+{
+    const unsigned long long biased = idx + APPLICATION_SEGMENT_BASE;
+    const unsigned segment =
+        (sizeof(biased) * 8 - 1) - __builtin_clzll(biased) -
+        APPLICATION_SEGMENT_BITS;
+
+    *offset = biased - (APPLICATION_SEGMENT_BASE << segment);
+    return segment;
+}
+
+static inline struct application *
+applications_get(const struct application_list *apps, size_t idx)
+{
+    size_t offset;
+    const unsigned segment = applications_segment(idx, &offset);
+    return apps->segments[segment][offset];
+}
+
 void applications_flush_text_run_cache(struct application_list *apps);
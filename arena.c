@@ -0,0 +1,153 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOG_MODULE "arena"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "xmalloc.h"
+
+#define CHUNK_SIZE (1024 * 1024)
+
+struct chunk {
+    struct chunk *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+};
+
+struct arena {
+    struct chunk *chunks;  /* Most recent first */
+    void *last;            /* Most recent allocation, for arena_trim() */
+    size_t used;
+};
+
+struct arena *
+arena_init(void)
+{
+    struct arena *arena = xmalloc(sizeof(*arena));
+    *arena = (struct arena){0};
+    return arena;
+}
+
+void
+arena_destroy(struct arena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    struct chunk *next;
+    for (struct chunk *chunk = arena->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(arena);
+}
+
+static struct chunk *
+chunk_new(size_t size)
+{
+    struct chunk *chunk = xmalloc(sizeof(*chunk) + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size, size_t align)
+{
+    xassert(align > 0 && (align & (align - 1)) == 0);
+    xassert(align <= alignof(max_align_t));
+
+    struct chunk *chunk = arena->chunks;
+
+    if (chunk != NULL) {
+        const size_t offset = (chunk->used + align - 1) & ~(align - 1);
+
+        if (offset <= chunk->size && size <= chunk->size - offset) {
+            void *ptr = &chunk->data[offset];
+            chunk->used = offset + size;
+            arena->used += size;
+            arena->last = ptr;
+            return ptr;
+        }
+    }
+
+    if (size > CHUNK_SIZE / 4) {
+        /*
+         * Large allocation; give it a chunk of its own, and keep
+         * using the current chunk for subsequent allocations.
+         */
+        struct chunk *large = chunk_new(size);
+        large->used = size;
+
+        if (chunk != NULL) {
+            large->next = chunk->next;
+            chunk->next = large;
+        } else
+            arena->chunks = large;
+
+        arena->used += size;
+        arena->last = chunk != NULL ? NULL : large->data;
+        return large->data;
+    }
+
+    LOG_DBG("new chunk (%zu bytes in use)", arena->used);
+
+    chunk = chunk_new(CHUNK_SIZE);
+    chunk->next = arena->chunks;
+    chunk->used = size;
+    arena->chunks = chunk;
+
+    arena->used += size;
+    arena->last = chunk->data;
+    return chunk->data;
+}
+
+void
+arena_trim(struct arena *arena, void *ptr, size_t new_size)
+{
+    struct chunk *chunk = arena->chunks;
+
+    if (ptr == NULL || ptr != arena->last || chunk == NULL)
+        return;
+
+    const size_t offset = (char *)ptr - chunk->data;
+    xassert(offset + new_size <= chunk->used);
+
+    arena->used -= chunk->used - (offset + new_size);
+    chunk->used = offset + new_size;
+}
+
+void
+arena_merge(struct arena *dst, struct arena *src)
+{
+    if (src->chunks != NULL) {
+        /* Keep allocating from dst's current chunk */
+        struct chunk *tail = src->chunks;
+        while (tail->next != NULL)
+            tail = tail->next;
+
+        if (dst->chunks != NULL) {
+            tail->next = dst->chunks->next;
+            dst->chunks->next = src->chunks;
+        } else {
+            dst->chunks = src->chunks;
+            dst->last = NULL;
+        }
+    }
+
+    dst->used += src->used;
+    free(src);
+}
+
+size_t
+arena_used(const struct arena *arena)
+{
+    return arena->used;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Bump allocator. Allocations cannot be freed individually; all
+ * memory is released at once, by arena_destroy().
+ *
+ * Memory is allocated in large chunks, which are never moved. That
+ * is, pointers returned by arena_alloc() stay valid until the arena
+ * is destroyed, and may be handed to other threads.
+ *
+ * The arena itself is *not* thread safe.
+ */
+struct arena;
+
+struct arena *arena_init(void);
+void arena_destroy(struct arena *arena);
+
+/* Never returns NULL; aborts on allocation failures, like xmalloc() */
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+
+/*
+ * Shrinks the most recent allocation, returning the excess to the
+ * arena. 'ptr' must be the last pointer returned by arena_alloc().
+ */
+void arena_trim(struct arena *arena, void *ptr, size_t new_size);
+
+/* Moves all memory owned by 'src' to 'dst', and destroys 'src' */
+void arena_merge(struct arena *dst, struct arena *src);
+
+/* Total number of bytes handed out (not counting trimmed excess) */
+size_t arena_used(const struct arena *arena);
@@ -0,0 +1,288 @@
+#include "cache-file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define LOG_MODULE "cache-file"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "xmalloc.h"
+#include "xsnprintf.h"
+
+void
+cache_path_stamps_add(cache_path_stamps_t *stamps, const char *path,
+                      const struct stat *st)
+{
+    struct cache_path_stamp stamp = {
+        .path = xstrdup(path),
+        .exists = st != NULL,
+    };
+
+    if (st != NULL) {
+        stamp.dev = st->st_dev;
+        stamp.ino = st->st_ino;
+        stamp.mtime = st->st_mtim;
+    }
+
+    tll_push_back(*stamps, stamp);
+}
+
+void
+cache_path_stamps_destroy(cache_path_stamps_t *stamps)
+{
+    tll_foreach(*stamps, it) {
+        free(it->item.path);
+        tll_remove(*stamps, it);
+    }
+}
+
+bool
+cache_map_open(struct cache_map *map, const char *path, size_t min_size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            LOG_ERRNO("%s: failed to open", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG_ERRNO("%s: failed to stat", path);
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size < (off_t)min_size || st.st_size > UINT32_MAX) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        LOG_ERRNO("%s: failed to mmap", path);
+        return false;
+    }
+
+    *map = (struct cache_map){.data = data, .size = st.st_size};
+    return true;
+}
+
+void
+cache_map_close(struct cache_map *map)
+{
+    if (map->data != NULL)
+        munmap((void *)map->data, map->size);
+
+    map->data = NULL;
+    map->size = 0;
+}
+
+bool
+cache_array_valid(const struct cache_map *map, struct cache_ref ref,
+                  size_t elem_size, size_t align)
+{
+    if (ref.len == 0)
+        return true;
+
+    return ref.offset % align == 0 &&
+           ref.offset <= map->size &&
+           (map->size - ref.offset) / elem_size >= ref.len;
+}
+
+bool
+cache_utf8_valid(const struct cache_map *map, struct cache_ref ref)
+{
+    if (ref.offset == 0)
+        return ref.len == 0;
+
+    return ref.offset < map->size &&
+           ref.len < map->size - ref.offset &&
+           map->data[ref.offset + ref.len] == '\0';
+}
+
+bool
+cache_stamps_valid(const struct cache_map *map, struct cache_ref ref)
+{
+    if (!cache_array_valid(map, ref, sizeof(struct cache_stamp),
+                           alignof(struct cache_stamp)))
+    {
+        return false;
+    }
+
+    const struct cache_stamp *stamps = cache_array_at(map, ref);
+    for (size_t i = 0; i < ref.len; i++) {
+        if (stamps[i].path.offset == 0 ||
+            !cache_utf8_valid(map, stamps[i].path))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+stamp_unchanged(const struct cache_map *map, const struct cache_stamp *stamp)
+{
+    const char *path = &map->data[stamp->path.offset];
+
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return stamp->nsec == -1 && (errno == ENOENT || errno == ENOTDIR);
+
+    return stamp->nsec != -1 &&
+           stamp->dev == (uint64_t)st.st_dev &&
+           stamp->ino == (uint64_t)st.st_ino &&
+           stamp->sec == (int64_t)st.st_mtim.tv_sec &&
+           stamp->nsec == (int64_t)st.st_mtim.tv_nsec;
+}
+
+bool
+cache_stamps_unchanged(const struct cache_map *map, struct cache_ref ref)
+{
+    const struct cache_stamp *stamps = cache_array_at(map, ref);
+
+    for (size_t i = 0; i < ref.len; i++) {
+        if (!stamp_unchanged(map, &stamps[i])) {
+            LOG_DBG("%s: changed", &map->data[stamps[i].path.offset]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t
+cache_buf_reserve(struct cache_buf *buf, size_t size, size_t align)
+{
+    const size_t offset = (buf->len + align - 1) & ~(align - 1);
+
+    if (offset + size > buf->size) {
+        size_t new_size = buf->size > 0 ? buf->size : 64 * 1024;
+        while (new_size < offset + size)
+            new_size *= 2;
+
+        buf->data = xrealloc(buf->data, new_size);
+        buf->size = new_size;
+    }
+
+    /* Zero padding, and the reserved space */
+    memset(&buf->data[buf->len], 0, offset + size - buf->len);
+    buf->len = offset + size;
+    return offset;
+}
+
+struct cache_ref
+cache_buf_add_utf8(struct cache_buf *buf, const char *s)
+{
+    if (s == NULL)
+        return (struct cache_ref){0};
+
+    const size_t len = strlen(s);
+    const size_t offset = cache_buf_reserve(buf, len + 1, 1);
+    memcpy(&buf->data[offset], s, len + 1);
+    return (struct cache_ref){.offset = offset, .len = len};
+}
+
+struct cache_ref
+cache_buf_add_stamps(struct cache_buf *buf, const cache_path_stamps_t *stamps)
+{
+    const size_t count = tll_length(*stamps);
+    if (count == 0)
+        return (struct cache_ref){0};
+
+    const size_t offset = cache_buf_reserve(
+        buf, count * sizeof(struct cache_stamp), alignof(struct cache_stamp));
+
+    size_t i = 0;
+    tll_foreach(*stamps, it) {
+        const struct cache_path_stamp *s = &it->item;
+        const struct cache_stamp stamp = {
+            .dev = s->exists ? s->dev : 0,
+            .ino = s->exists ? s->ino : 0,
+            .sec = s->exists ? s->mtime.tv_sec : 0,
+            .nsec = s->exists ? s->mtime.tv_nsec : -1,
+            .path = cache_buf_add_utf8(buf, s->path),
+        };
+        memcpy(&buf->data[offset + i++ * sizeof(stamp)], &stamp, sizeof(stamp));
+    }
+
+    return (struct cache_ref){.offset = offset, .len = count};
+}
+
+bool
+cache_write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = write(fd, data, len);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += r;
+        len -= r;
+    }
+
+    return true;
+}
+
+bool
+cache_file_replace(const char *path, const char *data, size_t size,
+                   mode_t mode)
+{
+    char *tmp_path = xasprintf("%s.XXXXXX", path);
+    int fd = mkostemp(tmp_path, O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERRNO("%s: failed to create", tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    /* mkostemp() always creates the file with 0600 */
+    if ((mode & 07777) != 0600)
+        fchmod(fd, mode & 07777);
+
+    if (!cache_write_all(fd, data, size)) {
+        LOG_ERRNO("%s: failed to write", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    /*
+     * Without this, the rename may reach the disk before the data
+     * does, leaving an empty cache behind after a crash
+     */
+    if (fsync(fd) < 0) {
+        LOG_ERRNO("%s: failed to sync", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    close(fd);
+
+    if (rename(tmp_path, path) < 0) {
+        LOG_ERRNO("%s: failed to rename to %s", tmp_path, path);
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    free(tmp_path);
+    return true;
+}
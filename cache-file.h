@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <tllist.h>
+
+/*
+ * Helpers shared by the binary caches (desktop entries, resolved
+ * icons and popularity counts): validating mapped cache files,
+ * building them in memory, and replacing them atomically.
+ *
+ * Cache files consist of fixed size records, referring to strings
+ * and arrays elsewhere in the file by offset.
+ */
+
+/*
+ * A string, or an array. 'offset' is relative to the start of the
+ * file, with zero meaning NULL. For strings, 'len' excludes the NUL
+ * terminator. For arrays, it's the number of elements.
+ */
+struct cache_ref {
+    uint32_t offset;
+    uint32_t len;
+};
+
+/* On-disk stamp of a file or directory, used to detect changes */
+struct cache_stamp {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t sec;
+    int64_t nsec;  /* -1: path doesn't exist */
+    struct cache_ref path;  /* UTF-8 */
+};
+
+/* A stamp recorded while scanning, before it's written to the file */
+struct cache_path_stamp {
+    char *path;
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+};
+typedef tll(struct cache_path_stamp) cache_path_stamps_t;
+
+/* 'st' is NULL if the path doesn't exist */
+void cache_path_stamps_add(
+    cache_path_stamps_t *stamps, const char *path, const struct stat *st);
+void cache_path_stamps_destroy(cache_path_stamps_t *stamps);
+
+/*
+ * Loading. Everything read from the file must be bounds checked
+ * before it's used; a corrupt (or truncated) cache is treated as a
+ * stale one.
+ */
+
+struct cache_map {
+    const char *data;
+    size_t size;
+};
+
+/*
+ * Maps 'path'. Returns false if it doesn't exist, can't be mapped,
+ * is smaller than 'min_size', or too large to be addressed by a
+ * struct cache_ref.
+ */
+bool cache_map_open(struct cache_map *map, const char *path, size_t min_size);
+void cache_map_close(struct cache_map *map);
+
+bool cache_array_valid(
+    const struct cache_map *map, struct cache_ref ref, size_t elem_size,
+    size_t align);
+bool cache_utf8_valid(const struct cache_map *map, struct cache_ref ref);
+bool cache_stamps_valid(const struct cache_map *map, struct cache_ref ref);
+
+static inline const void *
+cache_array_at(const struct cache_map *map, struct cache_ref ref)
+{
+    return &map->data[ref.offset];
+}
+
+/*
+ * True if none of the (validated) stamps in 'ref' differ from the
+ * file system.
+ */
+bool cache_stamps_unchanged(const struct cache_map *map, struct cache_ref ref);
+
+/*
+ * Saving. The file is built in memory; records are filled in by
+ * offset, since adding strings may move the buffer.
+ */
+
+struct cache_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+/* Reserves 'size' zeroed bytes, and returns their offset */
+size_t cache_buf_reserve(struct cache_buf *buf, size_t size, size_t align);
+struct cache_ref cache_buf_add_utf8(struct cache_buf *buf, const char *s);
+struct cache_ref cache_buf_add_stamps(
+    struct cache_buf *buf, const cache_path_stamps_t *stamps);
+
+bool cache_write_all(int fd, const char *data, size_t len);
+
+/*
+ * Writes 'data' to a temporary file next to 'path', with permissions
+ * 'mode', syncs it, and renames it over 'path'.
+ */
+bool cache_file_replace(
+    const char *path, const char *data, size_t size, mode_t mode);
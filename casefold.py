@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+import argparse
+import sys
+import unicodedata
+
+
+# Code points are mapped in blocks of 256. Blocks without any upper
+# case characters share a single all-zero block in the second stage
+# table.
+BLOCK_BITS = 8
+BLOCK_SIZE = 1 << BLOCK_BITS
+
+# There are no lower case mappings beyond this
+LIMIT = 0x20000
+
+
+def to_lower(cp: int) -> int:
+    lower = chr(cp).lower()
+
+    # Only U+0130 (LATIN CAPITAL LETTER I WITH DOT ABOVE) lower cases
+    # to more than one code point ("i" + COMBINING DOT ABOVE). Map it
+    # to "i", like towlower() does.
+    return ord(lower[0])
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('c_output', type=argparse.FileType('w'))
+    parser.add_argument('h_output', type=argparse.FileType('w'))
+    opts = parser.parse_args()
+
+    for cp in range(LIMIT, sys.maxunicode + 1):
+        assert to_lower(cp) == cp, f'U+{cp:04X} has a lower case mapping'
+
+    stage1: list[int] = []
+    stage2: list[tuple[int, ...]] = [(0,) * BLOCK_SIZE]
+    block_ids: dict[tuple[int, ...], int] = {stage2[0]: 0}
+
+    for block_start in range(0, LIMIT, BLOCK_SIZE):
+        block = tuple(to_lower(cp) - cp
+                      for cp in range(block_start, block_start + BLOCK_SIZE))
+
+        if block not in block_ids:
+            block_ids[block] = len(stage2)
+            stage2.append(block)
+
+        stage1.append(block_ids[block])
+
+    assert len(stage2) <= 256
+
+    opts.h_output.write('#pragma once\n')
+    opts.h_output.write('#include <stdint.h>\n')
+    opts.h_output.write('#include <uchar.h>\n')
+    opts.h_output.write('\n')
+    opts.h_output.write(f'/* Generated from the Unicode {unicodedata.unidata_version} '
+                        f'character database */\n')
+    opts.h_output.write(f'#define CASEFOLD_BLOCK_BITS {BLOCK_BITS}\n')
+    opts.h_output.write(f'#define CASEFOLD_LIMIT 0x{LIMIT:x}\n')
+    opts.h_output.write('\n')
+    opts.h_output.write('/* Block number, per 256 code points */\n')
+    opts.h_output.write(f'extern const uint8_t casefold_stage1[{len(stage1)}];\n')
+    opts.h_output.write('\n')
+    opts.h_output.write('/* Lower case code point, minus the code point itself */\n')
+    opts.h_output.write(f'extern const int32_t casefold_stage2[{len(stage2)}][{BLOCK_SIZE}];\n')
+
+    opts.h_output.write('\n')
+    opts.h_output.write('static inline char32_t\n')
+    opts.h_output.write('casefold_lower(char32_t c)\n')
+    opts.h_output.write('{\n')
+    opts.h_output.write('    if (c >= CASEFOLD_LIMIT)\n')
+    opts.h_output.write('        return c;\n')
+    opts.h_output.write('\n')
+    opts.h_output.write('    const uint8_t block = casefold_stage1[c >> CASEFOLD_BLOCK_BITS];\n')
+    opts.h_output.write('    return c + casefold_stage2[block][c & ((1 << CASEFOLD_BLOCK_BITS) - 1)];\n')
+    opts.h_output.write('}\n')
+
+    opts.c_output.write('#include "casefold.h"\n')
+    opts.c_output.write('\n')
+
+    opts.c_output.write(f'const uint8_t casefold_stage1[{len(stage1)}] = {{\n')
+    for i in range(0, len(stage1), 16):
+        row = ', '.join(str(v) for v in stage1[i:i + 16])
+        opts.c_output.write(f'    {row},\n')
+    opts.c_output.write('};\n')
+
+    opts.c_output.write('\n')
+    opts.c_output.write(f'const int32_t casefold_stage2[{len(stage2)}][{BLOCK_SIZE}] = {{\n')
+    for block in stage2:
+        opts.c_output.write('    {\n')
+        for i in range(0, BLOCK_SIZE, 16):
+            row = ', '.join(str(v) for v in block[i:i + 16])
+            opts.c_output.write(f'        {row},\n')
+        opts.c_output.write('    },\n')
+    opts.c_output.write('};\n')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
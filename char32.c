@@ -4,6 +4,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include <langinfo.h>
+#include <stdint.h>
 #include <wctype.h>
 #include <wchar.h>
 
@@ -13,9 +15,15 @@
  #endif
 #endif
 
+#if defined(__x86_64__) && (GNUC_AT_LEAST(4, 9) || defined(__clang__))
+ #define HAVE_X86_64_SIMD
+ #include <immintrin.h>
+#endif
+
 #define LOG_MODULE "char32"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
+#include "casefold.h"
 #include "xmalloc.h"
 
 /*
@@ -84,9 +92,501 @@ c32chr(const char32_t *s, char32_t c)
     return (char32_t *)wcschr((const wchar_t *)s, (wchar_t)c);
 }
 
+static char32_t *
+c32memchr_scalar(const char32_t *s, char32_t c, size_t n)
+{
+    return (char32_t *)wmemchr((const wchar_t *)s, (wchar_t)c, n);
+}
+
+#if defined(HAVE_X86_64_SIMD)
+/*
+ * SSE2 is part of the x86-64 baseline; no runtime check needed.
+ *
+ * Always inlined, for the same reason as c32memmem_sse2().
+ */
+static inline __attribute__((always_inline)) char32_t *
+c32memchr_sse2(const char32_t *s, char32_t c, size_t n)
+{
+    const __m128i needle = _mm_set1_epi32((int)c);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+        const int mask = _mm_movemask_ps(
+            _mm_castsi128_ps(_mm_cmpeq_epi32(v, needle)));
+
+        if (mask != 0)
+            return (char32_t *)&s[i + __builtin_ctz(mask)];
+    }
+
+    for (; i < n; i++) {
+        if (s[i] == c)
+            return (char32_t *)&s[i];
+    }
+
+    return NULL;
+}
+
+__attribute__((target("avx2")))
+static char32_t *
+c32memchr_avx2(const char32_t *s, char32_t c, size_t n)
+{
+    const __m256i needle = _mm256_set1_epi32((int)c);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&s[i]);
+        const int mask = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, needle)));
+
+        if (mask != 0)
+            return (char32_t *)&s[i + __builtin_ctz(mask)];
+    }
+
+    return c32memchr_sse2(&s[i], c, n - i);
+}
+#endif
+
+char32_t *
+c32memchr(const char32_t *s, char32_t c, size_t n)
+{
+#if defined(HAVE_X86_64_SIMD)
+    if (n >= 8 && __builtin_cpu_supports("avx2"))
+        return c32memchr_avx2(s, c, n);
+    return c32memchr_sse2(s, c, n);
+#else
+    return c32memchr_scalar(s, c, n);
+#endif
+}
+
+/* Compares the code points between the (already matched) first and last */
+static inline bool
+c32memmem_verify(const char32_t *candidate, const char32_t *needle,
+                 size_t needle_len)
+{
+    for (size_t i = 1; i + 1 < needle_len; i++) {
+        if (candidate[i] != needle[i])
+            return false;
+    }
+    return true;
+}
+
+static char32_t *
+c32memmem_scalar(const char32_t *haystack, size_t haystack_len,
+                 const char32_t *needle, size_t needle_len)
+{
+    const char32_t first = needle[0];
+    const char32_t last = needle[needle_len - 1];
+
+    for (size_t i = 0; i + needle_len <= haystack_len; i++) {
+        if (haystack[i] == first &&
+            haystack[i + needle_len - 1] == last &&
+            c32memmem_verify(&haystack[i], needle, needle_len))
+        {
+            return (char32_t *)&haystack[i];
+        }
+    }
+
+    return NULL;
+}
+
+#if defined(HAVE_X86_64_SIMD)
+/*
+ * Compares the needle's first and last code points against 4 (or 8)
+ * candidate positions at a time; only positions where both match are
+ * verified.
+ *
+ * Always inlined, so that the AVX2 variant's tail is VEX encoded too;
+ * calling legacy SSE code with dirty upper AVX state is several times
+ * slower than not vectorizing at all.
+ */
+static inline __attribute__((always_inline)) char32_t *
+c32memmem_sse2(const char32_t *haystack, size_t haystack_len,
+               const char32_t *needle, size_t needle_len)
+{
+    const __m128i first = _mm_set1_epi32((int)needle[0]);
+    const __m128i last = _mm_set1_epi32((int)needle[needle_len - 1]);
+    size_t i = 0;
+
+    for (; i + needle_len - 1 + 4 <= haystack_len; i += 4) {
+        const __m128i block_first =
+            _mm_loadu_si128((const __m128i *)&haystack[i]);
+        const __m128i block_last =
+            _mm_loadu_si128((const __m128i *)&haystack[i + needle_len - 1]);
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(
+            _mm_cmpeq_epi32(block_first, first),
+            _mm_cmpeq_epi32(block_last, last))));
+
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (c32memmem_verify(&haystack[pos], needle, needle_len))
+                return (char32_t *)&haystack[pos];
+            mask &= mask - 1;
+        }
+    }
+
+    return c32memmem_scalar(
+        &haystack[i], haystack_len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2")))
+static char32_t *
+c32memmem_avx2(const char32_t *haystack, size_t haystack_len,
+               const char32_t *needle, size_t needle_len)
+{
+    const __m256i first = _mm256_set1_epi32((int)needle[0]);
+    const __m256i last = _mm256_set1_epi32((int)needle[needle_len - 1]);
+    size_t i = 0;
+
+    for (; i + needle_len - 1 + 8 <= haystack_len; i += 8) {
+        const __m256i block_first =
+            _mm256_loadu_si256((const __m256i *)&haystack[i]);
+        const __m256i block_last =
+            _mm256_loadu_si256((const __m256i *)&haystack[i + needle_len - 1]);
+
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(
+            _mm256_cmpeq_epi32(block_first, first),
+            _mm256_cmpeq_epi32(block_last, last))));
+
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (c32memmem_verify(&haystack[pos], needle, needle_len))
+                return (char32_t *)&haystack[pos];
+            mask &= mask - 1;
+        }
+    }
+
+    return c32memmem_sse2(&haystack[i], haystack_len - i, needle, needle_len);
+}
+#endif
+
+/*
+ * Like memmem(), but on code points. Unlike a byte-wise memmem() on
+ * char32_t arrays, this never reports a match at an offset that is
+ * not a multiple of sizeof(char32_t).
+ */
+char32_t *
+c32memmem(const char32_t *haystack, size_t haystack_len,
+          const char32_t *needle, size_t needle_len)
+{
+    if (needle_len == 0)
+        return (char32_t *)haystack;
+    if (needle_len > haystack_len)
+        return NULL;
+
+#if defined(HAVE_X86_64_SIMD)
+    if (haystack_len - needle_len + 1 >= 8 && __builtin_cpu_supports("avx2"))
+        return c32memmem_avx2(haystack, haystack_len, needle, needle_len);
+    return c32memmem_sse2(haystack, haystack_len, needle, needle_len);
+#else
+    return c32memmem_scalar(haystack, haystack_len, needle, needle_len);
+#endif
+}
+
+bool
+c32_impl_supported(enum c32_impl impl)
+{
+    switch (impl) {
+    case C32_IMPL_SCALAR:
+        return true;
+
+#if defined(HAVE_X86_64_SIMD)
+    case C32_IMPL_SSE2:
+        return true;
+
+    case C32_IMPL_AVX2:
+        return __builtin_cpu_supports("avx2");
+#else
+    case C32_IMPL_SSE2:
+    case C32_IMPL_AVX2:
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+char32_t *
+c32memchr_using(enum c32_impl impl, const char32_t *s, char32_t c, size_t n)
+{
+    assert(c32_impl_supported(impl));
+
+    switch (impl) {
+#if defined(HAVE_X86_64_SIMD)
+    case C32_IMPL_AVX2:
+        return c32memchr_avx2(s, c, n);
+
+    case C32_IMPL_SSE2:
+        return c32memchr_sse2(s, c, n);
+#else
+    case C32_IMPL_AVX2:
+    case C32_IMPL_SSE2:
+#endif
+    case C32_IMPL_SCALAR:
+        break;
+    }
+
+    return c32memchr_scalar(s, c, n);
+}
+
+char32_t *
+c32memmem_using(enum c32_impl impl,
+                const char32_t *haystack, size_t haystack_len,
+                const char32_t *needle, size_t needle_len)
+{
+    assert(c32_impl_supported(impl));
+
+    if (needle_len == 0)
+        return (char32_t *)haystack;
+    if (needle_len > haystack_len)
+        return NULL;
+
+    switch (impl) {
+#if defined(HAVE_X86_64_SIMD)
+    case C32_IMPL_AVX2:
+        return c32memmem_avx2(haystack, haystack_len, needle, needle_len);
+
+    case C32_IMPL_SSE2:
+        return c32memmem_sse2(haystack, haystack_len, needle, needle_len);
+#else
+    case C32_IMPL_AVX2:
+    case C32_IMPL_SSE2:
+#endif
+    case C32_IMPL_SCALAR:
+        break;
+    }
+
+    return c32memmem_scalar(haystack, haystack_len, needle, needle_len);
+}
+
+/* Set by char32_init(), once the locale has been set */
+static bool utf8_locale;
+
+void
+char32_init(void)
+{
+    utf8_locale = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+}
+
+bool
+locale_is_utf8(void)
+{
+    return utf8_locale;
+}
+
+/*
+ * UTF-8 decoder, used instead of mbrtoc32() when the locale's
+ * character set is UTF-8.
+ *
+ * Runs of ASCII are widened 16 (SSE2) or 32 (AVX2) bytes at a time.
+ * Everything else is decoded, and validated, one code point at a
+ * time. Like mbrtoc32(), it rejects overlong encodings, surrogates,
+ * code points above U+10FFFF and incomplete sequences.
+ */
+
+#if defined(HAVE_X86_64_SIMD)
+/*
+ * Widens 16 bytes, if they are all ASCII (and non-NUL). Inlined into
+ * the AVX2 variant too, to avoid AVX-SSE transitions.
+ */
+static inline bool
+utf8_ascii_16(char32_t *dst, const unsigned char *src)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+    if ((_mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) != 0)
+        return false;
+
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+    _mm_storeu_si128((__m128i *)&dst[0], _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)&dst[4], _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)&dst[8], _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *)&dst[12], _mm_unpackhi_epi16(hi, zero));
+    return true;
+}
+
+/*
+ * Widens ASCII, up to the first non-ASCII or NUL byte. Returns the
+ * number of bytes converted (a multiple of 16)
+ */
+static size_t
+utf8_ascii_sse2(char32_t *dst, const unsigned char *src, size_t n)
+{
+    size_t i = 0;
+    while (i + 16 <= n && utf8_ascii_16(&dst[i], &src[i]))
+        i += 16;
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t
+utf8_ascii_avx2(char32_t *dst, const unsigned char *src, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&src[i]);
+
+        if ((_mm256_movemask_epi8(v) |
+             _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero))) != 0)
+        {
+            break;
+        }
+
+        for (size_t j = 0; j < 32; j += 8) {
+            _mm256_storeu_si256(
+                (__m256i *)&dst[i + j],
+                _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i *)&src[i + j])));
+        }
+    }
+
+    if (i + 16 <= n && utf8_ascii_16(&dst[i], &src[i]))
+        i += 16;
+
+    return i;
+}
+#endif
+
+/*
+ * Decodes a single multi-byte sequence. Returns its length, or 0 if
+ * it is invalid, or incomplete
+ */
+static inline size_t
+utf8_decode_one(const unsigned char *s, size_t avail, char32_t *cp)
+{
+    const unsigned char c = s[0];
+
+    if (c < 0xc2) {
+        /* Continuation byte, or overlong two-byte sequence */
+        return 0;
+    }
+
+    if (c < 0xe0) {
+        if (avail < 2 || (s[1] & 0xc0) != 0x80)
+            return 0;
+
+        *cp = (char32_t)(c & 0x1f) << 6 | (s[1] & 0x3f);
+        return 2;
+    }
+
+    if (c < 0xf0) {
+        if (avail < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80)
+            return 0;
+
+        const char32_t v =
+            (char32_t)(c & 0x0f) << 12 | (char32_t)(s[1] & 0x3f) << 6 |
+            (s[2] & 0x3f);
+
+        if (v < 0x800 || (v >= 0xd800 && v <= 0xdfff))
+            return 0;
+
+        *cp = v;
+        return 3;
+    }
+
+    if (c < 0xf5) {
+        if (avail < 4 ||
+            (s[1] & 0xc0) != 0x80 ||
+            (s[2] & 0xc0) != 0x80 ||
+            (s[3] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
+
+        const char32_t v =
+            (char32_t)(c & 0x07) << 18 | (char32_t)(s[1] & 0x3f) << 12 |
+            (char32_t)(s[2] & 0x3f) << 6 | (s[3] & 0x3f);
+
+        if (v < 0x10000 || v > 0x10ffff)
+            return 0;
+
+        *cp = v;
+        return 4;
+    }
+
+    return 0;
+}
+
+/*
+ * Decodes at most 'src_len' bytes, stopping at the first NUL, into at
+ * most 'dst_len' code points. 'dst' may be NULL, to only count them.
+ * Returns the number of code points, or (size_t)-1 on invalid UTF-8
+ */
+static size_t
+utf8_decode(char32_t *dst, size_t dst_len, const char *_src, size_t src_len)
+{
+    const unsigned char *src = (const unsigned char *)_src;
+
+#if defined(HAVE_X86_64_SIMD)
+    const bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    size_t chars = 0;
+    size_t i = 0;
+
+    while (i < src_len && chars < dst_len) {
+        const unsigned char c = src[i];
+
+        if (c == '\0') {
+            /* Like mbrtoc32(), store the terminator, but don't count it */
+            if (dst != NULL)
+                dst[chars] = U'\0';
+            break;
+        }
+
+        if (c < 0x80) {
+#if defined(HAVE_X86_64_SIMD)
+            if (dst != NULL) {
+                const size_t left = src_len - i;
+                const size_t room = dst_len - chars;
+                const size_t n = left < room ? left : room;
+                const size_t done = have_avx2
+                    ? utf8_ascii_avx2(&dst[chars], &src[i], n)
+                    : utf8_ascii_sse2(&dst[chars], &src[i], n);
+
+                i += done;
+                chars += done;
+            }
+#endif
+            /* Remainder of the ASCII run */
+            while (i < src_len && chars < dst_len &&
+                   src[i] < 0x80 && src[i] != '\0')
+            {
+                if (dst != NULL)
+                    dst[chars] = src[i];
+                chars++;
+                i++;
+            }
+            continue;
+        }
+
+        char32_t cp;
+        const size_t n = utf8_decode_one(&src[i], src_len - i, &cp);
+
+        if (n == 0)
+            return (size_t)-1;
+
+        if (dst != NULL)
+            dst[chars] = cp;
+        chars++;
+        i += n;
+    }
+
+    return chars;
+}
+
 size_t
 mbsntoc32(char32_t *dst, const char *src, size_t nms, size_t len)
 {
+    if (locale_is_utf8())
+        return utf8_decode(dst, dst != NULL ? len : SIZE_MAX, src, nms);
+
     mbstate_t ps = {0};
 
     char32_t *out = dst;
@@ -185,6 +685,12 @@ c32tombs(char *dst, const char32_t *src, size_t len)
 
 char32_t *
 ambstoc32(const char *src)
+{
+    return ambstoc32_len(src, NULL);
+}
+
+char32_t *
+ambstoc32_len(const char *src, size_t *len)
 {
     if (src == NULL)
         return NULL;
@@ -192,29 +698,38 @@ ambstoc32(const char *src)
     const size_t src_len = strlen(src);
 
     char32_t *ret = xmalloc((src_len + 1) * sizeof(ret[0]));
-
-    mbstate_t ps = {0};
-    char32_t *out = ret;
-    const char *in = src;
-    const char *const end = src + src_len + 1;
-
     size_t chars = 0;
-    size_t rc;
 
-    while ((rc = mbrtoc32(out, in, end - in, &ps)) != 0) {
-        switch (rc) {
-        case (size_t)-1:
-        case (size_t)-2:
-        case (size_t)-3:
+    if (locale_is_utf8()) {
+        chars = utf8_decode(ret, src_len, src, src_len);
+        if (chars == (size_t)-1)
             goto err;
+    } else {
+        mbstate_t ps = {0};
+        char32_t *out = ret;
+        const char *in = src;
+        const char *const end = src + src_len + 1;
+
+        size_t rc;
+
+        while ((rc = mbrtoc32(out, in, end - in, &ps)) != 0) {
+            switch (rc) {
+            case (size_t)-1:
+            case (size_t)-2:
+            case (size_t)-3:
+                goto err;
+            }
+
+            in += rc;
+            out++;
+            chars++;
         }
-
-        in += rc;
-        out++;
-        chars++;
     }
 
-    *out = U'\0';
+    ret[chars] = U'\0';
+
+    if (len != NULL)
+        *len = chars;
 
     return xreallocarray(ret, chars + 1, sizeof(ret[0]));
 
@@ -270,10 +785,172 @@ err:
     return NULL;
 }
 
+/* Branch-free; 'A'-'Z' get 0x20 added */
+static inline char32_t
+ascii_lower(char32_t c)
+{
+    return c + ((char32_t)(c - U'A' < 26) << 5);
+}
+
 char32_t
 toc32lower(char32_t c)
 {
-    return (char32_t)towlower((wint_t)c);
+    if (c < 0x80)
+        return ascii_lower(c);
+
+    /* Generated table; see casefold.py */
+    return casefold_lower(c);
+}
+
+#if defined(HAVE_X86_64_SIMD)
+/* Lower cases 4 code points, if they're all ASCII */
+static inline bool
+lower_ascii_sse2(char32_t *dst, const char32_t *src)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(v, _mm_set1_epi32(0x7f))) != 0)
+        return false;
+
+    const __m128i upper = _mm_and_si128(
+        _mm_cmpgt_epi32(v, _mm_set1_epi32(U'A' - 1)),
+        _mm_cmplt_epi32(v, _mm_set1_epi32(U'Z' + 1)));
+
+    _mm_storeu_si128(
+        (__m128i *)dst,
+        _mm_add_epi32(v, _mm_and_si128(upper, _mm_set1_epi32(0x20))));
+    return true;
+}
+#endif
+
+void
+toc32lower_n(char32_t *dst, const char32_t *src, size_t len)
+{
+    size_t i = 0;
+
+#if defined(HAVE_X86_64_SIMD)
+    for (; i + 4 <= len; i += 4) {
+        if (lower_ascii_sse2(&dst[i], &src[i]))
+            continue;
+
+        /* Mixed; avoid (unpredictable) branching on ASCII-or-not */
+        for (size_t j = i; j < i + 4; j++)
+            dst[j] = casefold_lower(src[j]);
+    }
+#endif
+
+    for (; i < len; i++)
+        dst[i] = casefold_lower(src[i]);
+}
+
+size_t
+utf8ntoc32(char32_t *dst, const char *src, size_t len)
+{
+    return utf8_decode(dst, dst != NULL ? len : SIZE_MAX, src, len);
+}
+
+/* Returns the number of bytes written (1-4) */
+static inline size_t
+utf8_encode_one(char *_dst, char32_t c)
+{
+    unsigned char *dst = (unsigned char *)_dst;
+
+    if (c < 0x80) {
+        dst[0] = c;
+        return 1;
+    }
+
+    if (c < 0x800) {
+        dst[0] = 0xc0 | (c >> 6);
+        dst[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+
+    if (c < 0x10000) {
+        dst[0] = 0xe0 | (c >> 12);
+        dst[1] = 0x80 | ((c >> 6) & 0x3f);
+        dst[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+
+    dst[0] = 0xf0 | (c >> 18);
+    dst[1] = 0x80 | ((c >> 12) & 0x3f);
+    dst[2] = 0x80 | ((c >> 6) & 0x3f);
+    dst[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+size_t
+c32ntoutf8(char *dst, const char32_t *src, size_t len)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++)
+        out += utf8_encode_one(&dst[out], src[i]);
+    return out;
+}
+
+#if defined(HAVE_X86_64_SIMD)
+/* Lower cases 16 bytes, if they're all ASCII */
+static inline bool
+utf8_lower_ascii_16(char *dst, const char *src)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+    if (_mm_movemask_epi8(v) != 0)
+        return false;
+
+    const __m128i upper = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+
+    _mm_storeu_si128(
+        (__m128i *)dst,
+        _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+    return true;
+}
+#endif
+
+size_t
+utf8tolower(char *dst, const char *_src, size_t len, size_t *chars)
+{
+    const unsigned char *src = (const unsigned char *)_src;
+
+    size_t count = 0;
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len) {
+#if defined(HAVE_X86_64_SIMD)
+        if (i + 16 <= len && utf8_lower_ascii_16(&dst[out], (const char *)&src[i])) {
+            i += 16;
+            out += 16;
+            count += 16;
+            continue;
+        }
+#endif
+
+        const unsigned char c = src[i];
+
+        if (c < 0x80) {
+            dst[out++] = ascii_lower(c);
+            count++;
+            i++;
+            continue;
+        }
+
+        char32_t cp;
+        const size_t n = utf8_decode_one(&src[i], len - i, &cp);
+
+        if (n == 0)
+            return (size_t)-1;
+
+        out += utf8_encode_one(&dst[out], casefold_lower(cp));
+        count++;
+        i += n;
+    }
+
+    *chars = count;
+    return out;
 }
 
 char32_t
@@ -14,15 +14,70 @@ char32_t *c32memcpy(char32_t *dest, const char32_t *src, size_t n);
 char32_t *c32cat(char32_t *dest, const char32_t *src);
 char32_t *c32dup(const char32_t *s);
 char32_t *c32chr(const char32_t *s, char32_t c);
+char32_t *c32memchr(const char32_t *s, char32_t c, size_t n) PURE;
+char32_t *c32memmem(const char32_t *haystack, size_t haystack_len,
+                    const char32_t *needle, size_t needle_len) PURE;
+
+/*
+ * The c32memchr() and c32memmem() implementations, for
+ * test/bench-c32memmem.c
+ */
+enum c32_impl {
+    C32_IMPL_SCALAR,
+    C32_IMPL_SSE2,
+    C32_IMPL_AVX2,
+};
+
+bool c32_impl_supported(enum c32_impl impl);
+char32_t *c32memchr_using(
+    enum c32_impl impl, const char32_t *s, char32_t c, size_t n);
+char32_t *c32memmem_using(enum c32_impl impl,
+                          const char32_t *haystack, size_t haystack_len,
+                          const char32_t *needle, size_t needle_len);
 
 size_t mbsntoc32(char32_t *dst, const char *src, size_t nms, size_t len);
 size_t mbstoc32(char32_t *dst, const char *src, size_t len);
 size_t c32ntombs(char *dst, const char32_t *src, size_t nwc, size_t len);
 size_t c32tombs(char *dst, const char32_t *src, size_t len);
 char32_t *ambstoc32(const char *src);
+
+/* Like ambstoc32(), but also returns the length of the decoded string */
+char32_t *ambstoc32_len(const char *src, size_t *len);
 char *ac32tombs(const char32_t *src);
 
+/*
+ * Looks up the locale's character set. Must be called after
+ * setlocale(LC_CTYPE), before any of the multibyte conversions are
+ * used.
+ */
+void char32_init(void);
+
+/* True if the locale's character set is UTF-8 (see char32_init()) */
+bool locale_is_utf8(void);
+
+/*
+ * UTF-8 conversions that don't depend on the locale, for text that is
+ * known to be UTF-8.
+ */
+
+/* Decodes 'len' bytes, stopping at NUL. Returns (size_t)-1 on invalid UTF-8 */
+size_t utf8ntoc32(char32_t *dst, const char *src, size_t len);
+
+/* Encodes 'len' code points. 'dst' must have room for 4 * len bytes */
+size_t c32ntoutf8(char *dst, const char32_t *src, size_t len);
+
+/*
+ * Lower cases, and validates, 'len' bytes. 'dst' must have room for
+ * len + len / 2 bytes; lower casing U+023A and U+023E grows them by
+ * one byte. Returns the number of bytes written, or (size_t)-1 on
+ * invalid UTF-8. The number of code points is returned in '*chars'.
+ */
+size_t utf8tolower(char *dst, const char *src, size_t len, size_t *chars);
+
 char32_t toc32lower(char32_t c) CONST_FN;
+
+/* Lower cases 'len' code points. 'dst' may be the same as 'src' */
+void toc32lower_n(char32_t *dst, const char32_t *src, size_t len);
 char32_t toc32upper(char32_t c) CONST_FN;
 
 bool isc32space(char32_t c32) CONST_FN;
@@ -0,0 +1,262 @@
+#include "corpus.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "corpus"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "arena.h"
+#include "char32.h"
+#include "xmalloc.h"
+
+static const enum match_fields field_sources[CORPUS_FIELD_COUNT] = {
+    [CORPUS_TITLE] = MATCH_NAME,
+    [CORPUS_TRANSLATED_NAME] = MATCH_NAME,
+    [CORPUS_BASENAME] = MATCH_FILENAME,
+    [CORPUS_GENERIC_NAME] = MATCH_GENERIC,
+    [CORPUS_EXEC] = MATCH_EXEC,
+    [CORPUS_COMMENT] = MATCH_COMMENT,
+    [CORPUS_MATCH_NTH] = MATCH_NTH,
+};
+
+static struct corpus_list *
+list_init(void)
+{
+    struct corpus_list *list = xmalloc(sizeof(*list));
+    *list = (struct corpus_list){
+        .first = xmalloc(sizeof(list->first[0])),
+    };
+    list->first[0] = 0;
+    return list;
+}
+
+static void
+list_destroy(struct corpus_list *list)
+{
+    if (list == NULL)
+        return;
+
+    free(list->first);
+    free(list->spans);
+    free(list);
+}
+
+struct corpus *
+corpus_init(enum match_fields fields)
+{
+    struct corpus *corpus = xmalloc(sizeof(*corpus));
+    *corpus = (struct corpus){0};
+
+    for (size_t i = 0; i < CORPUS_FIELD_COUNT; i++) {
+        if (fields & field_sources[i])
+            corpus->fields[i] = xmalloc(sizeof(corpus->fields[i][0]));
+    }
+
+    if (fields & MATCH_KEYWORDS)
+        corpus->keywords = list_init();
+    if (fields & MATCH_CATEGORIES)
+        corpus->categories = list_init();
+
+    return corpus;
+}
+
+void
+corpus_destroy(struct corpus *corpus)
+{
+    if (corpus == NULL)
+        return;
+
+    for (size_t i = 0; i < CORPUS_FIELD_COUNT; i++)
+        free(corpus->fields[i]);
+
+    list_destroy(corpus->keywords);
+    list_destroy(corpus->categories);
+    free(corpus->visible);
+    free(corpus->text);
+    free(corpus->titles);
+    arena_destroy(corpus->encoded);
+    free(corpus);
+}
+
+/* Copies 'str' (NUL terminated) to the arena, and returns its span */
+static struct corpus_span
+add_text(struct corpus *corpus, const char32_t *str, size_t len)
+{
+    if (str == NULL)
+        return (struct corpus_span){.offset = CORPUS_ABSENT};
+
+    if (corpus->text_len + len + 1 > corpus->text_size) {
+        size_t new_size = corpus->text_size > 0 ? corpus->text_size * 2 : 4096;
+        while (corpus->text_len + len + 1 > new_size)
+            new_size *= 2;
+
+        corpus->text = xreallocarray(
+            corpus->text, new_size, sizeof(corpus->text[0]));
+        corpus->text_size = new_size;
+    }
+
+    const size_t offset = corpus->text_len;
+    memcpy(&corpus->text[offset], str, len * sizeof(str[0]));
+    corpus->text[offset + len] = U'\0';
+    corpus->text_len += len + 1;
+
+    return (struct corpus_span){.offset = offset, .len = len};
+}
+
+static struct corpus_utf8
+add_title_utf8(struct corpus *corpus, const struct application *app)
+{
+    if (app->dmenu_line_lowercase != NULL) {
+        return (struct corpus_utf8){
+            .text = app->dmenu_line_lowercase,
+            .len = app->dmenu_line_lowercase_len,
+        };
+    }
+
+    if (app->title_lowercase == NULL)
+        return (struct corpus_utf8){0};
+
+    if (corpus->encoded == NULL)
+        corpus->encoded = arena_init();
+
+    char *text = arena_alloc(corpus->encoded, app->title_len * 4 + 1, 1);
+    const size_t len = c32ntoutf8(text, app->title_lowercase, app->title_len);
+    arena_trim(corpus->encoded, text, len + 1);
+
+    return (struct corpus_utf8){.text = text, .len = len};
+}
+
+const char32_t *
+corpus_title(const struct corpus *corpus, size_t idx, char32_t **buf,
+             size_t *buf_size, size_t *len)
+{
+    if (!corpus->utf8_titles)
+        return corpus_text(corpus, CORPUS_TITLE, idx, len);
+
+    size_t bytes;
+    const char *text = corpus_title_utf8(corpus, idx, &bytes);
+
+    if (text == NULL) {
+        *len = 0;
+        return NULL;
+    }
+
+    /* Each code point is at least one byte */
+    if (bytes + 1 > *buf_size) {
+        *buf_size = bytes + 1;
+        *buf = xreallocarray(*buf, *buf_size, sizeof((*buf)[0]));
+    }
+
+    *len = utf8ntoc32(*buf, text, bytes);
+    (*buf)[*len] = U'\0';
+    return *buf;
+}
+
+static void
+add_list(struct corpus *corpus, struct corpus_list *list,
+         const char32_list_t *items)
+{
+    if (list == NULL)
+        return;
+
+    const size_t count = tll_length(*items);
+
+    if (list->span_count + count > list->span_size) {
+        size_t new_size = list->span_size > 0 ? list->span_size * 2 : 256;
+        while (list->span_count + count > new_size)
+            new_size *= 2;
+
+        list->spans = xreallocarray(
+            list->spans, new_size, sizeof(list->spans[0]));
+        list->span_size = new_size;
+    }
+
+    tll_foreach(*items, it) {
+        list->spans[list->span_count++] =
+            add_text(corpus, it->item, c32len(it->item));
+    }
+
+    list->first[corpus->count + 1] = list->span_count;
+}
+
+void
+corpus_append(struct corpus *corpus, const struct application *app)
+{
+    const size_t idx = corpus->count;
+
+    if (idx >= corpus->size) {
+        const size_t new_size = corpus->size > 0 ? corpus->size * 2 : 256;
+
+        for (size_t i = 0; i < CORPUS_FIELD_COUNT; i++) {
+            if (corpus->fields[i] == NULL)
+                continue;
+            corpus->fields[i] = xreallocarray(
+                corpus->fields[i], new_size, sizeof(corpus->fields[i][0]));
+        }
+
+        if (corpus->keywords != NULL) {
+            corpus->keywords->first = xreallocarray(
+                corpus->keywords->first, new_size + 1,
+                sizeof(corpus->keywords->first[0]));
+        }
+
+        if (corpus->categories != NULL) {
+            corpus->categories->first = xreallocarray(
+                corpus->categories->first, new_size + 1,
+                sizeof(corpus->categories->first[0]));
+        }
+
+        if (corpus->titles != NULL) {
+            corpus->titles = xreallocarray(
+                corpus->titles, new_size, sizeof(corpus->titles[0]));
+        }
+
+        corpus->visible = xreallocarray(
+            corpus->visible, new_size, sizeof(corpus->visible[0]));
+        corpus->size = new_size;
+    }
+
+    corpus->visible[idx] = app->visible;
+
+    if (idx == 0 && app->dmenu_line_lowercase != NULL &&
+        corpus->fields[CORPUS_TITLE] != NULL)
+    {
+        corpus->utf8_titles = true;
+        corpus->titles = xmalloc(corpus->size * sizeof(corpus->titles[0]));
+
+        free(corpus->fields[CORPUS_TITLE]);
+        corpus->fields[CORPUS_TITLE] = NULL;
+    }
+
+    const struct {
+        const char32_t *str;
+        size_t len;
+    } sources[CORPUS_FIELD_COUNT] = {
+        [CORPUS_TITLE] = {app->title_lowercase, app->title_len},
+        [CORPUS_TRANSLATED_NAME] = {app->translated_name, app->translated_name_len},
+        [CORPUS_BASENAME] = {app->basename, app->basename_len},
+        [CORPUS_GENERIC_NAME] = {app->generic_name, app->generic_name_len},
+        [CORPUS_EXEC] = {app->wexec, app->wexec_len},
+        [CORPUS_COMMENT] = {app->comment, app->comment_len},
+        [CORPUS_MATCH_NTH] = {app->dmenu_match_nth, app->dmenu_match_nth_len},
+    };
+
+    for (size_t i = 0; i < CORPUS_FIELD_COUNT; i++) {
+        if (corpus->fields[i] == NULL)
+            continue;
+
+        corpus->fields[i][idx] =
+            add_text(corpus, sources[i].str, sources[i].len);
+    }
+
+    if (corpus->titles != NULL)
+        corpus->titles[idx] = add_title_utf8(corpus, app);
+
+    add_list(corpus, corpus->keywords, &app->keywords);
+    add_list(corpus, corpus->categories, &app->categories);
+
+    corpus->count++;
+
+    LOG_DBG("entry #%zu: %zu code points in arena", idx, corpus->text_len);
+}
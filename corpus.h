@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
+
+#include "application.h"
+#include "config.h"
+
+/*
+ * Contiguous, read-only copy of the (lower cased) application fields
+ * that are matched against.
+ *
+ * All text lives in a single arena. Each field is an array of spans
+ * into the arena, indexed by the application's index in the
+ * application list. Keywords and categories are flattened into span
+ * arrays of their own, with a per-application index of the first one.
+ *
+ * Only the fields enabled when the corpus was created are copied.
+ * Entries can only be appended, and the corpus must not be appended
+ * to while it is being searched.
+ *
+ * dmenu entries that keep their line as UTF-8 (see dmenu_line in
+ * struct application) have their titles matched as UTF-8 too. These
+ * aren't copied; the corpus refers to the (immutable) lower cased
+ * lines, and must not outlive the applications. This is decided by
+ * the first entry; later entries without a UTF-8 title have theirs
+ * encoded, into an arena of their own.
+ */
+enum corpus_field {
+    CORPUS_TITLE,
+    CORPUS_TRANSLATED_NAME,
+    CORPUS_BASENAME,
+    CORPUS_GENERIC_NAME,
+    CORPUS_EXEC,
+    CORPUS_COMMENT,
+    CORPUS_MATCH_NTH,
+    CORPUS_FIELD_COUNT,
+};
+
+/* Offset of fields the application doesn't have */
+#define CORPUS_ABSENT SIZE_MAX
+
+struct corpus_span {
+    size_t offset;
+    size_t len;
+};
+
+struct corpus_utf8 {
+    const char *text;  /* NULL if absent */
+    size_t len;
+};
+
+struct corpus_list {
+    size_t *first;  /* count + 1 elements */
+    struct corpus_span *spans;
+    size_t span_count;
+    size_t span_size;
+};
+
+struct corpus {
+    char32_t *text;
+    size_t text_len;
+    size_t text_size;
+
+    /* Titles are UTF-8, in 'titles', instead of in fields[CORPUS_TITLE] */
+    bool utf8_titles;
+    struct corpus_utf8 *titles;  /* NULL if not copied */
+    struct arena *encoded;       /* Titles that had to be encoded */
+
+    size_t count;
+    size_t size;
+
+    bool *visible;
+    struct corpus_span *fields[CORPUS_FIELD_COUNT];  /* NULL if not copied */
+    struct corpus_list *keywords;                    /* NULL if not copied */
+    struct corpus_list *categories;                  /* NULL if not copied */
+};
+
+struct corpus *corpus_init(enum match_fields fields);
+void corpus_destroy(struct corpus *corpus);
+
+/* Appends 'app' as entry number corpus->count */
+void corpus_append(struct corpus *corpus, const struct application *app);
+
+/*
+ * Returns NULL if the field is absent, or hasn't been copied. Must
+ * not be used for CORPUS_TITLE, if 'utf8_titles' is set
+ */
+static inline const char32_t *
+corpus_text(const struct corpus *corpus, enum corpus_field field, size_t idx,
+            size_t *len)
+{
+    const struct corpus_span *spans = corpus->fields[field];
+    if (spans == NULL || spans[idx].offset == CORPUS_ABSENT) {
+        *len = 0;
+        return NULL;
+    }
+
+    *len = spans[idx].len;
+    return &corpus->text[spans[idx].offset];
+}
+
+/*
+ * UTF-8 titles: returns the lower cased title, 'len' bytes long (not
+ * NUL terminated), or NULL if absent, or not copied
+ */
+static inline const char *
+corpus_title_utf8(const struct corpus *corpus, size_t idx, size_t *len)
+{
+    if (corpus->titles == NULL) {
+        *len = 0;
+        return NULL;
+    }
+
+    *len = corpus->titles[idx].len;
+    return corpus->titles[idx].text;
+}
+
+/*
+ * Returns the lower cased title as UTF-32, decoding it into 'buf' if
+ * stored as UTF-8. 'buf' is grown as necessary. Returns NULL if the
+ * title hasn't been copied.
+ */
+const char32_t *corpus_title(
+    const struct corpus *corpus, size_t idx, char32_t **buf, size_t *buf_size,
+    size_t *len);
+
+static inline size_t
+corpus_list_count(const struct corpus_list *list, size_t idx)
+{
+    return list != NULL ? list->first[idx + 1] - list->first[idx] : 0;
+}
+
+static inline const char32_t *
+corpus_list_item(const struct corpus *corpus, const struct corpus_list *list,
+                 size_t idx, size_t item, size_t *len)
+{
+    const struct corpus_span *span = &list->spans[list->first[idx] + item];
+    *len = span->len;
+    return &corpus->text[span->offset];
+}
@@ -0,0 +1,455 @@
+#include "desktop-cache.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "desktop-cache"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "char32.h"
+#include "xdg.h"
+#include "xmalloc.h"
+#include "xsnprintf.h"
+
+#define CACHE_FILE_NAME "fuzzel-desktop-entries"
+#define CACHE_MAGIC "fzldesk"
+#define CACHE_VERSION 1
+
+enum {
+    ENTRY_VISIBLE = 1 << 0,
+    ENTRY_STARTUP_NOTIFY = 1 << 1,
+};
+
+struct entry {
+    /* UTF-8 */
+    struct cache_ref id;
+    struct cache_ref path;
+    struct cache_ref exec;
+    struct cache_ref app_id;
+    struct cache_ref icon;
+    struct cache_ref desktop_file_path;
+    struct cache_ref action_id;
+
+    /* UTF-32 */
+    struct cache_ref title;
+    struct cache_ref title_lowercase;
+    struct cache_ref basename;
+    struct cache_ref wexec;
+    struct cache_ref generic_name;
+    struct cache_ref comment;
+    struct cache_ref translated_name;
+    struct cache_ref original_name;
+    struct cache_ref localized_name;
+    struct cache_ref action_name;
+    struct cache_ref localized_action_name;
+    struct cache_ref original_generic_name;
+    struct cache_ref localized_generic_name;
+
+    /* Arrays of UTF-32 strings */
+    struct cache_ref keywords;
+    struct cache_ref categories;
+
+    uint32_t flags;
+};
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;             /* Total file size */
+    struct cache_ref key;      /* UTF-8 */
+    struct cache_ref dirs;     /* struct cache_stamp[] */
+    struct cache_ref files;    /* struct cache_stamp[] */
+    struct cache_ref entries;  /* struct entry[] */
+};
+
+static char *
+cache_file_path(void)
+{
+    const char *cache_dir = xdg_cache_dir();
+    if (cache_dir == NULL)
+        return NULL;
+
+    return xasprintf("%s/" CACHE_FILE_NAME, cache_dir);
+}
+
+void
+desktop_cache_init(struct desktop_cache *cache, char *key)
+{
+    *cache = (struct desktop_cache){
+        .key = key,
+        .dirs = tll_init(),
+        .files = tll_init(),
+    };
+}
+
+void
+desktop_cache_destroy(struct desktop_cache *cache)
+{
+    free(cache->key);
+    cache_path_stamps_destroy(&cache->dirs);
+    cache_path_stamps_destroy(&cache->files);
+
+    cache_map_close(&cache->map);
+    cache->key = NULL;
+}
+
+void
+desktop_cache_add_dir(struct desktop_cache *cache, const char *path,
+                      const struct stat *st)
+{
+    cache_path_stamps_add(&cache->dirs, path, st);
+}
+
+void
+desktop_cache_add_file(struct desktop_cache *cache, const char *path,
+                       const struct stat *st)
+{
+    cache_path_stamps_add(&cache->files, path, st);
+}
+
+static bool
+c32_valid(const struct cache_map *map, struct cache_ref ref)
+{
+    if (ref.offset == 0)
+        return ref.len == 0;
+
+    return ref.offset % alignof(char32_t) == 0 &&
+           ref.offset < map->size &&
+           (map->size - ref.offset) / sizeof(char32_t) > ref.len &&
+           ((const char32_t *)&map->data[ref.offset])[ref.len] == U'\0';
+}
+
+static char *
+utf8_dup(const struct cache_map *map, struct cache_ref ref)
+{
+    if (ref.offset == 0)
+        return NULL;
+    return xmemdup(&map->data[ref.offset], ref.len + 1);
+}
+
+static char32_t *
+c32_dup(const struct cache_map *map, struct cache_ref ref)
+{
+    if (ref.offset == 0)
+        return NULL;
+    return xmemdup(&map->data[ref.offset], (ref.len + 1) * sizeof(char32_t));
+}
+
+static bool
+c32_list_valid(const struct cache_map *map, struct cache_ref ref)
+{
+    if (!cache_array_valid(map, ref, sizeof(struct cache_ref),
+                           alignof(struct cache_ref)))
+    {
+        return false;
+    }
+
+    const struct cache_ref *items = cache_array_at(map, ref);
+    for (size_t i = 0; i < ref.len; i++) {
+        if (items[i].offset == 0 || !c32_valid(map, items[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+entry_valid(const struct cache_map *map, const struct entry *e)
+{
+    return cache_utf8_valid(map, e->id) &&
+           cache_utf8_valid(map, e->path) &&
+           cache_utf8_valid(map, e->exec) &&
+           cache_utf8_valid(map, e->app_id) &&
+           cache_utf8_valid(map, e->icon) &&
+           cache_utf8_valid(map, e->desktop_file_path) &&
+           cache_utf8_valid(map, e->action_id) &&
+           c32_valid(map, e->title) && e->title.offset != 0 &&
+           c32_valid(map, e->title_lowercase) &&
+           e->title_lowercase.len == e->title.len &&
+           c32_valid(map, e->basename) &&
+           c32_valid(map, e->wexec) &&
+           c32_valid(map, e->generic_name) &&
+           c32_valid(map, e->comment) &&
+           c32_valid(map, e->translated_name) &&
+           c32_valid(map, e->original_name) &&
+           c32_valid(map, e->localized_name) &&
+           c32_valid(map, e->action_name) &&
+           c32_valid(map, e->localized_action_name) &&
+           c32_valid(map, e->original_generic_name) &&
+           c32_valid(map, e->localized_generic_name) &&
+           c32_list_valid(map, e->keywords) &&
+           c32_list_valid(map, e->categories);
+}
+
+static bool
+cache_valid(const struct cache_map *map, const char *key)
+{
+    if (map->size < sizeof(struct header))
+        return false;
+
+    const struct header *hdr = (const struct header *)map->data;
+
+    if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != CACHE_VERSION ||
+        hdr->size != map->size)
+    {
+        LOG_DBG("invalid header, or unsupported version");
+        return false;
+    }
+
+    if (!cache_utf8_valid(map, hdr->key) ||
+        hdr->key.len != strlen(key) ||
+        memcmp(&map->data[hdr->key.offset], key, hdr->key.len) != 0)
+    {
+        LOG_DBG("key mismatch (locale, options or XDG data directories)");
+        return false;
+    }
+
+    if (!cache_stamps_valid(map, hdr->dirs) ||
+        !cache_stamps_valid(map, hdr->files) ||
+        !cache_stamps_unchanged(map, hdr->dirs))
+    {
+        return false;
+    }
+
+    if (!cache_array_valid(map, hdr->entries, sizeof(struct entry),
+                           alignof(struct entry)))
+    {
+        return false;
+    }
+
+    const struct entry *entries = cache_array_at(map, hdr->entries);
+    for (size_t i = 0; i < hdr->entries.len; i++) {
+        if (!entry_valid(map, &entries[i])) {
+            LOG_DBG("entry #%zu: corrupt", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static char32_list_t
+c32_list_dup(const struct cache_map *map, struct cache_ref ref)
+{
+    char32_list_t list = tll_init();
+    const struct cache_ref *items = cache_array_at(map, ref);
+
+    for (size_t i = 0; i < ref.len; i++)
+        tll_push_back(list, c32_dup(map, items[i]));
+
+    return list;
+}
+
+static struct application *
+entry_to_application(const struct cache_map *map, const struct entry *e)
+{
+    struct application *app = xmalloc(sizeof(*app));
+    *app = (struct application){
+        .id = utf8_dup(map, e->id),
+        .index = 0,  /* Not used in application mode */
+        .path = utf8_dup(map, e->path),
+        .exec = utf8_dup(map, e->exec),
+        .app_id = utf8_dup(map, e->app_id),
+        .title = c32_dup(map, e->title),
+        .title_lowercase = c32_dup(map, e->title_lowercase),
+        .basename = c32_dup(map, e->basename),
+        .wexec = c32_dup(map, e->wexec),
+        .generic_name = c32_dup(map, e->generic_name),
+        .comment = c32_dup(map, e->comment),
+        .translated_name = c32_dup(map, e->translated_name),
+        .keywords = c32_list_dup(map, e->keywords),
+        .categories = c32_list_dup(map, e->categories),
+        .title_len = e->title.len,
+        .basename_len = e->basename.len,
+        .translated_name_len = e->translated_name.len,
+        .wexec_len = e->wexec.len,
+        .generic_name_len = e->generic_name.len,
+        .comment_len = e->comment.len,
+        .icon = {.name = utf8_dup(map, e->icon)},
+        .visible = (e->flags & ENTRY_VISIBLE) != 0,
+        .startup_notify = (e->flags & ENTRY_STARTUP_NOTIFY) != 0,
+        .count = 0,
+        .desktop_file_path = utf8_dup(map, e->desktop_file_path),
+        .action_id = utf8_dup(map, e->action_id),
+        .original_name = c32_dup(map, e->original_name),
+        .localized_name = c32_dup(map, e->localized_name),
+        .action_name = c32_dup(map, e->action_name),
+        .localized_action_name = c32_dup(map, e->localized_action_name),
+        .original_generic_name = c32_dup(map, e->original_generic_name),
+        .localized_generic_name = c32_dup(map, e->localized_generic_name),
+    };
+    return app;
+}
+
+bool
+desktop_cache_load(struct desktop_cache *cache, struct application_list *apps)
+{
+    assert(cache->map.data == NULL);
+
+    char *path = cache_file_path();
+    if (path == NULL)
+        return false;
+
+    struct cache_map map;
+    if (!cache_map_open(&map, path, sizeof(struct header))) {
+        free(path);
+        return false;
+    }
+
+    if (!cache_valid(&map, cache->key)) {
+        LOG_DBG("%s: stale", path);
+        cache_map_close(&map);
+        free(path);
+        return false;
+    }
+
+    const struct header *hdr = (const struct header *)map.data;
+    const struct entry *entries = cache_array_at(&map, hdr->entries);
+
+    for (size_t i = 0; i < hdr->entries.len; i++)
+        applications_append(apps, entry_to_application(&map, &entries[i]));
+    applications_publish(apps);
+
+    LOG_DBG("%s: loaded %u entries", path, hdr->entries.len);
+
+    cache->map = map;
+    cache->count = hdr->entries.len;
+    free(path);
+    return true;
+}
+
+bool
+desktop_cache_files_changed(const struct desktop_cache *cache)
+{
+    if (cache->map.data == NULL)
+        return false;
+
+    const struct header *hdr = (const struct header *)cache->map.data;
+    return !cache_stamps_unchanged(&cache->map, hdr->files);
+}
+
+static struct cache_ref
+buf_add_c32(struct cache_buf *buf, const char32_t *s)
+{
+    if (s == NULL)
+        return (struct cache_ref){0};
+
+    const size_t len = c32len(s);
+    const size_t offset = cache_buf_reserve(
+        buf, (len + 1) * sizeof(char32_t), alignof(char32_t));
+    memcpy(&buf->data[offset], s, (len + 1) * sizeof(char32_t));
+    return (struct cache_ref){.offset = offset, .len = len};
+}
+
+static struct cache_ref
+buf_add_c32_list(struct cache_buf *buf, const char32_list_t *list)
+{
+    const size_t count = tll_length(*list);
+    if (count == 0)
+        return (struct cache_ref){0};
+
+    const size_t offset = cache_buf_reserve(
+        buf, count * sizeof(struct cache_ref), alignof(struct cache_ref));
+
+    size_t i = 0;
+    tll_foreach(*list, it) {
+        const struct cache_ref item = buf_add_c32(buf, it->item);
+        memcpy(&buf->data[offset + i++ * sizeof(item)], &item, sizeof(item));
+    }
+
+    return (struct cache_ref){.offset = offset, .len = count};
+}
+
+static void
+buf_add_application(struct cache_buf *buf, size_t offset,
+                    const struct application *app)
+{
+    struct entry e = {0};
+
+    e.id = cache_buf_add_utf8(buf, app->id);
+    e.path = cache_buf_add_utf8(buf, app->path);
+    e.exec = cache_buf_add_utf8(buf, app->exec);
+    e.app_id = cache_buf_add_utf8(buf, app->app_id);
+    e.icon = cache_buf_add_utf8(buf, app->icon.name);
+    e.desktop_file_path = cache_buf_add_utf8(buf, app->desktop_file_path);
+    e.action_id = cache_buf_add_utf8(buf, app->action_id);
+
+    e.title = buf_add_c32(buf, app->title);
+    e.title_lowercase = buf_add_c32(buf, app->title_lowercase);
+    e.basename = buf_add_c32(buf, app->basename);
+    e.wexec = buf_add_c32(buf, app->wexec);
+    e.generic_name = buf_add_c32(buf, app->generic_name);
+    e.comment = buf_add_c32(buf, app->comment);
+    e.translated_name = buf_add_c32(buf, app->translated_name);
+    e.original_name = buf_add_c32(buf, app->original_name);
+    e.localized_name = buf_add_c32(buf, app->localized_name);
+    e.action_name = buf_add_c32(buf, app->action_name);
+    e.localized_action_name = buf_add_c32(buf, app->localized_action_name);
+    e.original_generic_name = buf_add_c32(buf, app->original_generic_name);
+    e.localized_generic_name = buf_add_c32(buf, app->localized_generic_name);
+
+    e.keywords = buf_add_c32_list(buf, &app->keywords);
+    e.categories = buf_add_c32_list(buf, &app->categories);
+
+    e.flags = (app->visible ? ENTRY_VISIBLE : 0) |
+              (app->startup_notify ? ENTRY_STARTUP_NOTIFY : 0);
+
+    memcpy(&buf->data[offset], &e, sizeof(e));
+}
+
+void
+desktop_cache_save(const struct desktop_cache *cache,
+                   const struct application_list *apps)
+{
+    char *path = cache_file_path();
+    if (path == NULL)
+        return;
+
+    struct cache_buf buf = {0};
+    const size_t hdr_offset = cache_buf_reserve(
+        &buf, sizeof(struct header), alignof(struct header));
+    assert(hdr_offset == 0);
+
+    struct header hdr = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+    };
+
+    hdr.key = cache_buf_add_utf8(&buf, cache->key);
+    hdr.dirs = cache_buf_add_stamps(&buf, &cache->dirs);
+    hdr.files = cache_buf_add_stamps(&buf, &cache->files);
+
+    const size_t entries_offset = cache_buf_reserve(
+        &buf, cache->count * sizeof(struct entry), alignof(struct entry));
+    hdr.entries = (struct cache_ref){
+        .offset = entries_offset,
+        .len = cache->count,
+    };
+
+    for (size_t i = 0; i < cache->count; i++) {
+        buf_add_application(
+            &buf, entries_offset + i * sizeof(struct entry),
+            applications_get(apps, i));
+    }
+
+    if (buf.len > UINT32_MAX) {
+        LOG_WARN("%s: too large, not saving desktop entry cache", path);
+        goto out;
+    }
+
+    hdr.size = buf.len;
+    memcpy(&buf.data[hdr_offset], &hdr, sizeof(hdr));
+
+    if (cache_file_replace(path, buf.data, buf.len, 0600)) {
+        LOG_DBG("%s: saved %zu entries (%zu bytes)",
+                path, cache->count, buf.len);
+    }
+
+out:
+    free(buf.data);
+    free(path);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/stat.h>
+
+#include "application.h"
+#include "cache-file.h"
+
+/*
+ * Binary cache of parsed desktop entries, in
+ * $XDG_CACHE_HOME/fuzzel-desktop-entries.
+ *
+ * The file is mapped, and consists of fixed size records referring
+ * to NUL terminated strings (UTF-8 and UTF-32) by offset. It is
+ * tagged with a key, describing everything (other than the desktop
+ * files themselves) the parsed entries depend on: locale, terminal,
+ * desktop filtering, and the list of XDG data directories.
+ *
+ * The cache is up to date when the key matches, and none of the
+ * scanned directories have changed (mtime, device and inode). This
+ * catches added, removed and renamed desktop files, files replaced
+ * by renaming a new version over them (as package managers do), and
+ * symlinked directories being re-targeted (Nix profiles, where all
+ * mtimes are the same). Files edited in place are caught by
+ * desktop_cache_files_changed(), which is meant to be run once the
+ * entries have been published.
+ */
+
+struct desktop_cache {
+    char *key;
+
+    /* Recorded while scanning, i.e. when not loaded from the cache */
+    cache_path_stamps_t dirs;
+    cache_path_stamps_t files;
+    size_t count;  /* Number of (leading) entries in the application list */
+
+    /* The cache file, if the entries were loaded from it */
+    struct cache_map map;
+};
+
+/* Takes ownership of 'key' */
+void desktop_cache_init(struct desktop_cache *cache, char *key);
+void desktop_cache_destroy(struct desktop_cache *cache);
+
+/* 'st' is NULL if the path doesn't exist */
+void desktop_cache_add_dir(
+    struct desktop_cache *cache, const char *path, const struct stat *st);
+void desktop_cache_add_file(
+    struct desktop_cache *cache, const char *path, const struct stat *st);
+
+/*
+ * Appends (and publishes) all cached entries to 'apps', if the cache
+ * exists and is up to date. Returns false otherwise, in which case
+ * 'apps' is left untouched.
+ */
+bool desktop_cache_load(
+    struct desktop_cache *cache, struct application_list *apps);
+
+/* True if any of the desktop files loaded from the cache has changed */
+bool desktop_cache_files_changed(const struct desktop_cache *cache);
+
+/*
+ * Writes the first 'cache->count' entries of 'apps', and the recorded
+ * directories and files, to the cache file. The file is replaced
+ * atomically.
+ */
+void desktop_cache_save(
+    const struct desktop_cache *cache, const struct application_list *apps);
@@ -2,14 +2,21 @@
 #include "column.h"
 #include "icon.h"
 
+#include <assert.h>
+#include <stdalign.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <threads.h>
 #include <uchar.h>
 #include <unistd.h>
 
@@ -18,18 +25,530 @@
 #define LOG_MODULE "dmenu"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
+#include "arena.h"
 #include "char32.h"
 #include "event.h"
 #include "macros.h"
 #include "xmalloc.h"
 
-void
-dmenu_load_entries(struct application_list *applications, char delim,
-                   const char *with_nth_format, const char *match_nth_format,
-                   char nth_delim, int event_fd, int abort_fd)
+/* Copies a (heap allocated) string into the arena, and frees it */
+static char32_t *
+move_to_arena(struct arena *arena, char32_t *str, size_t *len)
+{
+    *len = c32len(str);
+
+    char32_t *copy = arena_alloc(
+        arena, (*len + 1) * sizeof(copy[0]), alignof(char32_t));
+    c32memcpy(copy, str, *len + 1);
+
+    free(str);
+    return copy;
+}
+
+/*
+ * Like ambstoc32(), but decodes directly into the arena. 'src' is
+ * 'src_len' bytes, and need not be NUL terminated. Decoding stops at
+ * an embedded NUL, if any.
+ */
+static char32_t *
+arena_mbstoc32(struct arena *arena, const char *src, size_t src_len,
+               size_t *len)
+{
+    /* Each code point is at least one byte */
+    char32_t *ret = arena_alloc(
+        arena, (src_len + 1) * sizeof(ret[0]), alignof(char32_t));
+
+    const size_t chars = mbsntoc32(ret, src, src_len, src_len);
+    if (chars == (size_t)-1) {
+        arena_trim(arena, ret, 0);
+        return NULL;
+    }
+
+    ret[chars] = U'\0';
+    *len = chars;
+
+    arena_trim(arena, ret, (chars + 1) * sizeof(ret[0]));
+    return ret;
+}
+
+static char32_t *
+arena_c32tolower(struct arena *arena, const char32_t *str, size_t len)
+{
+    char32_t *lowercase = arena_alloc(
+        arena, (len + 1) * sizeof(lowercase[0]), alignof(char32_t));
+
+    toc32lower_n(lowercase, str, len);
+    lowercase[len] = U'\0';
+    return lowercase;
+}
+
+/*
+ * Input is read by a single thread, which only looks for the last
+ * delimiter in what it has read. Everything up to, and including, it
+ * is handed off as a chunk to a pool of decoder threads. They split
+ * the chunk into lines, and do the expensive part: UTF-8 decoding,
+ * lower casing and column extraction.
+ *
+ * When stdin is a regular file, it is mapped instead, and the chunks
+ * point directly into the mapping.
+ *
+ * Chunks are published to the application list in input order, by
+ * whichever decoder completes the oldest unpublished chunk.
+ */
+
+/* Don't hand off less than this, unless the input has dried up */
+#define CHUNK_MIN_SIZE (64 * 1024)
+
+/* Approximate chunk size, when stdin is mapped */
+#define CHUNK_MAPPED_SIZE (1024 * 1024)
+
+struct chunk {
+    const char *data;
+    size_t size;   /* All lines, except possibly the last, end with 'delim' */
+    char *buffer;  /* Heap allocation backing 'data', NULL if mapped */
+
+    bool decoded;
+    struct application **entries;
+    size_t count;
+};
+
+struct decoder;
+
+struct pipeline {
+    struct application_list *applications;
+    char delim;
+    const char *with_nth_format;
+    const char *match_nth_format;
+    char nth_delim;
+    int event_fd;
+
+    /* Launch counts, looked up before entries are published */
+    struct popularity_cache *popularity;
+
+    /* Keep lines as UTF-8, and decode titles on demand */
+    bool utf8_lines;
+
+    mtx_t lock;
+    cnd_t work;   /* Chunk queued, or no more input */
+    cnd_t space;  /* Chunk dequeued */
+    tll(struct chunk *) queue;      /* Waiting to be decoded */
+    tll(struct chunk *) in_order;   /* Not yet published */
+    bool no_more_input;
+
+    struct decoder *decoders;
+    size_t decoder_count;
+    size_t max_decoders;
+};
+
+struct decoder {
+    struct pipeline *pipeline;
+    struct arena *arena;
+    thrd_t thread;
+};
+
+/*
+ * Only validates, and lower cases, the line. 'title' is decoded on
+ * demand, by application_title()
+ */
+static bool
+decode_line_utf8(struct arena *arena, struct application *app,
+                 const char *line, size_t text_len, bool mapped)
+{
+    /* Lower casing may grow the text; see utf8tolower() */
+    char *lowercase = arena_alloc(arena, text_len + text_len / 2, 1);
+
+    size_t chars;
+    const size_t lowercase_len = utf8tolower(
+        lowercase, line, text_len, &chars);
+
+    if (lowercase_len == (size_t)-1) {
+        arena_trim(arena, lowercase, 0);
+        return false;
+    }
+
+    const bool unchanged =
+        lowercase_len == text_len && memcmp(lowercase, line, text_len) == 0;
+
+    if (unchanged)
+        arena_trim(arena, lowercase, 0);
+    else
+        arena_trim(arena, lowercase, lowercase_len);
+
+    /* Mapped input stays mapped; point into it instead of copying */
+    if (!mapped) {
+        char *copy = arena_alloc(arena, text_len, 1);
+        memcpy(copy, line, text_len);
+        line = copy;
+    }
+
+    app->dmenu_line = line;
+    app->dmenu_line_len = text_len;
+    app->dmenu_line_lowercase = unchanged ? line : lowercase;
+    app->dmenu_line_lowercase_len = lowercase_len;
+    app->title_len = chars;
+    return true;
+}
+
+/* Decodes a single line. Returns NULL if it isn't valid */
+static struct application *
+decode_line(const struct pipeline *pipeline, struct arena *arena,
+            const char *line, size_t entry_len, bool mapped)
+{
+    const char *const line_end = line + entry_len;
+
+    /*
+     * Support Rofi’s extended dmenu protocol. One can specify
+     * an icon by appending ‘\0icon\x1f<icon-name>’ to the
+     * entry:
+     *
+     *  “hello world\0icon\x1ffirefox”
+     *
+     * We also support fallback icons using comma-separated values.
+     * When the primary icon is not found, subsequent icons in the
+     * list will be tried until one is successfully loaded:
+     *
+     *  “hello world\0icon\x1ffirefox,web-browser,application-x-executable”
+     */
+    char *icon_name = NULL;
+    const char *extra = memchr(line, '\0', entry_len);
+
+    if (extra != NULL) {
+        const size_t extra_len = line_end - extra;
+
+        /*
+         * 'extra' is "\0icon\x1f" - 6 characters. Require
+         * *more* than 6, since icon *name* cannot be empty
+         */
+        if (extra_len > 6 && memcmp(extra, "\0icon\x1f", 6) == 0)
+            icon_name = xstrndup(extra + 6, line_end - (extra + 6));
+    }
+
+    const size_t text_len = extra != NULL ? (size_t)(extra - line) : entry_len;
+    LOG_DBG("%.*s (icon=%s)", (int)text_len, line, icon_name);
+
+    if (pipeline->utf8_lines) {
+        struct application *app = arena_alloc(
+            arena, sizeof(*app), alignof(struct application));
+        *app = (struct application){
+            .icon = {.name = icon_name},
+            .visible = true,
+        };
+
+        if (!decode_line_utf8(arena, app, line, text_len, mapped)) {
+            arena_trim(arena, app, 0);
+            free(icon_name);
+            return NULL;
+        }
+
+        return app;
+    }
+
+    size_t wline_len;
+    char32_t *wline = arena_mbstoc32(arena, line, text_len, &wline_len);
+
+    if (wline == NULL) {
+        free(icon_name);
+        return NULL;
+    }
+
+    /* The title is the input line itself, unless --with-nth */
+    char32_t *title = wline;
+    size_t title_len = wline_len;
+
+    if (pipeline->with_nth_format != NULL) {
+        title = move_to_arena(
+            arena,
+            nth_column(wline, pipeline->nth_delim, pipeline->with_nth_format),
+            &title_len);
+    }
+
+    char32_t *lowercase = arena_c32tolower(arena, title, title_len);
+
+    char32_t *match_nth = NULL;
+    size_t match_nth_len = 0;
+
+    if (pipeline->match_nth_format != NULL) {
+        char32_t *column = nth_column(
+            wline, pipeline->nth_delim, pipeline->match_nth_format);
+        size_t column_len = c32len(column);
+
+        match_nth = arena_c32tolower(arena, column, column_len);
+        match_nth_len = column_len;
+        free(column);
+    }
+
+    if (!mapped) {
+        char *copy = arena_alloc(arena, text_len, 1);
+        memcpy(copy, line, text_len);
+        line = copy;
+    }
+
+    struct application *app = arena_alloc(
+        arena, sizeof(*app), alignof(struct application));
+    *app = (struct application){
+        .dmenu_line = line,
+        .dmenu_line_len = text_len,
+        .dmenu_match_nth = match_nth,
+        .dmenu_match_nth_len = match_nth_len,
+        .title = title,
+        .title_lowercase = lowercase,
+        .title_len = title_len,
+        .icon = {.name = icon_name},
+        .visible = true,
+    };
+
+    return app;
+}
+
+static void
+decode_chunk(const struct pipeline *pipeline, struct arena *arena,
+             struct chunk *chunk)
+{
+    size_t entries_size = 0;
+
+    const char *line = chunk->data;
+    const char *const end = chunk->data + chunk->size;
+
+    while (line < end) {
+        const char *delim_at = memchr(line, pipeline->delim, end - line);
+        if (delim_at == NULL) {
+            LOG_DBG("last line: no delimiter");
+            delim_at = end;
+        }
+
+        struct application *app = decode_line(
+            pipeline, arena, line, delim_at - line, chunk->buffer == NULL);
+        line = delim_at + 1;
+
+        if (app == NULL)
+            continue;
+
+        if (chunk->count >= entries_size) {
+            entries_size = entries_size > 0 ? entries_size * 2 : 256;
+            chunk->entries = xreallocarray(
+                chunk->entries, entries_size, sizeof(chunk->entries[0]));
+        }
+
+        chunk->entries[chunk->count++] = app;
+    }
+
+    /* The raw input is no longer needed */
+    free(chunk->buffer);
+    chunk->buffer = NULL;
+    chunk->data = NULL;
+}
+
+/* Publishes all decoded chunks at the head of the queue. Called with the pipeline lock held */
+static void
+publish_chunks(struct pipeline *pipeline)
+{
+    struct application_list *applications = pipeline->applications;
+
+    while (tll_length(pipeline->in_order) > 0 &&
+           tll_front(pipeline->in_order)->decoded)
+    {
+        struct chunk *chunk = tll_pop_front(pipeline->in_order);
+
+        if (chunk->count > 0) {
+            for (size_t i = 0; i < chunk->count; i++) {
+                struct application *app = chunk->entries[i];
+                app->index = applications->appended;
+
+                if (pipeline->popularity != NULL)
+                    popularity_cache_apply(pipeline->popularity, app);
+
+                applications_append(applications, app);
+            }
+
+            applications_publish(applications);
+
+            if (pipeline->event_fd >= 0)
+                send_event(pipeline->event_fd, EVENT_APPS_SOME_LOADED);
+        }
+
+        free(chunk->entries);
+        free(chunk);
+    }
+}
+
+/* THREAD */
+static int
+decoder_thread(void *_ctx)
 {
-    tll(struct application *) entries = tll_init();
+    struct decoder *decoder = _ctx;
+    struct pipeline *pipeline = decoder->pipeline;
+
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    while (true) {
+        mtx_lock(&pipeline->lock);
+
+        while (tll_length(pipeline->queue) == 0 && !pipeline->no_more_input)
+            cnd_wait(&pipeline->work, &pipeline->lock);
+
+        if (tll_length(pipeline->queue) == 0) {
+            mtx_unlock(&pipeline->lock);
+            break;
+        }
+
+        struct chunk *chunk = tll_pop_front(pipeline->queue);
+        cnd_signal(&pipeline->space);
+        mtx_unlock(&pipeline->lock);
+
+        decode_chunk(pipeline, decoder->arena, chunk);
 
+        mtx_lock(&pipeline->lock);
+        chunk->decoded = true;
+        publish_chunks(pipeline);
+        mtx_unlock(&pipeline->lock);
+    }
+
+    return 0;
+}
+
+static void
+start_decoder(struct pipeline *pipeline)
+{
+    struct decoder *decoder = &pipeline->decoders[pipeline->decoder_count];
+    *decoder = (struct decoder){
+        .pipeline = pipeline,
+        .arena = arena_init(),
+    };
+
+    int ret = thrd_create(&decoder->thread, &decoder_thread, decoder);
+    if (ret != thrd_success) {
+        LOG_ERR("failed to create dmenu decoder thread: %d", ret);
+        arena_destroy(decoder->arena);
+        return;
+    }
+
+    pipeline->decoder_count++;
+}
+
+/*
+ * Hands 'data' (complete lines) to the decoders. 'buffer', if
+ * non-NULL, is freed once the chunk has been decoded
+ */
+static void
+queue_chunk(struct pipeline *pipeline, const char *data, size_t size,
+            char *buffer)
+{
+    struct chunk *chunk = xmalloc(sizeof(*chunk));
+    *chunk = (struct chunk){.data = data, .size = size, .buffer = buffer};
+
+    mtx_lock(&pipeline->lock);
+
+    /* Don't let the reader run too far ahead of the decoders */
+    while (tll_length(pipeline->queue) >= pipeline->max_decoders * 4)
+        cnd_wait(&pipeline->space, &pipeline->lock);
+
+    tll_push_back(pipeline->queue, chunk);
+    tll_push_back(pipeline->in_order, chunk);
+    cnd_signal(&pipeline->work);
+
+    /* Add decoders as long as they can't keep up */
+    const bool need_decoder =
+        pipeline->decoder_count == 0 ||
+        (tll_length(pipeline->queue) > 1 &&
+         pipeline->decoder_count < pipeline->max_decoders);
+
+    mtx_unlock(&pipeline->lock);
+
+    if (need_decoder)
+        start_decoder(pipeline);
+
+    if (pipeline->decoder_count == 0) {
+        /* Failed to create a thread; decode it ourselves */
+        mtx_lock(&pipeline->lock);
+        tll_pop_back(pipeline->queue);
+        mtx_unlock(&pipeline->lock);
+
+        decode_chunk(pipeline, pipeline->applications->arena, chunk);
+
+        mtx_lock(&pipeline->lock);
+        chunk->decoded = true;
+        publish_chunks(pipeline);
+        mtx_unlock(&pipeline->lock);
+    }
+}
+
+/*
+ * Maps stdin, if it is a regular file, and queues it in chunks. Returns
+ * false if stdin could not be mapped, in which case nothing has been
+ * queued.
+ */
+static bool
+load_mapped(struct pipeline *pipeline, int abort_fd)
+{
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) < 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    /* We may not be at the beginning of the file */
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset < 0 || offset >= st.st_size)
+        return false;
+
+    const size_t map_size = st.st_size;
+    char *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+
+    if (map == MAP_FAILED) {
+        LOG_ERRNO("failed to mmap stdin");
+        return false;
+    }
+
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    LOG_DBG("stdin mapped: %zu bytes, starting at %lld",
+            map_size, (long long)offset);
+
+    const char *const end = map + map_size;
+
+    for (const char *data = map + offset; data < end;) {
+        struct pollfd abort_pfd = {.fd = abort_fd, .events = POLLIN};
+        if (abort_fd >= 0 &&
+            poll(&abort_pfd, 1, 0) > 0 &&
+            (abort_pfd.revents & (POLLIN | POLLHUP)))
+        {
+            LOG_DBG("aborted");
+            break;
+        }
+
+        /* Extend the chunk to the end of the line it ends in */
+        const char *chunk_end = end;
+
+        if ((size_t)(end - data) > CHUNK_MAPPED_SIZE) {
+            const char *delim_at = memchr(
+                data + CHUNK_MAPPED_SIZE, pipeline->delim,
+                end - (data + CHUNK_MAPPED_SIZE));
+            if (delim_at != NULL)
+                chunk_end = delim_at + 1;
+        }
+
+        queue_chunk(pipeline, data, chunk_end - data, NULL);
+        data = chunk_end;
+    }
+
+    /* Entries point into the mapping; it is unmapped with the entries */
+    assert(pipeline->applications->map == NULL);
+    pipeline->applications->map = map;
+    pipeline->applications->map_size = map_size;
+
+    /* Leave stdin where a reader would have left it */
+    lseek(STDIN_FILENO, 0, SEEK_END);
+    return true;
+}
+
+/* Reads stdin, until EOF, and queues it in chunks of complete lines */
+static void
+load_streamed(struct pipeline *pipeline, int abort_fd)
+{
+    /*
+     * buffer[0..complete) are complete lines, not yet handed off to
+     * the decoders. buffer[complete..size) is a partial line.
+     */
+    size_t complete = 0;
     size_t size = 0;
     size_t alloc_size = 16384;
     char *buffer = xmalloc(alloc_size);
@@ -40,8 +559,6 @@ dmenu_load_entries(struct application_list *applications, char delim,
         goto out;
     }
 
-    size_t app_idx = 0;
-
     errno = 0;
     while (true) {
         struct pollfd fds[] = {
@@ -75,8 +592,8 @@ dmenu_load_entries(struct application_list *applications, char delim,
             buffer = xrealloc(buffer, alloc_size);
         }
 
-        ssize_t bytes_read = read(
-            STDIN_FILENO, &buffer[size], alloc_size - size - 1);
+        const size_t requested = alloc_size - size - 1;
+        ssize_t bytes_read = read(STDIN_FILENO, &buffer[size], requested);
 
         if (bytes_read < 0) {
             if (errno == EINTR)
@@ -88,165 +605,116 @@ dmenu_load_entries(struct application_list *applications, char delim,
             break;
         }
 
-        size += bytes_read;
-
-        /*
-         * Consume as much as possible from the input buffer
-         *
-         * Input buffer may contain many lines, resulting in multiple
-         * applications being added.
-         *
-         * Input buffer may not even contain a single line, in which
-         * case we can't consume anything at all.
-         *
-         * Input buffer may contain one or more full lines, followed
-         * by a final partial line. If stdin has been closed
-         * (i.e. there's no more input to read), then treat the last,
-         * partial line as a complete line (i.e. pretend it's followed
-         * by a delimiter). But, if stdin is still open, don't consume
-         * the last, partial line. Instead, wait for more input.
-         */
-        while (size > 0) {
-            char *delim_at = memchr(buffer, delim, size);
-            if (delim_at == NULL) {
-                if (bytes_read > 0) {
-                    /* No delimiter yet, wait for more data */
-                    LOG_DBG("no delimiter found, waiting for more data...");
-                    break;
-                } else {
-                    /* No delimiter, but stdin has been closed. Treat
-                       the last chunk of data as a complete line. */
-                    LOG_DBG("last line: pointing delim_at to the end of the buffer");
-                    delim_at = &buffer[size];
-                    size++;
-                }
-            }
-
-            const size_t entry_len = delim_at - buffer;
-            *delim_at = '\0';
-
+        if (bytes_read == 0) {
             /*
-             * Support Rofi’s extended dmenu protocol. One can specify
-             * an icon by appending ‘\0icon\x1f<icon-name>’ to the
-             * entry:
-             *
-             *  “hello world\0icon\x1ffirefox”
-             *
-             * We also support fallback icons using comma-separated values.
-             * When the primary icon is not found, subsequent icons in the
-             * list will be tried until one is successfully loaded:
-             *
-             *  “hello world\0icon\x1ffirefox,web-browser,application-x-executable”
+             * stdin has been closed. Treat the last, partial, line as
+             * a complete line.
              */
-            char *icon_name = NULL;
-            const char *extra = memchr(buffer, '\0', entry_len);
-
-            if (extra != NULL) {
-                const size_t extra_len = delim_at - extra;
-
-                /*
-                 * 'extra' is "\0icon\x1f" - 6 characters. Require
-                 * *more* than 6, since icon *name* cannot be empty
-                 */
-                if (extra_len > 6 && memcmp(extra, "\0icon\x1f", 6) == 0)
-                    icon_name = xstrndup(extra + 6, delim_at - (extra + 6));
-            }
-
-            LOG_DBG("%s (icon=%s)", buffer, icon_name);
-
-            char32_t *wline = ambstoc32(buffer);
-
-            /* Consume entry from input buffer */
-            const size_t consume = delim_at + 1 - buffer;
-            assert(consume <= size);
-
-            memmove(buffer, delim_at + 1, size - consume);
-            size -= consume;
-
-            if (wline == NULL) {
-                free(icon_name);
-                continue;
-            }
-
-            char32_t *title = with_nth_format == NULL
-                ? xc32dup(wline)
-                : nth_column(wline, nth_delim, with_nth_format);
-
-            char32_t *lowercase = xc32dup(title);
-            for (size_t i = 0; i < c32len(lowercase); i++)
-                lowercase[i] = toc32lower(lowercase[i]);
-
-            char32_t *match_nth = match_nth_format != NULL
-                ? nth_column(wline, nth_delim, match_nth_format)
-                : NULL;
-
-            if (match_nth != NULL) {
-                for (size_t i = 0; i < c32len(match_nth); i++)
-                    match_nth[i] = toc32lower(match_nth[i]);
-            }
+            complete = size;
+        } else {
+            const char *delim_at = memrchr(
+                &buffer[size], pipeline->delim, bytes_read);
+            size += bytes_read;
+
+            if (delim_at != NULL)
+                complete = delim_at + 1 - buffer;
+        }
 
-            struct application *app = xmalloc(sizeof(*app));
-            *app = (struct application){
-                .index = app_idx++,
-                .dmenu_input = wline,
-                .dmenu_match_nth = match_nth,
-                .dmenu_match_nth_len = match_nth != NULL ? c32len(match_nth) : 0,
-                .title = title,
-                .title_lowercase = lowercase,
-                .title_len = c32len(lowercase),
-                .icon = {.name = icon_name},
-                .visible = true,
-            };
-
-            tll_push_back(entries, app);
+        if (complete == 0) {
+            /* No delimiter yet, wait for more data */
+            LOG_DBG("no delimiter found, waiting for more data...");
+            continue;
         }
 
-        if (event_fd >= 0) {
-            mtx_lock(&applications->lock);
+        /*
+         * Batch up lines while there's more input immediately
+         * available, but don't hold on to them if there isn't.
+         */
+        if (complete < CHUNK_MIN_SIZE && (size_t)bytes_read == requested)
+            continue;
 
-            const size_t new_count = applications->count + tll_length(entries);
-            if (new_count > 0) {
-                applications->v = xreallocarray(
-                    applications->v, new_count, sizeof(applications->v[0]));
+        /* Hand off the complete lines; keep the partial one */
+        char *next = xmalloc(alloc_size);
+        memcpy(next, &buffer[complete], size - complete);
 
-                size_t i = applications->count;
-                tll_foreach(entries, it) {
-                    applications->v[i++] = it->item;
-                    tll_remove(entries, it);
-                }
+        queue_chunk(pipeline, buffer, complete, buffer);
 
-                assert(i == new_count);
-                applications->count = applications->visible_count = new_count;
-                send_event(event_fd, EVENT_APPS_SOME_LOADED);
-            }
-
-            mtx_unlock(&applications->lock);
-        }
+        buffer = next;
+        size -= complete;
+        complete = 0;
     }
 
-    free(buffer);
-
 out:
+    free(buffer);
+}
 
-    if (tll_length(entries) == 0)
-        return;
-
-    mtx_lock(&applications->lock);
+void
+dmenu_load_entries(struct application_list *applications, char delim,
+                   const char *with_nth_format, const char *match_nth_format,
+                   char nth_delim, struct popularity_cache *popularity,
+                   int event_fd, int abort_fd)
+{
+    /*
+     * Entries, and their strings, are allocated from per-decoder
+     * arenas. These are merged into the application list's arena
+     * once all input has been decoded.
+     */
+    if (applications->arena == NULL)
+        applications->arena = arena_init();
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    struct pipeline pipeline = {
+        .applications = applications,
+        .delim = delim,
+        .with_nth_format = with_nth_format,
+        .match_nth_format = match_nth_format,
+        .nth_delim = nth_delim,
+        .event_fd = event_fd,
+        .popularity = popularity,
+        .utf8_lines = with_nth_format == NULL && match_nth_format == NULL &&
+                      locale_is_utf8(),
+        .queue = tll_init(),
+        .in_order = tll_init(),
+        .max_decoders = cpu_count > 0 ? cpu_count : 1,
+    };
+
+    pipeline.decoders = xcalloc(
+        pipeline.max_decoders, sizeof(pipeline.decoders[0]));
+
+    mtx_init(&pipeline.lock, mtx_plain);
+    cnd_init(&pipeline.work);
+    cnd_init(&pipeline.space);
+
+    if (!load_mapped(&pipeline, abort_fd))
+        load_streamed(&pipeline, abort_fd);
+
+    mtx_lock(&pipeline.lock);
+    pipeline.no_more_input = true;
+    cnd_broadcast(&pipeline.work);
+    mtx_unlock(&pipeline.lock);
+
+    for (size_t i = 0; i < pipeline.decoder_count; i++) {
+        struct decoder *decoder = &pipeline.decoders[i];
+        thrd_join(decoder->thread, NULL);
+        arena_merge(applications->arena, decoder->arena);
+    }
 
-    const size_t new_count = applications->count + tll_length(entries);
-    applications->v = xreallocarray(
-        applications->v, new_count, sizeof(applications->v[0]));
+    /* From now on, only the lines that are rendered, or output, are read */
+    if (applications->map != NULL)
+        madvise(applications->map, applications->map_size, MADV_NORMAL);
 
-    size_t i = applications->count;
-    tll_foreach(entries, it) {
-        applications->v[i++] = it->item;
-        tll_remove(entries, it);
-    }
+    assert(tll_length(pipeline.queue) == 0);
+    assert(tll_length(pipeline.in_order) == 0);
 
-    applications->count = applications->visible_count = new_count;
-    mtx_unlock(&applications->lock);
+    LOG_DBG("%zu entries, %zu decoder threads, %zu bytes",
+            applications->count, pipeline.decoder_count,
+            arena_used(applications->arena));
 
-    tll_free(entries);
+    cnd_destroy(&pipeline.space);
+    cnd_destroy(&pipeline.work);
+    mtx_destroy(&pipeline.lock);
+    free(pipeline.decoders);
 }
 
 bool
@@ -256,9 +724,29 @@ dmenu_execute(const struct application *app, ssize_t index,
 {
     switch (format) {
     case DMENU_MODE_TEXT: {
-        const char32_t *output = app != NULL
-            ? app->dmenu_input
-            : prompt_text(prompt);
+        if (app != NULL && nth_format == NULL) {
+            /* The line, exactly as it was read */
+            fwrite(app->dmenu_line, 1, app->dmenu_line_len, stdout);
+            fputc('\n', stdout);
+            break;
+        }
+
+        char32_t *input = NULL;
+        const char32_t *output;
+
+        if (app != NULL) {
+            input = xmalloc((app->dmenu_line_len + 1) * sizeof(input[0]));
+
+            const size_t len = mbsntoc32(
+                input, app->dmenu_line, app->dmenu_line_len,
+                app->dmenu_line_len);
+
+            /* Validated when the line was loaded */
+            assert(len != (size_t)-1);
+            input[len] = U'\0';
+            output = input;
+        } else
+            output = prompt_text(prompt);
 
         char32_t *column_output = NULL;
         if (nth_format != NULL) {
@@ -271,6 +759,7 @@ dmenu_execute(const struct application *app, ssize_t index,
             printf("%s\n", text);
 
         free(column_output);
+        free(input);
         free(text);
         break;
     }
@@ -283,51 +772,46 @@ dmenu_execute(const struct application *app, ssize_t index,
     return true;
 }
 
+/*
+ * Icon "names" may be comma separated lists of names; use the first
+ * one found. The icon keeps the full list as its name, so that it is
+ * re-tried on subsequent lookups (e.g. with a new icon size).
+ */
 static void
-try_icon_list(struct application *app, icon_theme_list_t themes, int icon_size)
+try_icon_list(struct icon *icon, icon_theme_list_t themes, int icon_size)
 {
-    if (app->icon.name == NULL || strchr(app->icon.name, ',') == NULL)
+    if (icon->name == NULL || strchr(icon->name, ',') == NULL)
         return;
 
-    if (app->icon.type != ICON_NONE) {
+    if (icon->type != ICON_NONE) {
         return;
     }
 
-    char *icon_list = xstrdup(app->icon.name);
+    char *icon_list = xstrdup(icon->name);
     char *saveptr = NULL;
 
     for (char *icon_name = strtok_r(icon_list, ",", &saveptr);
          icon_name != NULL;
          icon_name = strtok_r(NULL, ",", &saveptr))
     {
-        free(app->icon.name);
-        app->icon.name = xstrdup(icon_name);
-
-        app->icon.type = ICON_NONE;
-        app->icon.path = NULL;
-        app->icon.svg = NULL;
-        app->icon.png = NULL;
-
-        struct application_list temp_list = {
-            .v = &app,
-            .count = 1,
-            .visible_count = 1
-        };
+        struct icon alternative = {.name = icon_name};
+        struct icon *alternatives[] = {&alternative};
 
-        icon_lookup_application_icons(themes, icon_size, &temp_list);
+        icon_lookup_icons(themes, icon_size, alternatives, 1);
 
-        if (app->icon.type != ICON_NONE)
+        if (alternative.type != ICON_NONE) {
+            icon_move(icon, &alternative);
             break;
+        }
     }
 
     free(icon_list);
 }
 
 void
-dmenu_try_icon_list(struct application_list *applications, icon_theme_list_t themes, int icon_size)
+dmenu_try_icon_list(struct icon *const *icons, size_t count,
+                    icon_theme_list_t themes, int icon_size)
 {
-    for (size_t i = 0; i < applications->count; i++) {
-        struct application *app = applications->v[i];
-        try_icon_list(app, themes, icon_size);
-    }
+    for (size_t i = 0; i < count; i++)
+        try_icon_list(icons[i], themes, icon_size);
 }
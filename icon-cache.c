@@ -0,0 +1,252 @@
+#include "icon-cache.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOG_MODULE "icon-cache"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "xmalloc.h"
+
+#define CACHE_FILE_NAME "icon-theme.cache"
+#define CACHE_MAJOR_VERSION 1
+
+#define NO_OFFSET UINT32_MAX
+
+/*
+ * File layout (all integers are big endian):
+ *
+ *   Header:        u16 major, u16 minor, u32 hash offset,
+ *                  u32 directory list offset
+ *   Hash:          u32 bucket count, u32 icon offset[bucket count]
+ *   Icon:          u32 chain (next icon in bucket) offset,
+ *                  u32 name offset, u32 image list offset
+ *   Image list:    u32 image count, image[image count]
+ *   Image:         u16 directory index, u16 flags (ICON_CACHE_*),
+ *                  u32 image data offset
+ *   Directories:   u32 directory count, u32 name offset[count]
+ *
+ * Empty buckets, and the end of chains, are NO_OFFSET. Names are NUL
+ * terminated.
+ */
+struct icon_cache {
+    const unsigned char *data;
+    size_t size;
+
+    uint32_t hash_offset;
+    uint32_t bucket_count;
+    uint32_t dirs_offset;
+    uint32_t dir_count;
+};
+
+static bool
+read_u16(const struct icon_cache *cache, size_t offset, uint16_t *value)
+{
+    if (offset > cache->size || cache->size - offset < 2)
+        return false;
+
+    const unsigned char *p = &cache->data[offset];
+    *value = (uint16_t)p[0] << 8 | p[1];
+    return true;
+}
+
+static bool
+read_u32(const struct icon_cache *cache, size_t offset, uint32_t *value)
+{
+    if (offset > cache->size || cache->size - offset < 4)
+        return false;
+
+    const unsigned char *p = &cache->data[offset];
+    *value = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+             (uint32_t)p[2] << 8 | p[3];
+    return true;
+}
+
+/* Returns NULL if the string isn't terminated within the file */
+static const char *
+string_at(const struct icon_cache *cache, uint32_t offset)
+{
+    if (offset >= cache->size)
+        return NULL;
+
+    const char *s = (const char *)&cache->data[offset];
+    return memchr(s, '\0', cache->size - offset) != NULL ? s : NULL;
+}
+
+/* Same as GTK's icon_name_hash() (note: signed chars) */
+static uint32_t
+name_hash(const char *name)
+{
+    const signed char *p = (const signed char *)name;
+    uint32_t h = *p;
+
+    if (h != 0) {
+        for (p++; *p != '\0'; p++)
+            h = (h << 5) - h + *p;
+    }
+
+    return h;
+}
+
+struct icon_cache *
+icon_cache_open(int dir_fd, const char *theme_path)
+{
+    struct stat dir_st;
+    if (fstatat(dir_fd, theme_path, &dir_st, 0) < 0)
+        return NULL;
+
+    char path[strlen(theme_path) + 1 + strlen(CACHE_FILE_NAME) + 1];
+    sprintf(path, "%s/" CACHE_FILE_NAME, theme_path);
+
+    int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < 12 || st.st_size > UINT32_MAX)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_mtime < dir_st.st_mtime) {
+        LOG_DBG("%s: stale", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        LOG_ERRNO("%s: failed to mmap", path);
+        return NULL;
+    }
+
+    struct icon_cache *cache = xmalloc(sizeof(*cache));
+    *cache = (struct icon_cache){.data = data, .size = st.st_size};
+
+    uint16_t major;
+
+    if (!read_u16(cache, 0, &major) ||
+        major != CACHE_MAJOR_VERSION ||
+        !read_u32(cache, 4, &cache->hash_offset) ||
+        !read_u32(cache, 8, &cache->dirs_offset) ||
+        !read_u32(cache, cache->hash_offset, &cache->bucket_count) ||
+        !read_u32(cache, cache->dirs_offset, &cache->dir_count) ||
+        cache->bucket_count == 0 ||
+        (size_t)cache->bucket_count * 4 >
+            cache->size - cache->hash_offset - 4 ||
+        (size_t)cache->dir_count * 4 > cache->size - cache->dirs_offset - 4)
+    {
+        LOG_WARN("%s: invalid icon theme cache", path);
+        icon_cache_destroy(cache);
+        return NULL;
+    }
+
+    LOG_DBG("%s: %u directories, %u buckets",
+            path, cache->dir_count, cache->bucket_count);
+    return cache;
+}
+
+void
+icon_cache_destroy(struct icon_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    munmap((void *)cache->data, cache->size);
+    free(cache);
+}
+
+int
+icon_cache_dir_index(const struct icon_cache *cache, const char *dir)
+{
+    /* Images refer to directories with 16-bit indices */
+    for (uint32_t i = 0; i < cache->dir_count && i <= UINT16_MAX; i++) {
+        uint32_t offset;
+        if (!read_u32(cache, (size_t)cache->dirs_offset + 4 + (size_t)i * 4,
+                      &offset))
+        {
+            break;
+        }
+
+        const char *name = string_at(cache, offset);
+        if (name != NULL && strcmp(name, dir) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static unsigned
+image_types(const struct icon_cache *cache, uint32_t offset, int dir_index)
+{
+    uint32_t image_count;
+    if (!read_u32(cache, offset, &image_count))
+        return 0;
+
+    for (uint32_t i = 0; i < image_count; i++) {
+        const size_t image = (size_t)offset + 4 + (size_t)i * 8;
+
+        uint16_t dir;
+        uint16_t flags;
+        if (!read_u16(cache, image, &dir) ||
+            !read_u16(cache, image + 2, &flags))
+        {
+            return 0;
+        }
+
+        if (dir == dir_index)
+            return flags & (ICON_CACHE_XPM | ICON_CACHE_SVG | ICON_CACHE_PNG);
+    }
+
+    return 0;
+}
+
+unsigned
+icon_cache_lookup(const struct icon_cache *cache, const char *name,
+                  int dir_index)
+{
+    const uint32_t bucket = name_hash(name) % cache->bucket_count;
+
+    uint32_t offset;
+    if (!read_u32(cache, (size_t)cache->hash_offset + 4 + (size_t)bucket * 4,
+                  &offset))
+    {
+        return 0;
+    }
+
+    /* Each icon is 12 bytes; a longer chain means it loops (corrupt cache) */
+    for (size_t steps = 0;
+         offset != NO_OFFSET && steps < cache->size / 12;
+         steps++)
+    {
+        uint32_t chain_offset;
+        uint32_t name_offset;
+        uint32_t images_offset;
+
+        if (!read_u32(cache, offset, &chain_offset) ||
+            !read_u32(cache, (size_t)offset + 4, &name_offset) ||
+            !read_u32(cache, (size_t)offset + 8, &images_offset))
+        {
+            return 0;
+        }
+
+        const char *icon_name = string_at(cache, name_offset);
+        if (icon_name != NULL && strcmp(icon_name, name) == 0)
+            return image_types(cache, images_offset, dir_index);
+
+        offset = chain_offset;
+    }
+
+    return 0;
+}
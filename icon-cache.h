@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * Reader for GTK's icon-theme.cache files (generated by
+ * gtk-update-icon-cache), found in the root directory of most
+ * installed icon themes.
+ *
+ * The file is mapped, and is a hash table of icon names, each listing
+ * the theme directories the icon exists in (and as which file
+ * types). All offsets are validated before being followed; a corrupt
+ * cache only results in icons not being found.
+ */
+
+struct icon_cache;
+
+enum {
+    ICON_CACHE_XPM = 1 << 0,
+    ICON_CACHE_SVG = 1 << 1,
+    ICON_CACHE_PNG = 1 << 2,
+};
+
+/*
+ * Maps <dir_fd>/<theme_path>/icon-theme.cache. Returns NULL if there
+ * is no cache, or if it is older than the theme directory (i.e. stale,
+ * like GTK considers it).
+ */
+struct icon_cache *icon_cache_open(int dir_fd, const char *theme_path);
+void icon_cache_destroy(struct icon_cache *cache);
+
+/*
+ * Index of the theme directory 'dir' (relative to the theme, e.g.
+ * "48x48/apps"), or -1 if the cache doesn't cover it
+ */
+int icon_cache_dir_index(const struct icon_cache *cache, const char *dir);
+
+/* ICON_CACHE_* types of the icon 'name' in directory 'dir_index' */
+unsigned icon_cache_lookup(
+    const struct icon_cache *cache, const char *name, int dir_index);
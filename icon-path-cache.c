@@ -0,0 +1,293 @@
+#include "icon-path-cache.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "icon-path-cache"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "strset.h"
+#include "xdg.h"
+#include "xmalloc.h"
+#include "xsnprintf.h"
+
+#define CACHE_FILE_NAME "fuzzel-icons"
+#define CACHE_MAGIC "fzlicon"
+#define CACHE_VERSION 1
+
+struct entry {
+    struct cache_ref name;
+    struct cache_ref path;  /* NULL: no icon found */
+    uint32_t type;    /* enum icon_type */
+};
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;         /* Total file size */
+    struct cache_ref key;
+    struct cache_ref dirs;       /* struct cache_stamp[] */
+    struct cache_ref icon_dirs;  /* struct cache_stamp[] */
+    struct cache_ref entries;    /* struct entry[] */
+};
+
+static char *
+cache_file_path(void)
+{
+    const char *cache_dir = xdg_cache_dir();
+    if (cache_dir == NULL)
+        return NULL;
+
+    return xasprintf("%s/" CACHE_FILE_NAME, cache_dir);
+}
+
+void
+icon_path_cache_init(struct icon_path_cache *cache, char *key)
+{
+    *cache = (struct icon_path_cache){
+        .key = key,
+        .dirs = tll_init(),
+        .icon_dirs = tll_init(),
+        .entries = tll_init(),
+    };
+}
+
+void
+icon_path_cache_destroy(struct icon_path_cache *cache)
+{
+    free(cache->key);
+    cache_path_stamps_destroy(&cache->dirs);
+    cache_path_stamps_destroy(&cache->icon_dirs);
+
+    tll_foreach(cache->entries, it) {
+        free(it->item.name);
+        free(it->item.path);
+        tll_remove(cache->entries, it);
+    }
+
+    strset_destroy(cache->names);
+    cache_map_close(&cache->map);
+
+    cache->key = NULL;
+    cache->names = NULL;
+}
+
+void
+icon_path_cache_add_dir(struct icon_path_cache *cache,
+                        const struct cache_path_stamp *stamp)
+{
+    struct cache_path_stamp copy = *stamp;
+    copy.path = xstrdup(stamp->path);
+    tll_push_back(cache->dirs, copy);
+}
+
+void
+icon_path_cache_add_icon_dir(struct icon_path_cache *cache, const char *path,
+                             const struct stat *st)
+{
+    cache_path_stamps_add(&cache->icon_dirs, path, st);
+}
+
+void
+icon_path_cache_add_icon(struct icon_path_cache *cache, const char *name,
+                         const char *path, enum icon_type type)
+{
+    struct icon_path_cache_entry entry = {
+        .name = xstrdup(name),
+        .path = path != NULL ? xstrdup(path) : NULL,
+        .type = path != NULL ? type : ICON_NONE,
+    };
+    tll_push_back(cache->entries, entry);
+}
+
+static bool
+entry_valid(const struct cache_map *map, const struct entry *e)
+{
+    if (e->name.offset == 0 ||
+        !cache_utf8_valid(map, e->name) ||
+        !cache_utf8_valid(map, e->path))
+    {
+        return false;
+    }
+
+    switch (e->type) {
+    case ICON_NONE:
+        return e->path.offset == 0;
+
+    case ICON_PNG:
+    case ICON_SVG:
+        return e->path.offset != 0;
+    }
+
+    return false;
+}
+
+static bool
+cache_valid(const struct cache_map *map, const char *key)
+{
+    if (map->size < sizeof(struct header))
+        return false;
+
+    const struct header *hdr = (const struct header *)map->data;
+
+    if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != CACHE_VERSION ||
+        hdr->size != map->size)
+    {
+        LOG_DBG("invalid header, or unsupported version");
+        return false;
+    }
+
+    if (!cache_utf8_valid(map, hdr->key) ||
+        hdr->key.len != strlen(key) ||
+        memcmp(&map->data[hdr->key.offset], key, hdr->key.len) != 0)
+    {
+        LOG_DBG("key mismatch (theme, icon size or icon directories)");
+        return false;
+    }
+
+    if (!cache_stamps_valid(map, hdr->dirs) ||
+        !cache_stamps_valid(map, hdr->icon_dirs) ||
+        !cache_stamps_unchanged(map, hdr->dirs))
+    {
+        return false;
+    }
+
+    if (!cache_array_valid(map, hdr->entries, sizeof(struct entry),
+                           alignof(struct entry)))
+    {
+        return false;
+    }
+
+    const struct entry *entries = cache_array_at(map, hdr->entries);
+    for (size_t i = 0; i < hdr->entries.len; i++) {
+        if (!entry_valid(map, &entries[i])) {
+            LOG_DBG("entry #%zu: corrupt", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+icon_path_cache_load(struct icon_path_cache *cache)
+{
+    assert(cache->map.data == NULL);
+
+    char *path = cache_file_path();
+    if (path == NULL)
+        return false;
+
+    struct cache_map map;
+    if (!cache_map_open(&map, path, sizeof(struct header))) {
+        free(path);
+        return false;
+    }
+
+    if (!cache_valid(&map, cache->key)) {
+        LOG_DBG("%s: stale", path);
+        cache_map_close(&map);
+        free(path);
+        return false;
+    }
+
+    const struct header *hdr = (const struct header *)map.data;
+    const struct entry *entries = cache_array_at(&map, hdr->entries);
+
+    cache->names = strset_init(hdr->entries.len);
+    for (size_t i = 0; i < hdr->entries.len; i++) {
+        const struct entry *e = &entries[i];
+        strset_add(cache->names, &map.data[e->name.offset], e->name.len,
+                   (void *)e);
+    }
+
+    LOG_DBG("%s: loaded %u icons", path, hdr->entries.len);
+
+    cache->map = map;
+    free(path);
+    return true;
+}
+
+bool
+icon_path_cache_lookup(const struct icon_path_cache *cache, const char *name,
+                       const char **path, enum icon_type *type)
+{
+    if (cache->names == NULL)
+        return false;
+
+    void **value = strset_find(cache->names, name, strlen(name));
+    if (value == NULL)
+        return false;
+
+    const struct entry *e = *value;
+    *path = e->path.offset != 0 ? &cache->map.data[e->path.offset] : NULL;
+    *type = e->type;
+    return true;
+}
+
+bool
+icon_path_cache_icon_dirs_changed(const struct icon_path_cache *cache)
+{
+    if (cache->map.data == NULL)
+        return false;
+
+    const struct header *hdr = (const struct header *)cache->map.data;
+    return !cache_stamps_unchanged(&cache->map, hdr->icon_dirs);
+}
+
+void
+icon_path_cache_save(const struct icon_path_cache *cache)
+{
+    char *path = cache_file_path();
+    if (path == NULL)
+        return;
+
+    struct cache_buf buf = {0};
+    const size_t hdr_offset = cache_buf_reserve(
+        &buf, sizeof(struct header), alignof(struct header));
+    assert(hdr_offset == 0);
+
+    struct header hdr = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+    };
+
+    hdr.key = cache_buf_add_utf8(&buf, cache->key);
+    hdr.dirs = cache_buf_add_stamps(&buf, &cache->dirs);
+    hdr.icon_dirs = cache_buf_add_stamps(&buf, &cache->icon_dirs);
+
+    const size_t count = tll_length(cache->entries);
+    const size_t entries_offset = cache_buf_reserve(
+        &buf, count * sizeof(struct entry), alignof(struct entry));
+    hdr.entries = (struct cache_ref){.offset = entries_offset, .len = count};
+
+    size_t i = 0;
+    tll_foreach(cache->entries, it) {
+        const struct entry e = {
+            .name = cache_buf_add_utf8(&buf, it->item.name),
+            .path = cache_buf_add_utf8(&buf, it->item.path),
+            .type = it->item.type,
+        };
+        memcpy(&buf.data[entries_offset + i++ * sizeof(e)], &e, sizeof(e));
+    }
+
+    if (buf.len > UINT32_MAX) {
+        LOG_WARN("%s: too large, not saving icon cache", path);
+        goto out;
+    }
+
+    hdr.size = buf.len;
+    memcpy(&buf.data[hdr_offset], &hdr, sizeof(hdr));
+
+    if (cache_file_replace(path, buf.data, buf.len, 0600)) {
+        LOG_DBG("%s: saved %zu icons (%zu bytes)", path, count, buf.len);
+    }
+
+out:
+    free(buf.data);
+    free(path);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/stat.h>
+
+#include <tllist.h>
+
+#include "application.h"
+#include "cache-file.h"
+
+/*
+ * Binary cache of resolved icons, in $XDG_CACHE_HOME/fuzzel-icons.
+ *
+ * Maps icon names to the file the icon theme lookup resolved them to
+ * (or to nothing, if no icon was found). It is tagged with a key,
+ * describing everything the lookup depends on, other than the
+ * contents of the icon directories: theme, icon size, supported image
+ * formats, and the list of icon base directories.
+ *
+ * The cache is up to date when the key matches, and none of the
+ * icon base directories, or theme directories (<base>/<theme>, for
+ * each theme in the inheritance chain), have changed. This catches
+ * themes being installed or removed, and index.theme and
+ * icon-theme.cache files being replaced. Icons added to, or removed
+ * from, the icon directories the lookup searched are caught by
+ * icon_path_cache_icon_dirs_changed(), which is meant to be run once
+ * the cached icons are displayed.
+ */
+
+struct strset;
+
+struct icon_path_cache_entry {
+    char *name;
+    char *path;  /* NULL if no icon was found */
+    enum icon_type type;
+};
+
+struct icon_path_cache {
+    char *key;
+
+    /* Recorded after a full lookup, i.e. when not loaded from the cache */
+    cache_path_stamps_t dirs;
+    cache_path_stamps_t icon_dirs;
+    tll(struct icon_path_cache_entry) entries;
+
+    /* The cache file, if loaded */
+    struct cache_map map;
+    struct strset *names;  /* Icon name -> entry in 'map' */
+};
+
+/* Takes ownership of 'key' */
+void icon_path_cache_init(struct icon_path_cache *cache, char *key);
+void icon_path_cache_destroy(struct icon_path_cache *cache);
+
+/* Copies 'stamp' */
+void icon_path_cache_add_dir(
+    struct icon_path_cache *cache, const struct cache_path_stamp *stamp);
+
+/* 'st' is NULL if the directory doesn't exist */
+void icon_path_cache_add_icon_dir(
+    struct icon_path_cache *cache, const char *path, const struct stat *st);
+void icon_path_cache_add_icon(
+    struct icon_path_cache *cache, const char *name, const char *path,
+    enum icon_type type);
+
+/* Maps the cache file, if it exists, and is up to date */
+bool icon_path_cache_load(struct icon_path_cache *cache);
+
+/*
+ * Looks up 'name' in the loaded cache. Returns false if it isn't
+ * cached. Otherwise, '*path' is the icon file (NULL if there's none).
+ */
+bool icon_path_cache_lookup(
+    const struct icon_path_cache *cache, const char *name,
+    const char **path, enum icon_type *type);
+
+/* True if any of the icon directories of the loaded cache has changed */
+bool icon_path_cache_icon_dirs_changed(const struct icon_path_cache *cache);
+
+/*
+ * Writes the recorded directories and icons to the cache file. The
+ * file is replaced atomically.
+ */
+void icon_path_cache_save(const struct icon_path_cache *cache);
@@ -5,12 +5,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <assert.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <dirent.h>
 
 #if defined(FUZZEL_ENABLE_PNG_LIBPNG)
  #include "png-fuzzel.h"
@@ -33,6 +36,11 @@
 #define LOG_MODULE "icon"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
+#include "arena.h"
+#include "icon-cache.h"
+#include "icon-path-cache.h"
+#include "strset.h"
+#include "timing.h"
 #include "xdg.h"
 #include "xmalloc.h"
 #include "xsnprintf.h"
@@ -283,13 +291,21 @@ already_loaded_theme(const char *theme_name, icon_theme_list_t themes)
 static void
 discover_and_load_theme(const char *theme_name, xdg_data_dirs_t dirs,
                         theme_names_t *themes_to_load, bool filter_context,
-                        icon_theme_list_t *themes)
+                        icon_theme_list_t *themes,
+                        cache_path_stamps_t *stamps)
 {
     tll_foreach(dirs, dir_it) {
         char path[strlen(dir_it->item.path) + 1 +
                   strlen(theme_name) + 1];
         sprintf(path, "%s/%s", dir_it->item.path, theme_name);
 
+        if (stamps != NULL) {
+            struct stat st;
+            const bool exists =
+                fstatat(dir_it->item.fd, theme_name, &st, 0) == 0;
+            cache_path_stamps_add(stamps, path, exists ? &st : NULL);
+        }
+
         struct icon_theme theme = {0};
         if (load_theme_in(path, &theme, filter_context, themes_to_load)) {
             theme.name = xstrdup(theme_name);
@@ -366,7 +382,8 @@ get_icon_dirs(void)
 }
 
 icon_theme_list_t
-icon_load_theme(const char *name, bool filter_context)
+icon_load_theme(const char *name, bool filter_context,
+                cache_path_stamps_t *stamps)
 {
     /* List of themes; first item is the primary theme, subsequent
      * items are inherited items (i.e. fallback themes) */
@@ -379,6 +396,14 @@ icon_load_theme(const char *name, bool filter_context)
 
     xdg_data_dirs_t dirs = get_icon_dirs();
 
+    if (stamps != NULL) {
+        tll_foreach(dirs, it) {
+            struct stat st;
+            const bool exists = fstat(it->item.fd, &st) == 0;
+            cache_path_stamps_add(stamps, it->item.path, exists ? &st : NULL);
+        }
+    }
+
     while (tll_length(themes_to_load) > 0) {
         char *theme_name = tll_pop_front(themes_to_load);
 
@@ -393,7 +418,7 @@ icon_load_theme(const char *name, bool filter_context)
             continue;
         }
 
-        discover_and_load_theme(theme_name, dirs, &themes_to_load, filter_context, &themes);
+        discover_and_load_theme(theme_name, dirs, &themes_to_load, filter_context, &themes, stamps);
         free(theme_name);
     }
 
@@ -411,7 +436,7 @@ icon_load_theme(const char *name, bool filter_context)
          * hicolor has no dependency, thus the themes_to_load here is
          * assumed to stay empty and will be disregarded.
          */
-        discover_and_load_theme("hicolor", dirs, &themes_to_load, filter_context, &themes);
+        discover_and_load_theme("hicolor", dirs, &themes_to_load, filter_context, &themes, stamps);
     }
 
     xdg_data_dirs_destroy(dirs);
@@ -424,9 +449,23 @@ theme_destroy(struct icon_theme theme)
     free(theme.name);
 
     tll_foreach(theme.dirs, it) {
+        tll_foreach(it->item.listings, listing_it) {
+            free(listing_it->item.base_path);
+            strset_destroy(listing_it->item.names);
+            tll_remove(it->item.listings, listing_it);
+        }
+
         free(it->item.path);
         tll_remove(theme.dirs, it);
     }
+
+    tll_foreach(theme.caches, it) {
+        free(it->item.base_path);
+        icon_cache_destroy(it->item.cache);
+        tll_remove(theme.caches, it);
+    }
+
+    arena_destroy(theme.names);
 }
 
 void
@@ -609,6 +648,207 @@ icon_reset(struct icon *icon)
     icon->type = ICON_NONE;
 }
 
+/* Icon names that are absolute paths are used as is (if PNG or SVG) */
+static void
+icon_from_absolute_path(struct icon *icon)
+{
+    const size_t name_len = strlen(icon->name);
+    if (icon->name[name_len - 3] == 's' &&
+        icon->name[name_len - 2] == 'v' &&
+        icon->name[name_len - 1] == 'g')
+    {
+        if (svg(icon, icon->name))
+            LOG_DBG("%s: absolute path SVG", icon->name);
+    } else if (icon->name[name_len - 3] == 'p' &&
+               icon->name[name_len - 2] == 'n' &&
+               icon->name[name_len - 1] == 'g')
+    {
+        if (png(icon, icon->name))
+            LOG_DBG("%s: abslute path PNG", icon->name);
+    }
+}
+
+/* File types, in icon_dir listings */
+enum {
+    ICON_FILE_PNG = 1 << 0,
+    ICON_FILE_SVG = 1 << 1,
+};
+
+struct lookup_stats {
+    size_t caches_loaded; /* icon-theme.cache files */
+    size_t dirs_indexed;  /* Directories found in an icon-theme.cache */
+    size_t dirs_read;     /* openat() + getdents() + close() */
+    size_t dirs_missing;  /* Failed openat() */
+    size_t dirs_cached;
+    size_t dir_entries;
+    size_t file_checks;   /* faccessat() */
+};
+
+/* Reads the names of all PNG and SVG files in 'dir_fd' (which is closed) */
+static struct strset *
+read_icon_dir(int dir_fd, struct arena *arena, size_t *entry_count)
+{
+    DIR *d = fdopendir(dir_fd);
+    if (d == NULL) {
+        close(dir_fd);
+        return NULL;
+    }
+
+    struct strset *names = strset_init(0);
+
+    for (const struct dirent *e = readdir(d); e != NULL; e = readdir(d)) {
+        (*entry_count)++;
+
+        if (e->d_type == DT_DIR)
+            continue;
+
+        const size_t len = strlen(e->d_name);
+        if (len <= 4 || e->d_name[len - 4] != '.')
+            continue;
+
+        uintptr_t type;
+        if (strcmp(&e->d_name[len - 3], "png") == 0)
+            type = ICON_FILE_PNG;
+        else if (strcmp(&e->d_name[len - 3], "svg") == 0)
+            type = ICON_FILE_SVG;
+        else
+            continue;
+
+        const size_t name_len = len - 4;
+
+        void **types = strset_find(names, e->d_name, name_len);
+        if (types != NULL) {
+            *types = (void *)((uintptr_t)*types | type);
+            continue;
+        }
+
+        char *name = arena_alloc(arena, name_len, 1);
+        memcpy(name, e->d_name, name_len);
+        strset_add(names, name, name_len, (void *)type);
+    }
+
+    closedir(d);
+    return names;
+}
+
+/* The theme's icon-theme.cache under 'base', opened on first use */
+static const struct icon_cache *
+theme_cache(struct icon_theme *theme, const struct xdg_data_dir *base,
+            struct lookup_stats *stats)
+{
+    tll_foreach(theme->caches, it) {
+        if (strcmp(it->item.base_path, base->path) == 0)
+            return it->item.cache;
+    }
+
+    struct icon_cache *cache = icon_cache_open(base->fd, theme->name);
+    if (cache != NULL)
+        stats->caches_loaded++;
+
+    struct icon_theme_cache entry = {
+        .base_path = xstrdup(base->path),
+        .cache = cache,
+    };
+    tll_push_back(theme->caches, entry);
+    return cache;
+}
+
+/*
+ * Returns the icon files in <base>/<theme>/<icon dir>. These are
+ * looked up in the theme's icon-theme.cache, if it has one covering
+ * the directory, and read from the directory itself otherwise. Either
+ * way, this is only done on first use.
+ *
+ * Returns NULL if the directory doesn't exist.
+ */
+static const struct icon_dir_listing *
+icon_dir_listing(struct icon_theme *theme, struct icon_dir *icon_dir,
+                 const struct xdg_data_dir *base,
+                 const char *theme_relative_path, struct lookup_stats *stats)
+{
+    tll_foreach(icon_dir->listings, it) {
+        if (strcmp(it->item.base_path, base->path) == 0) {
+            stats->dirs_cached++;
+            return it->item.names != NULL || it->item.cache != NULL
+                ? &it->item : NULL;
+        }
+    }
+
+    struct icon_dir_listing listing = {.base_path = xstrdup(base->path)};
+
+    const struct icon_cache *cache = theme_cache(theme, base, stats);
+    const int cache_dir_index = cache != NULL
+        ? icon_cache_dir_index(cache, icon_dir->path) : -1;
+
+    if (cache_dir_index >= 0) {
+        listing.cache = cache;
+        listing.cache_dir_index = cache_dir_index;
+        listing.exists = fstatat(
+            base->fd, theme_relative_path, &listing.st, 0) == 0;
+        stats->dirs_indexed++;
+    } else {
+        int dir_fd = openat(
+            base->fd, theme_relative_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (dir_fd >= 0) {
+            if (theme->names == NULL)
+                theme->names = arena_init();
+
+            /* Stamped before reading, so that changes while reading are caught */
+            listing.exists = fstat(dir_fd, &listing.st) == 0;
+            listing.names = read_icon_dir(
+                dir_fd, theme->names, &stats->dir_entries);
+            stats->dirs_read++;
+        } else {
+            /* E.g. EACCES; the directory exists, but can't be read */
+            if (errno != ENOENT && errno != ENOTDIR) {
+                listing.exists = fstatat(
+                    base->fd, theme_relative_path, &listing.st, 0) == 0;
+            }
+            stats->dirs_missing++;
+        }
+    }
+
+    tll_push_back(icon_dir->listings, listing);
+
+    const struct icon_dir_listing *ret = &tll_back(icon_dir->listings);
+    return ret->names != NULL || ret->cache != NULL ? ret : NULL;
+}
+
+/* Type of the icon file 'name' in 'listing'. PNGs are preferred over SVGs */
+static enum icon_type
+icon_file_type(const struct icon_dir_listing *listing, const char *name,
+               size_t len)
+{
+    uintptr_t t = 0;
+
+    if (listing->cache != NULL) {
+        const unsigned types = icon_cache_lookup(
+            listing->cache, name, listing->cache_dir_index);
+
+        if (types & ICON_CACHE_PNG)
+            t |= ICON_FILE_PNG;
+        if (types & ICON_CACHE_SVG)
+            t |= ICON_FILE_SVG;
+    } else {
+        void **types = strset_find(listing->names, name, len);
+        if (types != NULL)
+            t = (uintptr_t)*types;
+    }
+
+#if defined(FUZZEL_ENABLE_PNG_LIBPNG)
+    if (t & ICON_FILE_PNG)
+        return ICON_PNG;
+#endif
+#if defined(FUZZEL_ENABLE_SVG_NANOSVG) || defined(FUZZEL_ENABLE_SVG_LIBRSVG) || defined(FUZZEL_ENABLE_SVG_RESVG)
+    if (t & ICON_FILE_SVG)
+        return ICON_SVG;
+#endif
+
+    (void)t;
+    return ICON_NONE;
+}
+
 /*
  * Path is expected to contain the icon’s basename. It doesn’t have to
  * have the extension filled in; it will be filled in by this
@@ -625,18 +865,21 @@ icon_reset(struct icon *icon)
  * (.png or .svg).
  */
 static bool
-icon_file_exists(int dir_fd, char *path, size_t path_len)
+icon_file_exists(int dir_fd, char *path, size_t path_len,
+                 struct lookup_stats *stats)
 {
 #if defined(FUZZEL_ENABLE_PNG_LIBPNG)
     path[path_len - 3] = 'p';
     path[path_len - 2] = 'n';
     path[path_len - 1] = 'g';
 
+    stats->file_checks++;
     if (faccessat(dir_fd, path, R_OK, 0) < 0) {
 #if defined(FUZZEL_ENABLE_SVG_NANOSVG) || defined(FUZZEL_ENABLE_SVG_LIBRSVG) || defined(FUZZEL_ENABLE_SVG_RESVG)
         path[path_len - 3] = 's';
         path[path_len - 2] = 'v';
         path[path_len - 1] = 'g';
+        stats->file_checks++;
         return faccessat(dir_fd, path, R_OK, 0) == 0;
 #else
         return false;
@@ -650,6 +893,7 @@ icon_file_exists(int dir_fd, char *path, size_t path_len)
     path[path_len - 2] = 'v';
     path[path_len - 1] = 'g';
 
+    stats->file_checks++;
     return faccessat(dir_fd, path, R_OK, 0) == 0;
 #else
     return false;
@@ -657,13 +901,14 @@ icon_file_exists(int dir_fd, char *path, size_t path_len)
 }
 
 static bool
-lookup_icons(const icon_theme_list_t *themes, int icon_size,
-             struct application_list *applications,
-             const xdg_data_dirs_t *xdg_dirs)
+lookup_icons(icon_theme_list_t *themes, int icon_size,
+             struct icon *const *targets, size_t count,
+             const xdg_data_dirs_t *xdg_dirs, struct lookup_stats *stats)
 {
     struct icon_data {
         const char *name;
-        struct application *app;
+        size_t name_len;
+        struct icon *target;
 
         char *file_name;
         size_t file_name_len;
@@ -679,33 +924,21 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
 
     tll(struct icon_data) icons = tll_init();
 
-    for (size_t i = 0; i < applications->count; i++) {
-        struct application *app = applications->v[i];
-        icon_reset(&app->icon);
+    for (size_t i = 0; i < count; i++) {
+        struct icon *target = targets[i];
+        icon_reset(target);
 
-        if (app->icon.name == NULL)
+        if (target->name == NULL)
             continue;
 
-        if (app->icon.name[0] == '/') {
-            const size_t name_len = strlen(app->icon.name);
-            if (app->icon.name[name_len - 3] == 's' &&
-                app->icon.name[name_len - 2] == 'v' &&
-                app->icon.name[name_len - 1] == 'g')
-            {
-                if (svg(&app->icon, app->icon.name))
-                    LOG_DBG("%s: absolute path SVG", app->icon.name);
-            } else if (app->icon.name[name_len - 3] == 'p' &&
-                       app->icon.name[name_len - 2] == 'n' &&
-                       app->icon.name[name_len - 1] == 'g')
-            {
-                if (png(&app->icon, app->icon.name))
-                    LOG_DBG("%s: abslute path PNG", app->icon.name);
-            }
-        } else {
-            char *file_name = xstrjoin(app->icon.name, ".xxx");
+        if (target->name[0] == '/')
+            icon_from_absolute_path(target);
+        else {
+            char *file_name = xstrjoin(target->name, ".xxx");
             struct icon_data data = {
-                .name = app->icon.name,
-                .app = app,
+                .name = target->name,
+                .name_len = strlen(target->name),
+                .target = target,
                 .file_name = file_name,
                 .file_name_len = strlen(file_name),
                 .min_diff = {.diff = INT_MAX},
@@ -718,12 +951,12 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
      * https://specifications.freedesktop.org/icon-theme-spec/icon-theme-spec-latest.html#icon_lookup */
 
     tll_foreach(*themes, theme_it) {
-        const struct icon_theme *theme = &theme_it->item;
+        struct icon_theme *theme = &theme_it->item;
 
         /* Fallback icon to use if there aren’t any exact matches */
         /* Assume sorted */
         tll_foreach(theme->dirs, icon_dir_it) {
-            const struct icon_dir *icon_dir = &icon_dir_it->item;
+            struct icon_dir *icon_dir = &icon_dir_it->item;
 
             char theme_relative_path[
                 strlen(theme->name) + 1 +
@@ -799,9 +1032,13 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
                     break;
                 }
 
-                int dir_fd = openat(
-                    xdg_dir->fd, theme_relative_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
-                if (dir_fd < 0)
+                /* Don't read directories no one needs */
+                if (tll_length(icons) == 0)
+                    continue;
+
+                const struct icon_dir_listing *listing = icon_dir_listing(
+                    theme, icon_dir, xdg_dir, theme_relative_path, stats);
+                if (listing == NULL)
                     continue;
 
                 tll_foreach(icons, icon_it) {
@@ -810,11 +1047,10 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
                     if (!is_exact_match && icon->min_diff.diff <= diff)
                         continue;
 
-                    size_t len = icon->file_name_len;
-                    char *path = icon->file_name;
-                    path[len - 4] = '.';
+                    const enum icon_type file_type =
+                        icon_file_type(listing, icon->name, icon->name_len);
 
-                    if (!icon_file_exists(dir_fd, path, len))
+                    if (file_type == ICON_NONE)
                         continue;
 
                     if (!is_exact_match) {
@@ -823,19 +1059,19 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
                         icon->min_diff.xdg_dir = xdg_dir;
                         icon->min_diff.theme = theme;
                         icon->min_diff.icon_dir = icon_dir;
-                        icon->min_diff.type = path[len - 3] == 's'
-                            ? ICON_SVG : ICON_PNG;
+                        icon->min_diff.type = file_type;
                         continue;
                     }
 
                     char *full_path = xasprintf(
-                        "%s/%s/%s/%s",
-                        xdg_dir->path, theme->name, icon_dir->path, path);
-
-                    if ((path[len - 3] == 's' &&
-                         svg(&icon->app->icon, full_path)) ||
-                        (path[len - 3] == 'p' &&
-                         png(&icon->app->icon, full_path)))
+                        "%s/%s/%s/%s.%s",
+                        xdg_dir->path, theme->name, icon_dir->path, icon->name,
+                        file_type == ICON_SVG ? "svg" : "png");
+
+                    if ((file_type == ICON_SVG &&
+                         svg(icon->target, full_path)) ||
+                        (file_type == ICON_PNG &&
+                         png(icon->target, full_path)))
                     {
                         LOG_DBG("%s: %s", icon->name, full_path);
                         free(icon->file_name);
@@ -844,8 +1080,6 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
 
                     free(full_path);
                 }
-
-                close(dir_fd);
             }
         }
 
@@ -874,9 +1108,9 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
                     icon->min_diff.type == ICON_SVG ? "svg" : "png");
 
             if ((icon->min_diff.type == ICON_SVG &&
-                 svg(&icon->app->icon, full_path)) ||
+                 svg(icon->target, full_path)) ||
                 (icon->min_diff.type == ICON_PNG &&
-                 png(&icon->app->icon, full_path)))
+                 png(icon->target, full_path)))
             {
                 LOG_DBG("%s: %s (fallback)", icon->name, full_path);
                 free(icon->file_name);
@@ -900,20 +1134,20 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
             size_t len = icon->file_name_len;
             char *path = icon->file_name;
 
-            if (!icon_file_exists(it->item.fd, path, len))
+            if (!icon_file_exists(it->item.fd, path, len, stats))
                 continue;
 
             char full_path[strlen(it->item.path) + 1 + len + 1];
 
             /* Try SVG variant first */
             sprintf(full_path, "%s/%s", it->item.path, path);
-            if (path[len - 3] == 's' && svg(&icon->app->icon, full_path)) {
+            if (path[len - 3] == 's' && svg(icon->target, full_path)) {
                 LOG_DBG("%s: %s (standalone)", icon->name, full_path);
                 break;
             }
 
             /* No SVG, look for PNG instead */
-            if (path[len - 3] == 'p' && png(&icon->app->icon, full_path)) {
+            if (path[len - 3] == 'p' && png(icon->target, full_path)) {
                 LOG_DBG("%s: %s (standalone)", icon->name, full_path);
                 break;
             }
@@ -927,13 +1161,234 @@ lookup_icons(const icon_theme_list_t *themes, int icon_size,
     return true;
 }
 
+void
+icon_lookup_icons(icon_theme_list_t themes, int icon_size,
+                  struct icon *const *icons, size_t count)
+{
+    struct timespec *start = time_begin();
+    struct lookup_stats stats = {0};
+
+    xdg_data_dirs_t xdg_dirs = get_icon_dirs();
+    lookup_icons(&themes, icon_size, icons, count, &xdg_dirs, &stats);
+    xdg_data_dirs_destroy(xdg_dirs);
+
+    time_finish(start, NULL,
+                "%zu icons looked up: %zu icon-theme.cache files loaded, "
+                "%zu directories indexed by them, "
+                "%zu directories read (%zu entries), "
+                "%zu re-used, %zu not found, %zu faccessat() calls",
+                count, stats.caches_loaded, stats.dirs_indexed,
+                stats.dirs_read, stats.dir_entries, stats.dirs_cached,
+                stats.dirs_missing, stats.file_checks);
+}
+
 bool
 icon_lookup_application_icons(icon_theme_list_t themes, int icon_size,
                               struct application_list *applications)
 {
+    const size_t count = applications->count;
+    struct icon **icons = xmalloc((count > 0 ? count : 1) * sizeof(icons[0]));
+
+    for (size_t i = 0; i < count; i++)
+        icons[i] = &applications_get(applications, i)->icon;
+
+    icon_lookup_icons(themes, icon_size, icons, count);
+    free(icons);
+    return true;
+}
+
+void
+icon_move(struct icon *dst, struct icon *src)
+{
+    icon_reset(dst);
+
+    dst->path = src->path;
+    dst->type = src->type;
+    if (src->type == ICON_SVG)
+        dst->svg = src->svg;
+    else
+        dst->png = src->png;
+    dst->png_size_warned = src->png_size_warned;
+    dst->rasterized = src->rasterized;
+
+    src->path = NULL;
+    src->type = ICON_NONE;
+    src->png = NULL;
+    src->rasterized = (rasterized_list_t)tll_init();
+}
+
+bool
+icon_decode(struct icon *icon, bool gamma_correct)
+{
+    switch (icon->type) {
+    case ICON_NONE:
+        return false;
+
+    case ICON_PNG:
+        return icon->png != NULL ||
+               icon_from_png(icon, icon->path, gamma_correct);
+
+    case ICON_SVG:
+        return icon->svg != NULL || icon_from_svg(icon, icon->path);
+    }
+
+    return false;
+}
+
+/*
+ * Everything the icon lookup depends on, other than the contents of
+ * the theme directories
+ */
+static char *
+path_cache_key(const char *theme_name, int icon_size,
+               const xdg_data_dirs_t *dirs)
+{
+    char *key = xasprintf(
+        "theme=%s\nsize=%d\npng=%d\nsvg=%d\n",
+        theme_name, icon_size,
+#if defined(FUZZEL_ENABLE_PNG_LIBPNG)
+        1,
+#else
+        0,
+#endif
+#if defined(FUZZEL_ENABLE_SVG_NANOSVG) || defined(FUZZEL_ENABLE_SVG_LIBRSVG) || defined(FUZZEL_ENABLE_SVG_RESVG)
+        1
+#else
+        0
+#endif
+        );
+
+    tll_foreach(*dirs, it) {
+        char *new_key = xstrjoin3(key, "dir=", it->item.path);
+        free(key);
+        key = xstrjoin(new_key, "\n");
+        free(new_key);
+    }
+
+    return key;
+}
+
+bool
+icon_lookup_cached_icons(
+    struct icon_path_cache *cache, const char *theme_name, int icon_size,
+    struct icon *const *icons, size_t count)
+{
+    struct timespec *start = time_begin();
+
     xdg_data_dirs_t xdg_dirs = get_icon_dirs();
-    lookup_icons(&themes, icon_size, applications, &xdg_dirs);
+    icon_path_cache_init(cache, path_cache_key(theme_name, icon_size, &xdg_dirs));
     xdg_data_dirs_destroy(xdg_dirs);
 
+    if (!icon_path_cache_load(cache)) {
+        free(start);
+        return false;
+    }
+
+    const char *path;
+    enum icon_type type;
+
+    /* Don't touch any icons, unless all of them are cached */
+    for (size_t i = 0; i < count; i++) {
+        const char *name = icons[i]->name;
+
+        if (name != NULL && name[0] != '/' &&
+            !icon_path_cache_lookup(cache, name, &path, &type))
+        {
+            LOG_DBG("%s: not in the icon path cache", name);
+            free(start);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct icon *icon = icons[i];
+        icon_reset(icon);
+
+        if (icon->name == NULL)
+            continue;
+
+        if (icon->name[0] == '/') {
+            icon_from_absolute_path(icon);
+            continue;
+        }
+
+        icon_path_cache_lookup(cache, icon->name, &path, &type);
+
+        if (type == ICON_SVG)
+            svg(icon, path);
+        else if (type == ICON_PNG)
+            png(icon, path);
+    }
+
+    time_finish(start, NULL, "icons resolved from the icon path cache");
     return true;
 }
+
+void
+icon_record_application_icons(
+    struct icon_path_cache *cache, const char *theme_name,
+    icon_theme_list_t themes, const cache_path_stamps_t *theme_dirs,
+    int icon_size, const struct application_list *applications)
+{
+    xdg_data_dirs_t xdg_dirs = get_icon_dirs();
+    icon_path_cache_init(cache, path_cache_key(theme_name, icon_size, &xdg_dirs));
+    xdg_data_dirs_destroy(xdg_dirs);
+
+    /*
+     * The same theme may have been loaded from several base
+     * directories, and both the directories and the icon names
+     * may repeat
+     */
+    struct strset *seen = strset_init(256);
+
+    /* Stamped when the themes were loaded */
+    tll_foreach(*theme_dirs, it) {
+        const struct cache_path_stamp *dir = &it->item;
+        const size_t len = strlen(dir->path);
+
+        if (strset_find(seen, dir->path, len) == NULL) {
+            icon_path_cache_add_dir(cache, dir);
+            strset_add(seen, tll_back(cache->dirs).path, len, NULL);
+        }
+    }
+
+    /* The icon directories the lookup searched (or found missing) */
+    tll_foreach(themes, theme_it) {
+        const struct icon_theme *theme = &theme_it->item;
+
+        tll_foreach(theme->dirs, icon_dir_it) {
+            const struct icon_dir *icon_dir = &icon_dir_it->item;
+
+            tll_foreach(icon_dir->listings, listing_it) {
+                const struct icon_dir_listing *listing = &listing_it->item;
+                const char *base = listing->base_path;
+                char path[strlen(base) + 1 + strlen(theme->name) + 1 +
+                          strlen(icon_dir->path) + 1];
+                const int len = sprintf(
+                    path, "%s/%s/%s", base, theme->name, icon_dir->path);
+
+                if (strset_find(seen, path, len) == NULL) {
+                    icon_path_cache_add_icon_dir(
+                        cache, path, listing->exists ? &listing->st : NULL);
+                    strset_add(seen, tll_back(cache->icon_dirs).path, len, NULL);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < applications->count; i++) {
+        const struct application *app = applications_get(applications, i);
+        const char *name = app->icon.name;
+
+        if (name == NULL || name[0] == '/')
+            continue;
+
+        /* Keyed on the application's string; 'applications' outlives 'seen' */
+        if (!strset_add(seen, name, strlen(name), NULL))
+            continue;
+
+        icon_path_cache_add_icon(cache, name, app->icon.path, app->icon.type);
+    }
+
+    strset_destroy(seen);
+}
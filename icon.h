@@ -2,7 +2,10 @@
 
 #include <stdbool.h>
 
+#include <sys/stat.h>
+
 #include "application.h"
+#include "cache-file.h"
 #include "tllist.h"
 
 enum icon_dir_type {
@@ -11,6 +14,34 @@ enum icon_dir_type {
     ICON_DIR_THRESHOLD,
 };
 
+struct strset;
+struct arena;
+struct icon_cache;
+struct icon_path_cache;
+
+/*
+ * The icon files in an icon_dir, under one of the icon base
+ * directories. Either from the theme's icon-theme.cache, or read from
+ * the directory itself. Both are NULL if the directory doesn't exist.
+ */
+struct icon_dir_listing {
+    char *base_path;
+    struct strset *names;  /* Name (without extension) -> file types (icon.c) */
+
+    const struct icon_cache *cache;
+    int cache_dir_index;
+
+    /* The directory, as it was when read or indexed */
+    bool exists;
+    struct stat st;
+};
+
+/* A theme's icon-theme.cache, under one of the icon base directories */
+struct icon_theme_cache {
+    char *base_path;
+    struct icon_cache *cache;  /* NULL if there's none, or it's stale */
+};
+
 struct icon_dir {
     char *path;  /* Relative to theme's base path */
     int size;
@@ -19,21 +50,77 @@ struct icon_dir {
     int scale;
     int threshold;
     enum icon_dir_type type;
+
+    /* Read on first lookup, and kept for subsequent lookups */
+    tll(struct icon_dir_listing) listings;
 };
 
 struct icon_theme {
     char *name;
     tll(struct icon_dir) dirs;
+    tll(struct icon_theme_cache) caches;
+    struct arena *names;  /* Icon names in the dirs' listings */
 };
 
 typedef tll(struct icon_theme) icon_theme_list_t;
 
-icon_theme_list_t icon_load_theme(const char *name, bool filter_context);
+/*
+ * If 'dirs' isn't NULL, the icon base directories, and the theme
+ * directories looked for in them (<base>/<theme>), are stamped in it
+ */
+icon_theme_list_t icon_load_theme(
+    const char *name, bool filter_context, cache_path_stamps_t *dirs);
 void icon_themes_destroy(icon_theme_list_t themes);
 
 bool icon_lookup_application_icons(
     icon_theme_list_t themes, int icon_size,
     struct application_list *applications);
 
+/*
+ * Resolves the files of 'icons' (by name), resetting them first. The
+ * icons don't have to belong to any application; icons private to the
+ * calling thread are resolved without holding the icon lock, and then
+ * handed over with icon_move().
+ */
+void icon_lookup_icons(
+    icon_theme_list_t themes, int icon_size,
+    struct icon *const *icons, size_t count);
+
+/*
+ * Replaces 'dst' (other than its name) with 'src', including anything
+ * already decoded. 'src' is left reset.
+ */
+void icon_move(struct icon *dst, struct icon *src);
+
+/* Decodes the icon's file now, rather than when first rendered */
+bool icon_decode(struct icon *icon, bool gamma_correct);
+
+/*
+ * Application mode: resolves 'icons' (by name) from the icon path
+ * cache (see icon-path-cache.h), without loading any themes. Like
+ * icon_lookup_icons(), the icons may be private to the calling
+ * thread. Returns false, with the icons untouched, if the cache is
+ * missing, stale, or lacks any of the icons. Either way, 'cache' is
+ * initialized, and must be destroyed by the caller.
+ */
+bool icon_lookup_cached_icons(
+    struct icon_path_cache *cache, const char *theme_name, int icon_size,
+    struct icon *const *icons, size_t count);
+
+/*
+ * Initializes 'cache' with the icons resolved by
+ * icon_lookup_application_icons(), and the directories that lookup
+ * depended on, ready to be saved. 'theme_dirs' are the directories
+ * stamped by icon_load_theme().
+ *
+ * Only the icons' names, files and types are read. These are only
+ * changed by the thread that resolves them, which can thus call this
+ * without holding the icon lock.
+ */
+void icon_record_application_icons(
+    struct icon_path_cache *cache, const char *theme_name,
+    icon_theme_list_t themes, const cache_path_stamps_t *theme_dirs,
+    int icon_size, const struct application_list *applications);
+
 bool icon_from_png(struct icon *icon, const char *name, bool gamma_correct);
 bool icon_from_svg(struct icon *icon, const char *name);
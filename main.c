@@ -31,9 +31,11 @@
 #include "dmenu.h"
 #include "event.h"
 #include "fdm.h"
+#include "icon-path-cache.h"
 #include "key-binding.h"
 #include "match.h"
 #include "path.h"
+#include "popularity-cache.h"
 #include "render.h"
 #include "shm.h"
 #include "version.h"
@@ -57,9 +59,29 @@ struct context {
     struct application_list *apps;
 
     icon_theme_list_t *themes;
+    bool icons_resolved;
     int icon_size;
+    bool gamma_correct;
     mtx_t *icon_lock;
 
+    /*
+     * Application list indices of the matches on the first two pages,
+     * whose icons are resolved first. Set (under the icon lock) once
+     * all applications have been loaded, and 'set' is signaled.
+     */
+    struct {
+        size_t *entries;
+        size_t count;
+        size_t on_current_page;
+        cnd_t *set;
+    } icon_priority;
+
+    /*
+     * dmenu mode: signaled (under the icon lock) when more entries
+     * have been published, or the icon size has changed
+     */
+    cnd_t *icons_pending;
+
     const char *select_initial;
     const size_t select_initial_idx;
 
@@ -71,237 +93,9 @@ struct context {
             struct timespec *start;
             struct timespec *stop;
         } apps;
-        struct {
-            struct timespec *start;
-            struct timespec *stop;
-        } icons_theme;
-        struct {
-            struct timespec *start;
-            struct timespec *stop;
-        } icons;
     } timing;
 };
 
-struct cache_entry {
-    char *id;
-    char32_t *title;
-    size_t count;
-};
-
-static void
-read_cache(const char *path, struct application_list *apps, bool dmenu)
-{
-    if (path == NULL && dmenu) {
-        /* Don't thrash "normal" cache in dmenu mode */
-        return;
-    }
-
-    struct stat st;
-    FILE *f = NULL;
-
-    if (path == NULL) {
-        path = xdg_cache_dir();
-        if (path == NULL) {
-            LOG_WARN("failed to get cache directory: not saving popularity cache");
-            return;
-        }
-
-        int cache_dir_fd = open(path, O_DIRECTORY | O_CLOEXEC);
-        if (cache_dir_fd == -1) {
-            LOG_ERRNO("%s: failed to open", path);
-            return;
-        }
-
-        int fd = -1;
-        if (fstatat(cache_dir_fd, "fuzzel", &st, 0) < 0 ||
-            (fd = openat(cache_dir_fd, "fuzzel", O_RDONLY | O_CLOEXEC)) < 0 ||
-            (f = fdopen(fd, "r")) == NULL)
-        {
-            close(cache_dir_fd);
-            if (fd >= 0)
-                close(fd);
-
-            if (errno != ENOENT)
-                LOG_ERRNO("%s/fuzzel: failed to open", path);
-            return;
-        }
-        close(cache_dir_fd);
-    } else {
-        if (stat(path, &st) < 0 || (f = fopen(path, "re")) == NULL)
-        {
-            if (errno != ENOENT)
-                LOG_ERRNO("%s: failed to open", path);
-            return;
-        }
-    }
-
-    tll(struct cache_entry) cache_entries = tll_init();
-
-    size_t line_sz = 0;
-    char *line = NULL;
-
-    while (true) {
-        errno = 0;
-        ssize_t bytes = getline(&line, &line_sz, f);
-
-        if (bytes < 0) {
-            if (errno != 0) {
-                LOG_ERRNO("failed to read cache");
-                fclose(f);
-                free(line);
-                return;
-            }
-
-            /* Done */
-            break;
-        }
-
-        if (line[bytes - 1] == '\n')
-            line[bytes - 1] = '\0';
-
-        /* Parse each line ("<title>|<count>") */
-        char *ptr = NULL;
-        const char *id = strtok_r(line, "|", &ptr);
-        const char *count_str = strtok_r(NULL, "|", &ptr);
-
-        if (id == NULL || count_str == NULL) {
-            LOG_ERR("invalid cache entry (cache corrupt?): %s", line);
-            continue;
-        }
-
-        int count;
-        sscanf(count_str, "%u", &count);
-
-        struct cache_entry entry = {
-            .id = dmenu ? NULL : xstrdup(id),
-            .title = dmenu ? ambstoc32(id) : NULL,
-            .count = count,
-        };
-        tll_push_back(cache_entries, entry);
-    }
-
-    free(line);
-    fclose(f);
-
-    /* Loop all applications, and search for a matching cache entry */
-    for (size_t i = 0; i < apps->count; i++) {
-        struct application *app = apps->v[i];
-
-        if ((!dmenu && app->id == NULL) || (dmenu && app->title == NULL)) {
-            continue;
-        }
-
-        tll_foreach(cache_entries, it) {
-            const struct cache_entry *e = &it->item;
-            if ((!dmenu && e->id == NULL) || (dmenu && e->title == NULL))
-                continue;
-
-            if ((!dmenu && strcmp(app->id, e->id) == 0) ||
-                (dmenu && c32cmp(app->title, e->title) == 0))
-            {
-                app->count = e->count;
-
-                free(e->id);
-                free(e->title);
-                tll_remove(cache_entries, it);
-                break;
-            }
-        }
-    }
-
-    /* Free all un-matched cache entries */
-    tll_foreach(cache_entries, it) {
-        free(it->item.id);
-        tll_remove(cache_entries, it);
-    }
-}
-
-static void
-write_cache(const char *path, const struct application_list *apps, bool dmenu)
-{
-    if (path == NULL && dmenu) {
-        /* Don't thrash "normal" cache in dmenu mode */
-        return;
-    }
-
-    int fd = -1;
-
-    if (path == NULL) {
-        path = xdg_cache_dir();
-        if (path == NULL) {
-            LOG_WARN("failed to get cache directory: not saving popularity cache");
-            return;
-        }
-
-        int cache_dir_fd = open(path, O_DIRECTORY | O_CLOEXEC);
-        if (cache_dir_fd == -1) {
-            LOG_ERRNO("%s: failed to open", path);
-            return;
-        }
-
-        fd = openat(cache_dir_fd, "fuzzel", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-        close(cache_dir_fd);
-    } else {
-        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    }
-
-    if (fd == -1) {
-        LOG_ERRNO("%s/fuzzel: failed to open", path);
-        return;
-    }
-
-    for (size_t i = 0; i < apps->count; i++) {
-        if (apps->v[i]->count == 0)
-            continue;
-
-        if (!apps->v[i]->visible)
-            continue;
-
-        if (!dmenu && apps->v[i]->id == NULL)
-            continue;
-
-        if (dmenu && apps->v[i]->title == NULL)
-            continue;
-
-        if (!dmenu) {
-            const char *id = apps->v[i]->id;
-            const size_t id_len = strlen(id);
-
-            if (write(fd, id, id_len) != id_len) {
-                LOG_ERRNO("failed to write cache");
-                break;
-            }
-        } else {
-            const char32_t *title = apps->v[i]->title;
-            char *u8_title = ac32tombs(title);
-
-            if (u8_title != NULL) {
-                const size_t title_len = strlen(u8_title);
-                if (write(fd, u8_title, title_len) != title_len) {
-                    LOG_ERRNO("failed to write cache");
-                    break;
-                }
-
-                free(u8_title);
-            }
-        }
-
-        char count_as_str[11];
-        const size_t count_len = xsnprintf(
-            count_as_str, sizeof(count_as_str), "%u", apps->v[i]->count);
-
-        if (write(fd, "|", 1) != 1 ||
-            write(fd, count_as_str, count_len) != count_len ||
-            write(fd, "\n", 1) != 1)
-        {
-            LOG_ERRNO("failed to write cache");
-            break;
-        }
-    }
-
-    close(fd);
-}
-
 static const char *
 version_and_features(void)
 {
@@ -482,13 +276,22 @@ font_reloaded(struct wayland *wayl, struct fcft_font *font, void *data)
     mtx_lock(ctx->icon_lock);
     {
         ctx->icon_size = render_icon_size(ctx->render);
+        cnd_broadcast(ctx->icons_pending);
 
-        if (conf->icons_enabled) {
+        /*
+         * Until the initial icon lookup is done, load_icons() owns the
+         * themes, and re-does the lookup if the icon size has changed
+         */
+        if (conf->icons_enabled && ctx->icons_resolved) {
             icon_lookup_application_icons(
                 *ctx->themes, ctx->icon_size, ctx->apps);
 
             if (conf->dmenu.enabled) {
-                dmenu_try_icon_list(ctx->apps, *ctx->themes, ctx->icon_size);
+                for (size_t i = 0; i < ctx->apps->count; i++) {
+                    struct icon *icon = &applications_get(ctx->apps, i)->icon;
+                    dmenu_try_icon_list(
+                        &icon, 1, *ctx->themes, ctx->icon_size);
+                }
             }
         }
     }
@@ -564,6 +367,444 @@ acquire_file_lock(const char *path, int *fd)
     return true;
 }
 
+struct icon_theme_loader {
+    thrd_t thread;
+    bool running;
+
+    const char *name;
+    bool filter_context;
+    icon_theme_list_t themes;
+
+    /* Base and theme directories, for the icon path cache */
+    bool stamp_dirs;
+    cache_path_stamps_t dirs;
+
+    /*
+     * dmenu mode: once the themes are loaded, the icons of the entries
+     * are resolved as they're published, until all have been loaded
+     * ('apps_loaded', under the icon lock). The first 'resolved'
+     * entries are then done, at 'resolved_icon_size'.
+     */
+    struct context *ctx;
+    bool apps_loaded;
+    size_t resolved;
+    int resolved_icon_size;
+};
+
+static void resolve_published_icons(struct icon_theme_loader *loader);
+
+/* THREAD */
+static int
+load_icon_themes(void *_loader)
+{
+    struct icon_theme_loader *loader = _loader;
+
+    struct timespec *start = time_begin();
+    loader->themes = icon_load_theme(
+        loader->name, loader->filter_context,
+        loader->stamp_dirs ? &loader->dirs : NULL);
+    if (tll_length(loader->themes) > 0)
+        LOG_INFO("theme: %s", tll_front(loader->themes).name);
+    else
+        LOG_WARN("%s: icon theme not found", loader->name);
+    time_finish(start, NULL, "icon themes loaded");
+
+    if (loader->ctx != NULL)
+        resolve_published_icons(loader);
+
+    return 0;
+}
+
+/*
+ * Loads the icon themes in a thread of its own, while the applications
+ * are being loaded (or right away, if the thread can't be created)
+ */
+static void
+icon_themes_start(struct icon_theme_loader *loader)
+{
+    if (thrd_create(&loader->thread, &load_icon_themes, loader) == thrd_success)
+        loader->running = true;
+    else {
+        LOG_WARN("failed to create icon theme thread");
+
+        /* Nothing has been published yet */
+        loader->ctx = NULL;
+        load_icon_themes(loader);
+    }
+}
+
+/*
+ * Returns the loaded themes; the caller takes ownership. In dmenu
+ * mode, this also stops the resolving of published icons; call it
+ * once all entries have been loaded.
+ */
+static icon_theme_list_t
+icon_themes_wait(struct icon_theme_loader *loader)
+{
+    if (loader->running) {
+        if (loader->ctx != NULL) {
+            mtx_lock(loader->ctx->icon_lock);
+            loader->apps_loaded = true;
+            cnd_broadcast(loader->ctx->icons_pending);
+            mtx_unlock(loader->ctx->icon_lock);
+        }
+
+        thrd_join(loader->thread, NULL);
+        loader->running = false;
+    }
+
+    icon_theme_list_t themes = loader->themes;
+    loader->themes = (icon_theme_list_t)tll_init();
+    return themes;
+}
+
+/*
+ * Resolves, and optionally decodes, the icons of the applications at
+ * 'indices'. This is done on private icons, without holding the icon
+ * lock (rendering doesn't have to wait); the lock is only held while
+ * handing them over to the applications, after which they're rendered.
+ */
+/* THREAD */
+static int
+resolve_icon_batch(struct context *ctx, icon_theme_list_t themes,
+                   int icon_size, bool dmenu_enabled,
+                   const size_t *indices, size_t count, bool decode)
+{
+    struct application_list *apps = ctx->apps;
+
+    if (count == 0)
+        return 0;
+
+    struct icon *icons = xcalloc(count, sizeof(icons[0]));
+    struct icon **ptrs = xmalloc(count * sizeof(ptrs[0]));
+
+    for (size_t i = 0; i < count; i++) {
+        /* Icon names are never changed once loaded */
+        icons[i].name = applications_get(apps, indices[i])->icon.name;
+        ptrs[i] = &icons[i];
+    }
+
+    icon_lookup_icons(themes, icon_size, ptrs, count);
+    if (dmenu_enabled)
+        dmenu_try_icon_list(ptrs, count, themes, icon_size);
+
+    if (decode) {
+        for (size_t i = 0; i < count; i++)
+            icon_decode(&icons[i], ctx->gamma_correct);
+    }
+
+    mtx_lock(ctx->icon_lock);
+    {
+        for (size_t i = 0; i < count; i++)
+            icon_move(&applications_get(apps, indices[i])->icon, &icons[i]);
+    }
+    mtx_unlock(ctx->icon_lock);
+
+    free(ptrs);
+    free(icons);
+
+    return send_event(ctx->event_fd, EVENT_ICONS_LOADED);
+}
+
+/*
+ * Application mode: resolves all icons from the icon path cache, the
+ * same way resolve_icon_batch() does; i.e. the cache is loaded, and
+ * looked up, without holding the icon lock.
+ */
+/* THREAD */
+static bool
+resolve_cached_icons(struct context *ctx, struct icon_path_cache *cache,
+                     const char *icon_theme, int icon_size)
+{
+    struct application_list *apps = ctx->apps;
+    const size_t count = apps->count;
+
+    struct icon *icons = xcalloc(count > 0 ? count : 1, sizeof(icons[0]));
+    struct icon **ptrs = xmalloc((count > 0 ? count : 1) * sizeof(ptrs[0]));
+
+    for (size_t i = 0; i < count; i++) {
+        icons[i].name = applications_get(apps, i)->icon.name;
+        ptrs[i] = &icons[i];
+    }
+
+    const bool found = icon_lookup_cached_icons(
+        cache, icon_theme, icon_size, ptrs, count);
+
+    if (found) {
+        mtx_lock(ctx->icon_lock);
+        {
+            for (size_t i = 0; i < count; i++)
+                icon_move(&applications_get(apps, i)->icon, &icons[i]);
+        }
+        mtx_unlock(ctx->icon_lock);
+    }
+
+    free(ptrs);
+    free(icons);
+    return found;
+}
+
+/*
+ * dmenu mode: resolves the icons of each chunk of entries as it's
+ * published, so that the first page gets its icons while the rest
+ * of the input is still being read. Runs in the theme loader thread.
+ */
+/* THREAD */
+static void
+resolve_published_icons(struct icon_theme_loader *loader)
+{
+    struct context *ctx = loader->ctx;
+    size_t resolved = 0;
+    int resolved_icon_size = 0;
+
+    while (true) {
+        mtx_lock(ctx->icon_lock);
+
+        while (!loader->apps_loaded &&
+               (ctx->icon_size == 0 ||
+                (ctx->icon_size == resolved_icon_size &&
+                 ctx->apps->count == resolved)))
+        {
+            cnd_wait(ctx->icons_pending, ctx->icon_lock);
+        }
+
+        const bool apps_loaded = loader->apps_loaded;
+        const int icon_size = ctx->icon_size;
+        mtx_unlock(ctx->icon_lock);
+
+        /* load_icons() resolves the rest, in match order */
+        if (apps_loaded)
+            break;
+
+        if (icon_size != resolved_icon_size) {
+            resolved = 0;
+            resolved_icon_size = icon_size;
+        }
+
+        const size_t count = ctx->apps->count;
+        if (count == resolved)
+            continue;
+
+        size_t *indices = xmalloc((count - resolved) * sizeof(indices[0]));
+        for (size_t i = resolved; i < count; i++)
+            indices[i - resolved] = i;
+
+        int r = resolve_icon_batch(
+            ctx, loader->themes, icon_size, true,
+            indices, count - resolved, false);
+        free(indices);
+
+        if (r != 0)
+            break;
+
+        resolved = count;
+    }
+
+    loader->resolved = resolved;
+    loader->resolved_icon_size = resolved_icon_size;
+}
+
+/*
+ * Resolves all icons, in batches: the current page (decoded as well,
+ * so that it is rendered without delay), the next page, and then
+ * everything else. Each batch is rendered as soon as it's resolved.
+ *
+ * The first 'resolved' entries have already been resolved, at
+ * 'icon_size', by resolve_published_icons(). These are skipped,
+ * unless they're on the current or the next page.
+ */
+/* THREAD */
+static int
+resolve_icons(struct context *ctx, icon_theme_list_t themes, int icon_size,
+              bool dmenu_enabled, size_t resolved)
+{
+    struct application_list *apps = ctx->apps;
+    const size_t count = apps->count;
+
+    if (count == 0)
+        return send_event(ctx->event_fd, EVENT_ICONS_LOADED);
+
+    struct timespec *start = time_begin();
+
+    size_t *order = xmalloc(count * sizeof(order[0]));
+    bool *queued = xcalloc(count, sizeof(queued[0]));
+    size_t queued_count = 0;
+    size_t on_current_page = 0;
+
+    mtx_lock(ctx->icon_lock);
+    {
+        /*
+         * The main thread sets the priority when it has processed
+         * EVENT_APPS_ALL_LOADED. Don't wait for long; without it,
+         * icons are simply resolved in application list order.
+         */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100 * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while (ctx->icon_priority.entries == NULL &&
+               cnd_timedwait(ctx->icon_priority.set, ctx->icon_lock,
+                             &deadline) == thrd_success)
+            ;
+
+        for (size_t i = 0; i < ctx->icon_priority.count; i++) {
+            const size_t idx = ctx->icon_priority.entries[i];
+            if (idx >= count || queued[idx])
+                continue;
+
+            if (i < ctx->icon_priority.on_current_page)
+                on_current_page++;
+
+            queued[idx] = true;
+            order[queued_count++] = idx;
+        }
+    }
+    mtx_unlock(ctx->icon_lock);
+
+    const size_t prioritized = queued_count;
+
+    for (size_t i = resolved; i < count; i++) {
+        if (!queued[i])
+            order[queued_count++] = i;
+    }
+
+    int r = resolve_icon_batch(
+        ctx, themes, icon_size, dmenu_enabled,
+        &order[0], on_current_page, true);
+
+    if (r == 0) {
+        r = resolve_icon_batch(
+            ctx, themes, icon_size, dmenu_enabled,
+            &order[on_current_page], prioritized - on_current_page, false);
+    }
+
+    if (r == 0) {
+        r = resolve_icon_batch(
+            ctx, themes, icon_size, dmenu_enabled,
+            &order[prioritized], queued_count - prioritized, false);
+    }
+
+    free(queued);
+    free(order);
+
+    time_finish(start, NULL,
+                "icon paths resolved (%zu on the current page, %zu on the next)",
+                on_current_page, prioritized - on_current_page);
+    return r;
+}
+
+/* THREAD */
+static int
+load_icons(struct context *ctx, struct icon_theme_loader *loader,
+           const char *icon_theme, bool dmenu_enabled)
+{
+    struct application_list *apps = ctx->apps;
+    struct icon_path_cache cache = {0};
+    struct icon_path_cache fresh = {0};
+    int cached_icon_size = 0;
+    int r = 0;
+
+    /*
+     * Application mode: resolve the icons from the icon path cache,
+     * and display them, without waiting for the themes. The cache is
+     * then revalidated, once the themes have been loaded.
+     */
+    if (!dmenu_enabled) {
+        mtx_lock(ctx->icon_lock);
+        const int icon_size = ctx->icon_size;
+        mtx_unlock(ctx->icon_lock);
+
+        if (icon_size > 0 &&
+            resolve_cached_icons(ctx, &cache, icon_theme, icon_size))
+        {
+            cached_icon_size = icon_size;
+
+            r = send_event(ctx->event_fd, EVENT_ICONS_LOADED);
+            if (r != 0)
+                goto out;
+        }
+    }
+
+    icon_theme_list_t themes = icon_themes_wait(loader);
+
+    mtx_lock(ctx->icon_lock);
+    *ctx->themes = themes;
+    mtx_unlock(ctx->icon_lock);
+
+    /* Icons added to, or removed from, the theme since the cache was saved */
+    const bool cache_stale =
+        cached_icon_size > 0 && icon_path_cache_icon_dirs_changed(&cache);
+
+    int resolved_icon_size = cache_stale ? 0 : cached_icon_size;
+    int recorded_icon_size = 0;
+    bool resolved = false;
+
+    while (true) {
+        mtx_lock(ctx->icon_lock);
+        int icon_size = ctx->icon_size;
+        mtx_unlock(ctx->icon_lock);
+
+        /*
+         * Record the icons for the next run before handing them over
+         * to font_reloaded(). Until then, they're only changed by this
+         * thread, and can be read without holding the lock.
+         */
+        if (resolved && !dmenu_enabled &&
+            icon_size == resolved_icon_size &&
+            icon_size != recorded_icon_size)
+        {
+            icon_path_cache_destroy(&fresh);
+            icon_record_application_icons(
+                &fresh, icon_theme, themes, &loader->dirs, icon_size, apps);
+            recorded_icon_size = icon_size;
+        }
+
+        bool done = false;
+
+        mtx_lock(ctx->icon_lock);
+        icon_size = ctx->icon_size;
+        if (icon_size == 0 || icon_size == resolved_icon_size) {
+            /* Icon size changes are handled by font_reloaded() from now on */
+            ctx->icons_resolved = true;
+            done = true;
+        }
+        mtx_unlock(ctx->icon_lock);
+
+        if (done)
+            break;
+
+        /* dmenu: entries resolved while they were being loaded */
+        const size_t already_resolved =
+            icon_size == loader->resolved_icon_size ? loader->resolved : 0;
+
+        r = resolve_icons(
+            ctx, themes, icon_size, dmenu_enabled, already_resolved);
+        if (r != 0)
+            goto out;
+
+        resolved_icon_size = icon_size;
+        resolved = true;
+    }
+
+    if (!resolved && cached_icon_size == 0) {
+        /* No icon size yet; have the icon column laid out anyway */
+        r = send_event(ctx->event_fd, EVENT_ICONS_LOADED);
+    }
+
+    /* Icons are displayed; save them for the next run */
+    if (resolved && !dmenu_enabled && recorded_icon_size == resolved_icon_size)
+        icon_path_cache_save(&fresh);
+
+out:
+    icon_path_cache_destroy(&cache);
+    icon_path_cache_destroy(&fresh);
+    return r;
+}
+
 /* THREAD */
 static int
 populate_apps(void *_ctx)
@@ -584,7 +825,9 @@ populate_apps(void *_ctx)
     bool filter_desktop = conf->filter_desktop;
     bool list_exec_in_path = conf->list_executables_in_path;
     char_list_t desktops = tll_init();
+    struct desktop_cache desktop_cache = {0};
     char *saveptr = NULL;
+    int r = 0;
 
     if (filter_desktop) {
         char *xdg_current_desktop = getenv("XDG_CURRENT_DESKTOP");
@@ -600,60 +843,90 @@ populate_apps(void *_ctx)
         }
     }
 
+    struct icon_theme_loader icon_themes = {
+        .name = icon_theme,
+        .filter_context = !dmenu_enabled,
+        .stamp_dirs = !dmenu_enabled,
+        .ctx = dmenu_enabled && !conf->prompt_only ? ctx : NULL,
+    };
+
+    if (icons_enabled)
+        icon_themes_start(&icon_themes);
+
     ctx->timing.apps.start = time_begin();
 
     if (dmenu_enabled) {
         if (!conf->prompt_only) {
+            /*
+             * Launch counts are assigned as entries are published,
+             * since they're matched (and sorted) right away
+             */
+            struct popularity_cache *popularity =
+                popularity_cache_open(cache_path, true);
+
             dmenu_load_entries(
                 apps, dmenu_delim, dmenu_with_nth_format, dmenu_match_nth_format,
-                dmenu_nth_delim, ctx->event_fd, ctx->dmenu_abort_fd);
-            read_cache(cache_path, apps, true);
+                dmenu_nth_delim, popularity, ctx->event_fd, ctx->dmenu_abort_fd);
+
+            popularity_cache_close(popularity);
         }
     } else {
-        xdg_find_programs(terminal, actions_enabled, filter_desktop, &desktops, apps);
+        xdg_find_programs(terminal, actions_enabled, filter_desktop,
+                          &desktops, apps, &desktop_cache);
         if (list_exec_in_path)
             path_find_programs(apps);
-        read_cache(cache_path, apps, false);
+        popularity_cache_load(cache_path, apps, false);
     }
-    tll_free_and_free(desktops, free);
 
     ctx->timing.apps.stop = time_end();
 
-    int r = send_event(ctx->event_fd, EVENT_APPS_ALL_LOADED);
+    r = send_event(ctx->event_fd, EVENT_APPS_ALL_LOADED);
     if (r != 0)
-        return r;
+        goto out;
 
     if (icons_enabled) {
-        ctx->timing.icons_theme.start = time_begin();
-        icon_theme_list_t icon_themes = icon_load_theme(icon_theme, !dmenu_enabled);
-        if (tll_length(icon_themes) > 0)
-            LOG_INFO("theme: %s", tll_front(icon_themes).name);
-        else
-            LOG_WARN("%s: icon theme not found", icon_theme);
-        ctx->timing.icons_theme.stop = time_end();
-
-        ctx->timing.icons.start = time_begin();
-        mtx_lock(ctx->icon_lock);
-        {
-            *ctx->themes = icon_themes;
-            if (ctx->icon_size > 0) {
-                icon_lookup_application_icons(
-                    *ctx->themes, ctx->icon_size, apps);
+        r = load_icons(ctx, &icon_themes, icon_theme, dmenu_enabled);
+        if (r != 0)
+            goto out;
+    }
 
-                if (dmenu_enabled) {
-                    dmenu_try_icon_list(apps, *ctx->themes, ctx->icon_size);
-                }
-            }
-        }
-        mtx_unlock(ctx->icon_lock);
-        ctx->timing.icons.stop = time_end();
+out:
+    if (icons_enabled) {
+        /* Not yet handed over, if we bailed out early */
+        icon_themes_destroy(icon_themes_wait(&icon_themes));
+        cache_path_stamps_destroy(&icon_themes.dirs);
+    }
 
-        r = send_event(ctx->event_fd, EVENT_ICONS_LOADED);
-        if (r != 0)
-            return r;
+    if (!dmenu_enabled) {
+        /* Everything's displayed; now bring the desktop entry cache up to date */
+        xdg_update_cache(terminal, actions_enabled, filter_desktop,
+                         &desktops, apps, &desktop_cache);
     }
 
-    return 0;
+    tll_free_and_free(desktops, free);
+    return r;
+}
+
+/* Have the icons of the current, and the next, page resolved first */
+static void
+set_icon_priority(struct context *ctx)
+{
+    const size_t max = 2 * matches_max_matches_per_page(ctx->matches);
+    size_t *entries = xmalloc((max > 0 ? max : 1) * sizeof(entries[0]));
+
+    const size_t count =
+        matches_get_upcoming_entries(ctx->matches, entries, max);
+    const size_t on_current_page = min(count, matches_get_count(ctx->matches));
+
+    mtx_lock(ctx->icon_lock);
+    {
+        free(ctx->icon_priority.entries);
+        ctx->icon_priority.entries = entries;
+        ctx->icon_priority.count = count;
+        ctx->icon_priority.on_current_page = on_current_page;
+        cnd_broadcast(ctx->icon_priority.set);
+    }
+    mtx_unlock(ctx->icon_lock);
 }
 
 static bool
@@ -705,7 +978,7 @@ process_event(struct context *ctx, enum event_type event)
              *   b) all applications have been loaded
              *   c) a partial load will cause more matches to be displayed
              */
-            matches_update_no_delay(matches);
+            matches_update_appended(matches);
             if (select_idx != 0) {
                 if (!matches_selected_set(matches, select_idx)) {
                     LOG_ERR("couldn't select entry at index %zu", select_idx);
@@ -716,6 +989,18 @@ process_event(struct context *ctx, enum event_type event)
                 matches_selected_select(matches, select);
         }
 
+        if (event == EVENT_APPS_ALL_LOADED && conf->icons_enabled)
+            set_icon_priority(ctx);
+
+        if (event == EVENT_APPS_SOME_LOADED && conf->icons_enabled &&
+            conf->dmenu.enabled)
+        {
+            /* Have the icons of the newly published entries resolved */
+            mtx_lock(ctx->icon_lock);
+            cnd_broadcast(ctx->icons_pending);
+            mtx_unlock(ctx->icon_lock);
+        }
+
         /*
          * Allow displaying the menu if:
          *   --no-run-if-empty is NOT enabled, OR we have at least one entry
@@ -737,10 +1022,6 @@ process_event(struct context *ctx, enum event_type event)
 
     case EVENT_ICONS_LOADED:
         /* Just need to refresh the GUI */
-        time_finish(ctx->timing.icons_theme.start, ctx->timing.icons_theme.stop,
-                    "icon themes loaded");
-        time_finish(ctx->timing.icons.start, ctx->timing.icons.stop,
-                    "icon paths resolved");
         matches_icons_loaded(matches);
         break;
 
@@ -1042,6 +1323,7 @@ main(int argc, char *const *argv)
 
     setlocale(LC_CTYPE, "");
     setlocale(LC_MESSAGES, "");
+    char32_init();
 
     /* Auto-enable dmenu mode if invoked through a ‘dmenu’ symlink */
     if (argv[0] != NULL) {
@@ -2259,6 +2541,21 @@ main(int argc, char *const *argv)
         return EXIT_FAILURE;
     }
 
+    cnd_t icon_priority_set;
+    if (cnd_init(&icon_priority_set) != thrd_success) {
+        LOG_ERR("failed to create icon priority condition variable");
+        mtx_destroy(&icon_lock);
+        return EXIT_FAILURE;
+    }
+
+    cnd_t icons_pending;
+    if (cnd_init(&icons_pending) != thrd_success) {
+        LOG_ERR("failed to create pending icons condition variable");
+        cnd_destroy(&icon_priority_set);
+        mtx_destroy(&icon_lock);
+        return EXIT_FAILURE;
+    }
+
     struct application_list *apps = NULL;
     struct fdm *fdm = NULL;
     struct prompt *prompt = NULL;
@@ -2330,6 +2627,8 @@ main(int argc, char *const *argv)
         .apps = apps,
         .themes = &themes,
         .icon_lock = &icon_lock,
+        .icon_priority = {.set = &icon_priority_set},
+        .icons_pending = &icons_pending,
         .select_initial = select,
         .select_initial_idx = select_idx,
         .event_fd = -1,
@@ -2344,7 +2643,8 @@ main(int argc, char *const *argv)
              &font_reloaded, &ctx)) == NULL)
         goto out;
 
-    render_initialize_colors(render, &conf, wayl_do_linear_blending(wayl));
+    ctx.gamma_correct = wayl_do_linear_blending(wayl);
+    render_initialize_colors(render, &conf, ctx.gamma_correct);
 
     matches_set_wayland(matches, wayl);
     ctx.wayl = wayl;
@@ -2395,7 +2695,7 @@ main(int argc, char *const *argv)
     }
 
     if (wayl_update_cache(wayl))
-        write_cache(conf.cache_path, apps, conf.dmenu.enabled);
+        popularity_cache_save(conf.cache_path, apps, conf.dmenu.enabled);
 
     ret = wayl_exit_code(wayl);
 
@@ -2408,6 +2708,7 @@ out:
 
         int res;
         thrd_join(app_thread_id, &res);
+        free(ctx.icon_priority.entries);
 
         if (res != 0) {
             if (res < 0)
@@ -2428,6 +2729,8 @@ out:
     if (dmenu_abort_fd >= 0)
         close(dmenu_abort_fd);
 
+    cnd_destroy(&icons_pending);
+    cnd_destroy(&icon_priority_set);
     mtx_destroy(&icon_lock);
 
     shm_fini();
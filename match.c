@@ -5,6 +5,7 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string.h>
@@ -27,13 +28,23 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "char32.h"
+#include "corpus.h"
+#include "ngram.h"
+#include "timing.h"
 #include "wayland.h"
+#include "wsdeque.h"
 #include "xmalloc.h"
 #include "xsnprintf.h"
 
 #define min(x, y) ((x < y) ? (x) : (y))
 #define max(x, y) ((x > y) ? (x) : (y))
 
+/* Don't bother building an n-gram index for small application lists */
+#define INDEX_MIN_ENTRIES 10000
+
+/* Don't bother waking up the worker threads for small searches */
+#define THREADS_MIN_ENTRIES 4096
+
 enum delayed_update_type {
     DELAYED_NO_UPDATE,
     DELAYED_FULL_UPDATE,
@@ -46,6 +57,7 @@ struct matches {
     struct wayland *wayl;
     const struct prompt *prompt;
     struct application_list *applications;
+    struct corpus *corpus;  /* What we search; mirrors 'applications' */
     enum match_fields fields;
     bool all_apps_loaded;
 
@@ -59,11 +71,59 @@ struct matches {
     size_t page_count;
     size_t selected;
     size_t max_matches_per_page;
+
+    /*
+     * Number of leading matches that are in their final order. The
+     * remaining ones compare no better than these, but are otherwise
+     * unsorted; they are sorted on demand, as the selection moves
+     * past 'sorted_count'.
+     */
+    size_t sorted_count;
+
+    /*
+     * Entries [0..count) have been matched against 'prompt'. As long
+     * as the prompt doesn't change, entries loaded after that (dmenu
+     * mode) can be matched on their own, and merged into the result.
+     */
+    struct {
+        char32_t *prompt;
+        size_t count;
+    } matched;
+
     size_t fuzzy_min_length;
     size_t fuzzy_max_length_discrepancy;
     size_t fuzzy_max_distance;
     bool have_icons;
 
+    /* Pre-processed tokens, for match_levenshtein() (fuzzy mode only) */
+    struct levenshtein_pattern *fuzzy_patterns;
+
+    /*
+     * UTF-8 encoded tokens, for matching UTF-8 titles without decoding
+     * them (see match_title_utf8())
+     */
+    struct utf8_token *utf8_tokens;
+    char *utf8_token_text;
+
+    /* UTF-8 titles are decoded here when matching single threaded */
+    char32_t *title_buf;
+    size_t title_buf_size;
+
+    /*
+     * Fuzzy mode: the previous matches are *not* a superset of the
+     * matches for a longer prompt. Instead, track the applications
+     * that matched, or that were rejected for reasons that may no
+     * longer hold once the last token grows. Typing more characters
+     * only needs to search these.
+     */
+    struct {
+        char32_t *prompt;           /* Prompt 'ids' was built for */
+        size_t apps_size;           /* matches_size when built */
+        bool valid;
+        uint32_t *ids;
+        size_t count;
+    } fuzzy_narrow;
+
     size_t delay_ms;
     size_t delay_limit;
     int delay_fd;
@@ -72,33 +132,97 @@ struct matches {
     /* Thread synchronization */
     struct {
         uint16_t count;
-        sem_t start;
         sem_t done;
-        mtx_t lock;
-        tll(uint64_t) queue;
+        bool exit;
         thrd_t *threads;
+        struct match_worker **state;
+        uint32_t grain;  /* Slices larger than this are split */
 
         /* Set before feeding thread with sorting data */
         bool incremental;
         const char32_t *const *tokens;
         size_t *tok_lengths;
         size_t tok_count;
+        const uint32_t *candidates;
+        const uint32_t *fuzzy_candidates;
 
         struct match *old_matches;
     } workers;
+
+    /* N-gram index, built in the background once all apps are loaded */
+    struct {
+        bool enabled;
+        bool thread_running;
+        thrd_t thread;
+        _Atomic bool abort;
+        _Atomic bool ready;
+        struct ngram_index *ngrams;
+    } index;
 };
 
-struct thread_context {
+/*
+ * Per-thread state. Each worker has its own deque of slices (ranges
+ * of entries to search), and its own result buffers. The results are
+ * merged into 'matches' once all workers are done.
+ */
+struct match_worker {
     struct matches *matches;
     int my_id;
+
+    /* One per worker, so that no worker can run twice in one update */
+    sem_t start;
+    struct ws_deque deque;
+
+    struct match *results;
+    size_t result_count;
+    size_t result_size;
+
+    /* Fuzzy mode: see 'fuzzy_narrow' in struct matches */
+    uint32_t *fuzzy_narrow;
+    size_t fuzzy_narrow_count;
+    size_t fuzzy_narrow_size;
+
+    /* UTF-8 titles are decoded here */
+    char32_t *title_buf;
+    size_t title_buf_size;
+
+    /* Statistics, for --print-timing-info */
+    struct timespec *time_start;
+    struct timespec *time_stop;
+    size_t searched;
+    size_t slices;
+    size_t stolen;
 };
 
-struct levenshtein_matrix {
-    size_t distance;
-    enum choice { UNSET, FIRST, SECOND, THIRD } choice;
+struct utf8_token {
+    const char *text;
+    size_t len;
+    bool ascii;
+};
+
+/*
+ * A search token, pre-processed for match_levenshtein(). Tokens of up
+ * to 64 characters are matched bit-parallel (Myers/Hyyrö); 'peq' is a
+ * small hash table mapping each token character to a bit mask of the
+ * positions it occurs at.
+ */
+#define LEVENSHTEIN_MAX_BITS 64
+#define LEVENSHTEIN_PEQ_SIZE 128
+
+struct levenshtein_pattern {
+    const char32_t *pat;
+    size_t len;
+    bool last;  /* Last token; grows as the user types */
+    struct {
+        char32_t c;
+        uint64_t mask;  /* 0 means empty slot */
+    } peq[LEVENSHTEIN_PEQ_SIZE];
 };
 
 static int match_thread(void *_ctx);
+static int match_compar(const void *_a, const void *_b);
+static void matches_sort_upto(struct matches *matches, size_t count);
+static void matches_sort_selected_page(struct matches *matches);
 
 static bool
 is_word_boundary(const char32_t *str, size_t pos)
@@ -116,8 +240,7 @@ static char32_t *
 match_exact(const char32_t *haystack, size_t haystack_len,
             const char32_t *needle, size_t needle_len)
 {
-    return memmem(haystack, haystack_len * sizeof(char32_t),
-                  needle, needle_len * sizeof(char32_t));
+    return c32memmem(haystack, haystack_len, needle, needle_len);
 }
 
 static void
@@ -152,6 +275,11 @@ match_fzf(const char32_t *haystack, size_t haystack_len,
              start < haystack_end;
              start++)
         {
+            /* Only positions matching the first character can match at all */
+            start = c32memchr(start, *needle, haystack_end - start);
+            if (start == NULL)
+                break;
+
             const char32_t *n = needle;
             const char32_t *h = start;
 
@@ -198,118 +326,490 @@ match_fzf(const char32_t *haystack, size_t haystack_len,
     }
 }
 
+/*
+ * match_fzf(), on UTF-8 text. For ASCII needles, this finds the same
+ * matches match_fzf() does on the decoded text: ASCII bytes never
+ * occur inside multi-byte sequences, and match lengths are the same
+ * in bytes and code points. Positions are byte offsets.
+ */
 static void
-levenshtein_distance(const char32_t *a, size_t alen,
-                     const char32_t *b, size_t blen,
-                     struct levenshtein_matrix **m)
+match_fzf_utf8(const char *haystack, size_t haystack_len,
+               const char *needle, size_t needle_len,
+               struct match_substring **pos, size_t *pos_count,
+               enum matched_type *match_type)
 {
-    for (size_t i = 1; i <= blen; i++) {
-        m[i][0].distance = i;
-        m[i][0].choice = FIRST;
-    }
+    const char *const needle_end = &needle[needle_len];
+    const char *const haystack_end = &haystack[haystack_len];
+
+    const char *haystack_search_start = haystack;
 
-    for (size_t i = 1; i <= blen; i++) {
-        for (size_t j = 1; j <= alen; j++) {
-            const size_t cost = a[j - 1] == b[i - 1] ? 0 : 1;
-            const size_t first = m[i - 1][j].distance + 1;
-            const size_t second = m[i][j - 1].distance + 1;
-            const size_t third = m[i - 1][j - 1].distance + cost;
+    while (needle < needle_end) {
+        if (haystack_search_start >= haystack_end) {
+            free(*pos);
+            *pos = NULL;
+            *pos_count = 0;
+            *match_type = MATCHED_NONE;
+            return;
+        }
 
-            const size_t shortest = min(min(first, second), third);
-            m[i][j].distance = shortest;
+        size_t longest_match_len = 0;
+        size_t longest_match_ofs = 0;
 
-            if (shortest == first)
-                m[i][j].choice = FIRST;
-            else if (shortest == second)
-                m[i][j].choice = SECOND;
-            else
-                m[i][j].choice = THIRD;
+        for (const char *start = haystack_search_start;
+             start < haystack_end;
+             start++)
+        {
+            start = memchr(start, *needle, haystack_end - start);
+            if (start == NULL)
+                break;
+
+            const char *n = needle;
+            const char *h = start;
+
+            size_t match_len = 0;
+            while (n < needle_end && h < haystack_end && *n == *h) {
+                match_len++;
+                n++;
+                h++;
+            }
+
+            if (match_len > longest_match_len) {
+                longest_match_len = match_len;
+                longest_match_ofs = start - haystack;
+            }
+
+            if (n >= needle_end)
+                break;
         }
+
+        if (longest_match_len == 0) {
+            *match_type = MATCHED_NONE;
+            return;
+        }
+
+        (*pos_count)++;
+        *pos = xreallocarray(*pos, *pos_count, sizeof((*pos)[0]));
+        (*pos)[*pos_count - 1].start = longest_match_ofs;
+        (*pos)[*pos_count - 1].len = longest_match_len;
+
+        *match_type = MATCHED_EXACT;
+
+        needle += longest_match_len;
+        haystack_search_start = haystack + longest_match_ofs + longest_match_len;
     }
 }
 
-static const char32_t *
-match_levenshtein(struct matches *matches,
-                  const char32_t *src, size_t src_len,
-                  const char32_t *pat, size_t pat_len, size_t *_match_len)
+/*
+ * True if the bytes of 'needle' occur in 'haystack', in order. Any
+ * text match_fzf() matches passes this.
+ */
+static bool
+utf8_is_subsequence(const char *haystack, size_t haystack_len,
+                    const char *needle, size_t needle_len)
 {
-    if (matches->mode != MATCH_MODE_FUZZY)
-        return NULL;
+    const char *h = haystack;
+    const char *const haystack_end = &haystack[haystack_len];
+
+    for (size_t i = 0; i < needle_len; i++) {
+        h = memchr(h, needle[i], haystack_end - h);
+        if (h == NULL)
+            return false;
+        h++;
+    }
 
-    if (pat_len < matches->fuzzy_min_length)
-        return NULL;
+    return true;
+}
 
-    if (src_len < pat_len)
-        return NULL;
+/* Number of code points in the first 'len' bytes of valid UTF-8 */
+static size_t
+utf8_code_points(const char *text, size_t len)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++)
+        count += ((unsigned char)text[i] & 0xc0) != 0x80;
+    return count;
+}
 
-    struct levenshtein_matrix **m = xcalloc(pat_len + 1, sizeof(m[0]));
-    for (size_t i = 0; i < pat_len + 1; i++)
-        m[i] = xcalloc(src_len + 1, sizeof(m[0][0]));
-
-    levenshtein_distance(src, src_len, pat, pat_len, m);
-
-#if 0
-    /* Dump levenshtein table */
-    printf("     ");
-    for (size_t j = 0; j < src_len; j++)
-        printf("%lc  ", src[j]);
-    printf("\n");
-    for (size_t i = 0; i < pat_len + 1; i++) {
-        if (i > 0)
-            printf("%lc ", pat[i - 1]);
-        else
-            printf("  ");
+/* is_word_boundary(), with 'pos' being a byte offset into UTF-8 text */
+static bool
+is_word_boundary_utf8(const char *text, size_t pos)
+{
+    if (pos == 0)
+        return true;
 
-        for (size_t j = 0; j < src_len + 1; j++)
-            printf("%zu%c ", m[i][j].distance,
-                   m[i][j].choice == FIRST ? 'f' :
-                   m[i][j].choice == SECOND ? 's' :
-                   m[i][j].choice == THIRD ? 't' : 'u');
-        printf("\n");
+    if ((unsigned char)text[pos - 1] < 0x80)
+        return isc32space((unsigned char)text[pos - 1]);
+
+    /* Decode the code point ending at 'pos' */
+    size_t start = pos - 1;
+    while (start > 0 && pos - start < 4 &&
+           ((unsigned char)text[start] & 0xc0) == 0x80)
+    {
+        start--;
     }
-#endif
 
-    size_t c = 0;
-    size_t best = m[pat_len][0].distance;
+    char32_t prev[4];
+    return utf8ntoc32(prev, &text[start], pos - start) == 1 &&
+           isc32space(prev[0]);
+}
 
-    for (ssize_t j = src_len; j >= 0; j--) {
-        if (m[pat_len][j].distance < best) {
-            best = m[pat_len][j].distance;
-            c = j;
-        }
+static inline size_t
+peq_slot(char32_t c)
+{
+    return (c * 2654435761u) >> (32 - 7);
+}
+
+static void
+levenshtein_pattern_init(struct levenshtein_pattern *p,
+                         const char32_t *pat, size_t len)
+{
+    p->pat = pat;
+    p->len = len;
+    memset(p->peq, 0, sizeof(p->peq));
+
+    if (len > LEVENSHTEIN_MAX_BITS)
+        return;
+
+    for (size_t i = 0; i < len; i++) {
+        size_t slot = peq_slot(pat[i]);
+        while (p->peq[slot].mask != 0 && p->peq[slot].c != pat[i])
+            slot = (slot + 1) % LEVENSHTEIN_PEQ_SIZE;
+
+        p->peq[slot].c = pat[i];
+        p->peq[slot].mask |= (uint64_t)1 << i;
     }
+}
 
-    const size_t end = c;
+static inline uint64_t
+peq_lookup(const struct levenshtein_pattern *p, char32_t c)
+{
+    for (size_t slot = peq_slot(c);
+         p->peq[slot].mask != 0;
+         slot = (slot + 1) % LEVENSHTEIN_PEQ_SIZE)
+    {
+        if (p->peq[slot].c == c)
+            return p->peq[slot].mask;
+    }
+
+    return 0;
+}
+
+/*
+ * Advances the Myers bit-vectors (vertical deltas) one column. Row 0
+ * is all zeroes, i.e. a match may start anywhere in the source.
+ */
+static inline void
+myers_step(uint64_t eq, uint64_t *pv, uint64_t *mv)
+{
+    const uint64_t xv = eq | *mv;
+    const uint64_t xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+    const uint64_t ph = (*mv | ~(xh | *pv)) << 1;
+    const uint64_t mh = (*pv & xh) << 1;
+
+    *pv = mh | ~(xv | ph);
+    *mv = ph & xv;
+}
+
+/* Distance of row 'row', given a column's vertical delta vectors */
+static inline size_t
+myers_cell(uint64_t pv, uint64_t mv, size_t row)
+{
+    const uint64_t mask = row >= 64
+        ? ~(uint64_t)0
+        : ((uint64_t)1 << row) - 1;
+    return __builtin_popcountll(pv & mask) - __builtin_popcountll(mv & mask);
+}
+
+/*
+ * Walks the (implicit) distance matrix back from (pat_len, end),
+ * returning the column where the match starts. Ties are broken the
+ * same way the full matrix used to be built: vertical, horizontal,
+ * then diagonal.
+ */
+static size_t
+levenshtein_traceback(const char32_t *src, const char32_t *pat,
+                      size_t pat_len, size_t end,
+                      size_t (*cell)(const void *ctx, size_t row, size_t col),
+                      const void *ctx)
+{
     size_t r = pat_len;
-    // printf("starting at r=%zu, c=%zu\n", r, c);
+    size_t c = end;
 
     while (r > 0) {
-        switch (m[r][c].choice) {
-        case UNSET: assert(false); break;
-        case FIRST: r--; break;
-        case SECOND: c--; break;
-        case THIRD: r--; c--; break;
+        if (c == 0) {
+            r--;
+            continue;
+        }
+
+        const size_t cost = src[c - 1] == pat[r - 1] ? 0 : 1;
+        const size_t first = cell(ctx, r - 1, c) + 1;
+        const size_t second = cell(ctx, r, c - 1) + 1;
+        const size_t third = cell(ctx, r - 1, c - 1) + cost;
+        const size_t shortest = min(min(first, second), third);
+
+        if (shortest == first)
+            r--;
+        else if (shortest == second)
+            c--;
+        else {
+            r--;
+            c--;
+        }
+    }
+
+    return c;
+}
+
+struct myers_columns {
+    const uint64_t *pv;
+    const uint64_t *mv;
+    size_t window;
+    size_t first_col;
+};
+
+static size_t
+myers_columns_cell(const void *ctx, size_t row, size_t col)
+{
+    const struct myers_columns *cols = ctx;
+    assert(col >= cols->first_col);
+
+    const size_t idx = col % cols->window;
+    return myers_cell(cols->pv[idx], cols->mv[idx], row);
+}
+
+/*
+ * Bit-parallel matcher, for tokens that fit in a 64-bit word.
+ *
+ * The first pass finds the best end column, and its distance. The
+ * second pass, run only when the distance is acceptable, re-computes
+ * the columns the traceback may touch. A traceback from column 'end'
+ * never moves more than pat_len + distance columns to the left, so
+ * those fit in a small ring buffer on the stack.
+ */
+static size_t
+levenshtein_myers(const char32_t *src, size_t src_len,
+                  const struct levenshtein_pattern *p, size_t max_distance,
+                  size_t *_start, size_t *_end)
+{
+    const size_t pat_len = p->len;
+
+    uint64_t pv = ~(uint64_t)0;
+    uint64_t mv = 0;
+
+    size_t best = pat_len;
+    size_t end = 0;
+
+    for (size_t j = 1; j <= src_len; j++) {
+        myers_step(peq_lookup(p, src[j - 1]), &pv, &mv);
+
+        const size_t score = myers_cell(pv, mv, pat_len);
+
+        /* Right-most column with the lowest distance wins */
+        if (score < best || (score == best && best < pat_len)) {
+            best = score;
+            end = j;
+        }
+    }
+
+    if (best > max_distance)
+        return best;
+
+    enum { RING_SIZE = 2 * LEVENSHTEIN_MAX_BITS + 2 };
+    uint64_t ring_pv[RING_SIZE];
+    uint64_t ring_mv[RING_SIZE];
+
+    const size_t window = pat_len + best + 2;
+    const size_t first_col = end >= window - 1 ? end - (window - 1) : 0;
+
+    pv = ~(uint64_t)0;
+    mv = 0;
+
+    if (first_col == 0) {
+        ring_pv[0] = pv;
+        ring_mv[0] = mv;
+    }
+
+    for (size_t j = 1; j <= end; j++) {
+        myers_step(peq_lookup(p, src[j - 1]), &pv, &mv);
+        if (j >= first_col) {
+            ring_pv[j % window] = pv;
+            ring_mv[j % window] = mv;
         }
     }
 
-#if 0
-    *match = (struct levenshtein_match){
-        .start = c,
-        .len = end - c,
-        .distance = m[pat_len][end].distance,
+    const struct myers_columns cols = {
+        .pv = ring_pv,
+        .mv = ring_mv,
+        .window = window,
+        .first_col = first_col,
     };
-#endif
-    const size_t match_ofs = c;
-    const size_t match_distance = m[pat_len][end].distance;
-    const size_t match_len = end - c;
 
-    LOG_DBG("%ls vs. %ls: sub-string: %.*ls, (distance=%zu, row=%zu, col=%zu)",
-            (const wchar_t *)src, (const wchar_t *)pat,
-            (int)match_len, (const wchar_t *)&src[match_ofs], match_distance, r, c);
+    *_start = levenshtein_traceback(
+        src, p->pat, pat_len, end, &myers_columns_cell, &cols);
+    *_end = end;
+    return best;
+}
+
+/* Advances a full DP column one step (source character 'c') */
+static inline void
+dp_step(char32_t c, const char32_t *pat, size_t pat_len, size_t col[static 1])
+{
+    size_t diag = col[0];
+    col[0] = 0;
+
+    for (size_t i = 1; i <= pat_len; i++) {
+        const size_t cost = c == pat[i - 1] ? 0 : 1;
+        const size_t left = col[i];
+        col[i] = min(min(col[i - 1] + 1, left + 1), diag + cost);
+        diag = left;
+    }
+}
+
+/*
+ * Cells within 'distance' of the diagonal ending at (pat_len, end).
+ * Row 'r' covers columns [lo(r), lo(r) + width), where lo(r) is
+ * end - (pat_len - r) - distance - 2.
+ */
+struct dp_band {
+    size_t *cells;
+    size_t width;
+    size_t pat_len;
+    size_t end;
+    size_t distance;
+};
+
+static inline ssize_t
+dp_band_offset(const struct dp_band *band, size_t row, size_t col)
+{
+    return (ssize_t)col - (ssize_t)band->end +
+        (ssize_t)(band->pat_len - row) + (ssize_t)band->distance + 2;
+}
+
+static size_t
+dp_band_cell(const void *ctx, size_t row, size_t col)
+{
+    const struct dp_band *band = ctx;
+    const ssize_t ofs = dp_band_offset(band, row, col);
+
+    assert(ofs >= 0 && ofs < (ssize_t)band->width);
+    return band->cells[row * band->width + ofs];
+}
+
+/*
+ * Fallback for tokens longer than 64 characters: a plain column-wise
+ * DP. As above, the first pass only finds the best end column. Each
+ * step away from the diagonal costs one, so the traceback path stays
+ * within 'distance' cells of it; that band is all the second pass
+ * needs to record.
+ */
+static size_t
+levenshtein_banded(const char32_t *src, size_t src_len,
+                   const struct levenshtein_pattern *p, size_t max_distance,
+                   size_t *_start, size_t *_end)
+{
+    const char32_t *pat = p->pat;
+    const size_t pat_len = p->len;
+
+    size_t col[pat_len + 1];
+    for (size_t i = 0; i <= pat_len; i++)
+        col[i] = i;
+
+    size_t best = pat_len;
+    size_t end = 0;
+
+    for (size_t j = 1; j <= src_len; j++) {
+        dp_step(src[j - 1], pat, pat_len, col);
+
+        if (col[pat_len] < best || (col[pat_len] == best && best < pat_len)) {
+            best = col[pat_len];
+            end = j;
+        }
+    }
+
+    if (best > max_distance)
+        return best;
+
+    struct dp_band band = {
+        .width = 2 * best + 4,
+        .pat_len = pat_len,
+        .end = end,
+        .distance = best,
+    };
+
+    /* Only pathologically large bands (huge max distance) hit the heap */
+    const size_t band_cells = (pat_len + 1) * band.width;
+    size_t band_on_stack[band_cells <= 4096 ? band_cells : 1];
+    band.cells = band_cells <= 4096
+        ? band_on_stack
+        : xmalloc(band_cells * sizeof(band.cells[0]));
+
+    for (size_t i = 0; i <= pat_len; i++)
+        col[i] = i;
 
-    for (size_t i = 0; i < pat_len + 1; i++)
-        free(m[i]);
-    free(m);
+    for (size_t j = 0; j <= end; j++) {
+        if (j > 0)
+            dp_step(src[j - 1], pat, pat_len, col);
+
+        for (size_t i = 0; i <= pat_len; i++) {
+            const ssize_t ofs = dp_band_offset(&band, i, j);
+            if (ofs >= 0 && ofs < (ssize_t)band.width)
+                band.cells[i * band.width + ofs] = col[i];
+        }
+    }
+
+    *_start = levenshtein_traceback(
+        src, pat, pat_len, end, &dp_band_cell, &band);
+    *_end = end;
+
+    if (band.cells != band_on_stack)
+        free(band.cells);
+
+    return best;
+}
+
+/*
+ * '*may_match_longer' is set when the last token was rejected for a
+ * reason that may not hold once it grows: it being too short, or the
+ * match length discrepancy. The distance never decreases when a
+ * token grows, so a rejection on distance alone is final.
+ */
+static const char32_t *
+match_levenshtein(struct matches *matches,
+                  const char32_t *src, size_t src_len,
+                  const struct levenshtein_pattern *p, size_t *_match_len,
+                  bool *may_match_longer)
+{
+    if (matches->mode != MATCH_MODE_FUZZY)
+        return NULL;
+
+    const size_t pat_len = p->len;
+
+    if (pat_len < matches->fuzzy_min_length) {
+        if (p->last)
+            *may_match_longer = true;
+        return NULL;
+    }
+
+    if (src_len < pat_len)
+        return NULL;
+
+    size_t match_ofs = 0;
+    size_t end = 0;
+
+    const size_t match_distance = pat_len <= LEVENSHTEIN_MAX_BITS
+        ? levenshtein_myers(
+            src, src_len, p, matches->fuzzy_max_distance, &match_ofs, &end)
+        : levenshtein_banded(
+            src, src_len, p, matches->fuzzy_max_distance, &match_ofs, &end);
+
+    if (match_distance > matches->fuzzy_max_distance)
+        return NULL;
+
+    const size_t match_len = end - match_ofs;
+
+    LOG_DBG("%ls vs. %ls: sub-string: %.*ls, (distance=%zu)",
+            (const wchar_t *)src, (const wchar_t *)p->pat,
+            (int)match_len, (const wchar_t *)&src[match_ofs], match_distance);
 
     const size_t len_diff = match_len > pat_len
         ? match_len - pat_len
@@ -323,6 +823,8 @@ match_levenshtein(struct matches *matches,
         return &src[match_ofs];
     }
 
+    if (p->last)
+        *may_match_longer = true;
     return NULL;
 }
 
@@ -383,6 +885,7 @@ matches_init(struct fdm *fdm, const struct prompt *prompt,
         .fdm = fdm,
         .prompt = prompt,
         .applications = NULL,
+        .corpus = corpus_init(fields),
         .fields = fields,
         .mode = mode,
         .sort_result = sort_result,
@@ -398,38 +901,44 @@ matches_init(struct fdm *fdm, const struct prompt *prompt,
         .delay_fd = -1,
         .delay_ms = delay_ms,
         .delay_limit = delay_limit,
+        .index = {
+            /* The index covers the title and --match-nth text only */
+            .enabled = mode != MATCH_MODE_FUZZY &&
+                       (fields & ~(MATCH_NAME | MATCH_NTH)) == 0,
+        },
     };
 
     if (workers > 0) {
-        if (sem_init(&matches->workers.start, 0, 0) < 0 ||
-            sem_init(&matches->workers.done, 0, 0) < 0)
-        {
-            LOG_ERRNO("failed to instantiate match worker semaphores");
+        if (sem_init(&matches->workers.done, 0, 0) < 0) {
+            LOG_ERRNO("failed to instantiate match worker semaphore");
             goto err_free_matches;
         }
 
-        int err;
-        if ((err = mtx_init(&matches->workers.lock, mtx_plain)) != thrd_success) {
-            LOG_ERR("failed to instantiate match worker mutex: %d", err);
-            goto err_free_semaphores;
-        }
-
         matches->workers.threads =
             xcalloc(workers, sizeof(matches->workers.threads[0]));
+        matches->workers.state =
+            xcalloc(workers, sizeof(matches->workers.state[0]));
 
         for (size_t i = 0; i < workers; i++) {
-            struct thread_context *ctx = xmalloc(sizeof(*ctx));
-            *ctx = (struct thread_context){
-                .matches = matches,
-                .my_id = 1 + i,
-            };
+            struct match_worker *worker = xcalloc(1, sizeof(*worker));
+            worker->matches = matches;
+            worker->my_id = 1 + i;
+            ws_deque_init(&worker->deque);
+
+            if (sem_init(&worker->start, 0, 0) < 0) {
+                LOG_ERRNO("failed to instantiate match worker semaphore");
+                free(worker);
+                goto err_free_semaphores;
+            }
+
+            matches->workers.state[i] = worker;
 
             int ret = thrd_create(
-                &matches->workers.threads[i], &match_thread, ctx);
+                &matches->workers.threads[i], &match_thread, worker);
             if (ret != thrd_success) {
                 LOG_ERR("failed to create match worker thread: %d", ret);
                 matches->workers.threads[i] = 0;
-                goto err_free_semaphores_and_lock;
+                goto err_free_semaphores;
             }
 
             matches->workers.count++;
@@ -441,23 +950,21 @@ matches_init(struct fdm *fdm, const struct prompt *prompt,
     int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
     if (timer_fd < 0) {
         LOG_ERRNO("failed to create timerfd");
-        goto err_free_semaphores_and_lock;
+        goto err_free_semaphores;
     }
 
     if (!fdm_add(fdm, timer_fd, EPOLLIN, &fdm_delayed_timer, matches)) {
         close(timer_fd);
-        goto err_free_semaphores_and_lock;
+        goto err_free_semaphores;
     }
 
     matches->delay_fd = timer_fd;
     return matches;
 
-err_free_semaphores_and_lock:
-    mtx_destroy(&matches->workers.lock);
 err_free_semaphores:
-    sem_destroy(&matches->workers.start);
     sem_destroy(&matches->workers.done);
 err_free_matches:
+    corpus_destroy(matches->corpus);
     free(matches);
     return NULL;
 }
@@ -470,21 +977,31 @@ matches_destroy(struct matches *matches)
 
     fdm_del(matches->fdm, matches->delay_fd);
 
-    mtx_lock(&matches->workers.lock);
-    {
-        assert(tll_length(matches->workers.queue) == 0);
+    matches->workers.exit = true;
 
-        for (size_t i = 0; i < matches->workers.count; i++) {
-            assert(matches->workers.threads[i] != 0);
-            sem_post(&matches->workers.start);
-            tll_push_back(matches->workers.queue, (uint64_t)-2);
-        }
+    for (size_t i = 0; i < matches->workers.count; i++) {
+        assert(matches->workers.threads[i] != 0);
+        sem_post(&matches->workers.state[i]->start);
     }
-    mtx_unlock(&matches->workers.lock);
 
-    for (size_t i = 0; i < matches->workers.count; i++)
+    for (size_t i = 0; i < matches->workers.count; i++) {
         thrd_join(matches->workers.threads[i], NULL);
 
+        /* Note: 'pos' in the results is owned by matches->matches */
+        struct match_worker *worker = matches->workers.state[i];
+        sem_destroy(&worker->start);
+        free(worker->results);
+        free(worker->fuzzy_narrow);
+        free(worker->title_buf);
+        free(worker);
+    }
+
+    if (matches->index.thread_running) {
+        matches->index.abort = true;
+        thrd_join(matches->index.thread, NULL);
+    }
+    ngram_index_destroy(matches->index.ngrams);
+
     mtx_lock(&matches->applications->lock);
     if (matches->applications != NULL) {
         for (size_t i = 0; i < matches->matches_size; i++)
@@ -492,11 +1009,15 @@ matches_destroy(struct matches *matches)
     }
     mtx_unlock(&matches->applications->lock);
 
+    free(matches->matched.prompt);
+    free(matches->title_buf);
+    free(matches->fuzzy_narrow.prompt);
+    free(matches->fuzzy_narrow.ids);
+    corpus_destroy(matches->corpus);
     free(matches->workers.threads);
+    free(matches->workers.state);
     free(matches->matches);
     free(matches->workers.old_matches);
-    mtx_destroy(&matches->workers.lock);
-    sem_destroy(&matches->workers.start);
     sem_destroy(&matches->workers.done);
     free(matches);
 }
@@ -508,6 +1029,74 @@ matches_set_wayland(struct matches *matches, struct wayland *wayl)
     matches->wayl = wayl;
 }
 
+/* THREAD */
+static int
+index_thread(void *_ctx)
+{
+    struct matches *matches = _ctx;
+
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    if (pthread_setname_np(pthread_self(), "fuzzel:index") < 0)
+        LOG_ERRNO("index thread: failed to set process title");
+
+    const bool index_name = matches->fields & MATCH_NAME;
+    const bool index_nth = matches->fields & MATCH_NTH;
+
+    /* The corpus doesn't change once all apps have been loaded */
+    mtx_lock(&matches->applications->lock);
+    const struct corpus *corpus = matches->corpus;
+    const size_t count = corpus->count;
+    mtx_unlock(&matches->applications->lock);
+
+    struct timespec *start = time_begin();
+    struct ngram_index *ngrams = ngram_index_init();
+
+    char32_t *title_buf = NULL;
+    size_t title_buf_size = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (matches->index.abort) {
+            ngram_index_destroy(ngrams);
+            free(title_buf);
+            free(start);
+            return 1;
+        }
+
+        if (!corpus->visible[i])
+            continue;
+
+        const char32_t *text;
+        size_t len;
+
+        if (index_name) {
+            text = corpus_title(corpus, i, &title_buf, &title_buf_size, &len);
+            ngram_index_add(ngrams, i, text, len);
+
+            text = corpus_text(corpus, CORPUS_TRANSLATED_NAME, i, &len);
+            if (text != NULL)
+                ngram_index_add(ngrams, i, text, len);
+        }
+
+        if (index_nth) {
+            text = corpus_text(corpus, CORPUS_MATCH_NTH, i, &len);
+            if (text != NULL)
+                ngram_index_add(ngrams, i, text, len);
+        }
+    }
+
+    free(title_buf);
+
+    time_finish(start, NULL, "n-gram index built (%zu entries)",
+                ngram_index_entry_count(ngrams));
+
+    matches->index.ngrams = ngrams;
+    matches->index.ready = true;
+    return 0;
+}
+
 void
 matches_all_applications_loaded(struct matches *matches)
 {
@@ -517,33 +1106,58 @@ matches_all_applications_loaded(struct matches *matches)
     assert(matches->matches_size == matches->applications->count);
     matches_unlock(matches);
 #endif
+
+    if (!matches->index.enabled || matches->index.thread_running ||
+        matches->applications->count < INDEX_MIN_ENTRIES)
+    {
+        return;
+    }
+
+    int ret = thrd_create(&matches->index.thread, &index_thread, matches);
+    if (ret != thrd_success) {
+        LOG_ERR("failed to create n-gram index thread: %d", ret);
+        return;
+    }
+
+    matches->index.thread_running = true;
 }
 
 void
 matches_set_applications(struct matches *matches,
                          struct application_list *applications)
 {
+    /*
+     * Entries up to the published count are immutable, and can be
+     * read without blocking the loader, which may be appending more
+     * while we're copying these.
+     */
+    const size_t count = atomic_load_explicit(
+        &applications->count, memory_order_acquire);
+
     mtx_lock(&applications->lock);
 
     assert(matches->matches == NULL || matches->matches_size > 0);
-    assert(applications->count >= matches->matches_size);
+    assert(count >= matches->matches_size);
 
     matches->applications = applications;
 
-    if (matches->matches == NULL && applications->count == 0) {
+    if (matches->matches == NULL && count == 0) {
         mtx_unlock(&applications->lock);
         return;
     }
 
     matches->matches = xreallocarray(
-        matches->matches, applications->count, sizeof(matches->matches[0]));
+        matches->matches, count, sizeof(matches->matches[0]));
 
     const size_t old_size = matches->matches_size;
-    const size_t diff = applications->count - old_size;
+    const size_t diff = count - old_size;
 
     memset(&matches->matches[old_size], 0, diff * sizeof(matches->matches[0]));
 
-    matches->matches_size = applications->count;
+    for (size_t i = old_size; i < count; i++)
+        corpus_append(matches->corpus, applications_get(applications, i));
+
+    matches->matches_size = count;
     mtx_unlock(&applications->lock);
     matches_icons_loaded(matches);
 }
@@ -555,8 +1169,8 @@ matches_icons_loaded(struct matches *matches)
         return;
 
     mtx_lock(&matches->applications->lock);
-    for (size_t i = 0; i < matches->applications->count; i++) {
-        if (matches->applications->v[i]->icon.name != NULL) {
+    for (size_t i = 0; i < matches->matches_size; i++) {
+        if (applications_get(matches->applications, i)->icon.name != NULL) {
             matches->have_icons = true;
             break;
         }
@@ -592,6 +1206,7 @@ void
 matches_max_matches_per_page_set(struct matches *matches, size_t max_matches)
 {
     matches->max_matches_per_page = max_matches;
+    matches_sort_selected_page(matches);
 }
 
 size_t
@@ -681,6 +1296,44 @@ matches_get_match_index(const struct matches *matches)
         : 0;
 }
 
+size_t
+matches_get_upcoming_entries(struct matches *matches, size_t *entries,
+                             size_t max)
+{
+    const size_t per_page = matches->max_matches_per_page;
+    const size_t first = matches_get_page(matches) * per_page;
+    size_t count = 0;
+
+    /* The next page may extend into the unsorted matches */
+    matches_sort_upto(matches, first + 2 * per_page);
+
+    for (size_t i = first;
+         i < matches->match_count && i - first < 2 * per_page && count < max;
+         i++)
+    {
+        entries[count++] = matches->matches[i].entry;
+    }
+
+    return count;
+}
+
+/*
+ * True if the title contains 'string' (given both as UTF-8, and
+ * decoded). Titles kept as UTF-8 are compared without decoding them.
+ */
+static bool
+title_contains(struct application *app, const char *string, size_t len,
+               const char32_t *wstring, size_t wlen)
+{
+    if (app->dmenu_line_lowercase != NULL) {
+        /* The title is the (valid UTF-8) line itself */
+        return memmem(app->dmenu_line, app->dmenu_line_len, string, len) != NULL;
+    }
+
+    return match_exact(application_title(app), app->title_len,
+                       wstring, wlen) != NULL;
+}
+
 bool
 matches_selected_select(struct matches *matches, const char *_string)
 {
@@ -691,19 +1344,64 @@ matches_selected_select(struct matches *matches, const char *_string)
     if (string == NULL)
         return false;
 
-    for (size_t i = 0; i < matches->match_count; i++) {
-        if (match_exact(matches->matches[i].application->title,
-                       matches->matches[i].application->title_len,
-                       string, c32len(string)) != NULL)
+    const size_t len = strlen(_string);
+    const size_t wlen = c32len(string);
+
+    /*
+     * First match, in sort order. Check the sorted matches first, and
+     * only sort as far as the best unsorted match that contains the
+     * string, if none of them does.
+     */
+    const size_t sorted = matches->sorted_count;
+    bool found = false;
+
+    for (size_t i = 0; i < sorted; i++) {
+        if (title_contains(matches->matches[i].application,
+                           _string, len, string, wlen))
         {
             matches->selected = i;
-            free(string);
-            return true;
+            found = true;
+            break;
+        }
+    }
+
+    const struct match *best = NULL;
+
+    for (size_t i = sorted; !found && i < matches->match_count; i++) {
+        const struct match *m = &matches->matches[i];
+
+        if ((best == NULL || match_compar(m, best) < 0) &&
+            title_contains(m->application, _string, len, string, wlen))
+        {
+            best = m;
+        }
+    }
+
+    if (best != NULL) {
+        /* Everything that doesn't compare worse must be sorted */
+        size_t count = sorted;
+        for (size_t i = sorted; i < matches->match_count; i++) {
+            if (match_compar(&matches->matches[i], best) <= 0)
+                count++;
+        }
+
+        matches_sort_upto(matches, count);
+
+        for (size_t i = sorted; i < matches->sorted_count; i++) {
+            if (title_contains(matches->matches[i].application,
+                               _string, len, string, wlen))
+            {
+                matches->selected = i;
+                found = true;
+                break;
+            }
         }
+
+        assert(found);
     }
 
     free(string);
-    return false;
+    return found;
 }
 
 bool
@@ -713,6 +1411,7 @@ matches_idx_select(struct matches *matches, size_t idx)
         return false;
 
     matches->selected = match_get_idx(matches, idx);
+    matches_sort_selected_page(matches);
     return true;
 }
 
@@ -723,6 +1422,7 @@ matches_selected_first(struct matches *matches)
         return false;
 
     matches->selected = 0;
+    matches_sort_selected_page(matches);
     return true;
 }
 
@@ -733,6 +1433,7 @@ matches_selected_set(struct matches *matches, size_t idx)
         return false;
 
     matches->selected = idx;
+    matches_sort_selected_page(matches);
     return true;
 }
 
@@ -746,6 +1447,7 @@ matches_selected_last(struct matches *matches)
     }
 
     matches->selected = matches->match_count - 1;
+    matches_sort_selected_page(matches);
     return true;
 }
 
@@ -754,109 +1456,601 @@ matches_selected_prev(struct matches *matches, bool wrap)
 {
     if (matches->selected > 0) {
         matches->selected--;
+        matches_sort_selected_page(matches);
         return true;
     } else if (wrap && matches->match_count > 1) {
         matches->selected = matches->match_count - 1;
+        matches_sort_selected_page(matches);
         return true;
     }
 
     return false;
 }
 
-bool
-matches_selected_next(struct matches *matches, bool wrap)
+bool
+matches_selected_next(struct matches *matches, bool wrap)
+{
+    if (matches->selected + 1 < matches->match_count) {
+        matches->selected++;
+        matches_sort_selected_page(matches);
+        return true;
+    } else if (wrap && matches->match_count > 1) {
+        matches->selected = 0;
+        matches_sort_selected_page(matches);
+        return true;
+    }
+
+    return false;
+}
+
+bool
+matches_selected_prev_page(struct matches *matches, bool scrolling)
+{
+    const size_t page_no = matches_get_page(matches);
+    if (page_no > 0) {
+        assert(matches->selected >= matches->max_matches_per_page);
+        matches->selected -= matches->max_matches_per_page;
+        matches_sort_selected_page(matches);
+        return true;
+    } else if (!scrolling && matches->selected > 0) {
+        matches->selected = 0;
+        matches_sort_selected_page(matches);
+        return true;
+    }
+
+    return false;
+}
+
+bool
+matches_selected_next_page(struct matches *matches, bool scrolling)
+{
+    const size_t page_no = matches_get_page(matches);
+    if (page_no + 1 < matches->page_count) {
+        matches->selected = min(
+            matches->selected + matches->max_matches_per_page,
+            matches->match_count - 1);
+        matches_sort_selected_page(matches);
+        return true;
+    } else if (!scrolling && matches->selected < matches->match_count - 1) {
+        matches->selected = matches->match_count - 1;
+        matches_sort_selected_page(matches);
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * The sort order, on the full (unpacked) match data:
+ *
+ *  1. Exact matches before fuzzy ones
+ *  2. Most frequently launched first
+ *  3. Matches at word boundaries first
+ *  4. Highest score (longest consecutive match) first
+ *  5. Fewest matched ranges first
+ *  6. Earliest first match first
+ *  7. Shortest title first
+ *
+ * This is only used to compare matches whose sort keys both had a
+ * field that didn't fit; see match_sort_key().
+ */
+static int
+match_compar_full(const struct match *a, const struct match *b)
+{
+    if (a->matched_type != b->matched_type) {
+        if (a->matched_type == MATCHED_EXACT)
+            return -1;
+        else
+            return 1;
+    }
+
+    if (a->application->count > b->application->count)
+        return -1;
+    else if (a->application->count < b->application->count)
+        return 1;
+    /* Prioritize matches at word boundaries */
+    else if (a->word_boundary != b->word_boundary) {
+        return a->word_boundary ? -1 : 1;
+    }
+    else if (a->score > b->score)
+        return -1;
+    else if (a->score < b->score)
+        return 1;
+    else if (a->pos_count < b->pos_count)
+        return -1;
+    else if (a->pos_count > b->pos_count)
+        return 1;
+    else if (a->pos_count > 0 && b->pos_count > 0 && a->pos[0].start < b->pos[0].start)
+        return -1;
+    else if (a->pos_count > 0 && b->pos_count > 0 && a->pos[0].start > b->pos[0].start)
+        return 1;
+    else if (a->pos_count > 0 && b->pos_count > 0 &&
+             application_has_title(a->application) &&
+             application_has_title(b->application))
+    {
+        if (a->application->title_len < b->application->title_len)
+            return -1;
+        else if (a->application->title_len > b->application->title_len)
+            return 1;
+        else
+            return 0;
+    } else
+        return 0;
+}
+
+/* Set in sort keys where a field was clamped */
+#define SORT_KEY_SATURATED ((uint64_t)1)
+
+static uint64_t
+sort_key_field(size_t value, unsigned bits, bool *saturated)
+{
+    const uint64_t max_value = ((uint64_t)1 << bits) - 1;
+
+    if (value >= max_value) {
+        *saturated = true;
+        return max_value;
+    }
+
+    return value;
+}
+
+/*
+ * Packs everything match_compar_full() looks at into a single integer,
+ * with the most significant field in the most significant bits. Fields
+ * where a higher value sorts first are stored inverted.
+ *
+ * Values that don't fit are clamped, and the key is flagged as
+ * saturated. Clamping preserves the order, so comparing keys gives
+ * the same result as comparing the full match data, unless *both*
+ * keys are flagged.
+ *
+ *   bit  63:     not an exact match
+ *   bits 62..47: application (launch) count, inverted
+ *   bit  46:     not at a word boundary
+ *   bits 45..30: score, inverted
+ *   bits 29..22: number of matched ranges
+ *   bits 21..10: start of first matched range
+ *   bits  9..1:  title length
+ *   bit   0:     saturated
+ */
+static uint64_t
+match_sort_key(const struct match *m)
+{
+    const struct application *app = m->application;
+    const bool have_pos = m->pos_count > 0;
+    bool saturated = false;
+    uint64_t key;
+
+    key = m->matched_type != MATCHED_EXACT;
+    key = key << 16 | (0xffff - sort_key_field(app->count, 16, &saturated));
+    key = key << 1 | !m->word_boundary;
+    key = key << 16 | (0xffff - sort_key_field(m->score, 16, &saturated));
+    key = key << 8 | sort_key_field(m->pos_count, 8, &saturated);
+    key = key << 12 | (have_pos
+                       ? sort_key_field(max(m->pos[0].start, 0), 12, &saturated)
+                       : 0);
+    key = key << 9 | (have_pos && application_has_title(app)
+                      ? sort_key_field(app->title_len, 9, &saturated)
+                      : 0);
+    key = key << 1 | (saturated ? SORT_KEY_SATURATED : 0);
+
+    return key;
+}
+
+static int
+match_compar(const void *_a, const void *_b)
+{
+    const struct match *a = _a;
+    const struct match *b = _b;
+
+    if (a->sort_key & b->sort_key & SORT_KEY_SATURATED)
+        return match_compar_full(a, b);
+
+    if (a->sort_key != b->sort_key)
+        return a->sort_key < b->sort_key ? -1 : 1;
+
+    return 0;
+}
+
+/* Below this, qsort() beats the radix sort's setup cost */
+#define RADIX_SORT_MIN 1024
+
+struct sort_item {
+    uint64_t key;
+    size_t idx;
+};
+
+/*
+ * LSD radix sort on the matches' sort keys. Only the (key, index)
+ * pairs are moved around during the passes; the matches themselves
+ * are permuted once, at the end.
+ */
+static void
+sort_matches(struct match *v, size_t count)
+{
+    bool saturated = false;
+    for (size_t i = 0; i < count && !saturated; i++)
+        saturated = v[i].sort_key & SORT_KEY_SATURATED;
+
+    /*
+     * Saturated keys can't be ordered by their key alone. They are
+     * rare enough (e.g. matches far into very long dmenu lines) that
+     * we simply fall back to a comparison sort.
+     */
+    if (count < RADIX_SORT_MIN || saturated) {
+        qsort(v, count, sizeof(v[0]), &match_compar);
+        return;
+    }
+
+    struct sort_item *items = xmalloc(count * 2 * sizeof(items[0]));
+    struct sort_item *src = items;
+    struct sort_item *dst = items + count;
+
+    /* Bits that differ between at least two keys */
+    uint64_t differs = 0;
+    for (size_t i = 0; i < count; i++) {
+        src[i] = (struct sort_item){.key = v[i].sort_key, .idx = i};
+        differs |= v[i].sort_key ^ v[0].sort_key;
+    }
+
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        if (((differs >> shift) & 0xff) == 0)
+            continue;
+
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < count; i++)
+            offsets[(src[i].key >> shift) & 0xff]++;
+
+        size_t sum = 0;
+        for (size_t i = 0; i < 256; i++) {
+            const size_t n = offsets[i];
+            offsets[i] = sum;
+            sum += n;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+
+        struct sort_item *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    struct match *sorted = xmalloc(count * sizeof(sorted[0]));
+    for (size_t i = 0; i < count; i++)
+        sorted[i] = v[src[i].idx];
+    memcpy(v, sorted, count * sizeof(v[0]));
+
+    free(sorted);
+    free(items);
+}
+
+static void
+swap_matches(struct match *a, struct match *b)
+{
+    struct match tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/*
+ * Reorders 'v' such that its first 'k' elements are the 'k' best
+ * matches (as defined by match_compar()), in unspecified order.
+ *
+ * Quickselect, with a three-way partition. The pivot always ends up
+ * in the middle partition, which guarantees progress even if the
+ * comparison function isn't a strict weak ordering.
+ */
+static void
+select_best_matches(struct match *v, size_t count, size_t k)
+{
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (hi - lo > 16) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        /* Median of three */
+        if (match_compar(&v[mid], &v[lo]) < 0)
+            swap_matches(&v[mid], &v[lo]);
+        if (match_compar(&v[hi - 1], &v[mid]) < 0) {
+            swap_matches(&v[hi - 1], &v[mid]);
+            if (match_compar(&v[mid], &v[lo]) < 0)
+                swap_matches(&v[mid], &v[lo]);
+        }
+
+        const struct match pivot = v[mid];
+
+        /* [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot */
+        size_t lt = lo;
+        size_t gt = hi;
+
+        for (size_t i = lo; i < gt; ) {
+            const int r = match_compar(&v[i], &pivot);
+            if (r < 0)
+                swap_matches(&v[lt++], &v[i++]);
+            else if (r > 0)
+                swap_matches(&v[i], &v[--gt]);
+            else
+                i++;
+        }
+
+        if (k < lt)
+            hi = lt;
+        else if (k >= gt)
+            lo = gt;
+        else
+            return;
+    }
+
+    qsort(&v[lo], hi - lo, sizeof(v[0]), &match_compar);
+}
+
+/*
+ * Ensures the first 'count' matches are sorted. Only the part that
+ * isn't already sorted is touched: its best matches are selected,
+ * and then sorted.
+ */
+static void
+matches_sort_upto(struct matches *matches, size_t count)
+{
+    const size_t total = matches->match_count;
+    const size_t sorted = matches->sorted_count;
+
+    if (count > total)
+        count = total;
+    if (count <= sorted)
+        return;
+
+    /*
+     * Grow the sorted range geometrically, to keep the total cost of
+     * paging through all matches at O(n log n)
+     */
+    const size_t doubled = sorted * 2;
+    count = max(count, min(doubled, total));
+
+    struct match *tail = &matches->matches[sorted];
+    const size_t tail_count = total - sorted;
+    size_t k = count - sorted;
+
+    if (k < tail_count / 2)
+        select_best_matches(tail, tail_count, k);
+    else
+        k = tail_count;
+
+    sort_matches(tail, k);
+    matches->sorted_count = sorted + k;
+
+    LOG_DBG("sorted %zu/%zu matches", matches->sorted_count, total);
+}
+
+/*
+ * Merges matches [old_count..match_count), for newly loaded entries,
+ * into the sorted prefix. Only the new matches that compare better
+ * than the last sorted one need to be sorted; the others join the
+ * unsorted remainder.
+ */
+static void
+matches_merge_appended(struct matches *matches, size_t old_count)
+{
+    struct match *v = matches->matches;
+    const size_t total = matches->match_count;
+    const size_t sorted = matches->sorted_count;
+
+    if (sorted == 0 || total == old_count)
+        return;
+
+    /* Partition the new matches: better than the last sorted match first */
+    const struct match *last = &v[sorted - 1];
+    size_t better = old_count;
+
+    for (size_t i = old_count; i < total; i++) {
+        if (match_compar(&v[i], last) < 0)
+            swap_matches(&v[better++], &v[i]);
+    }
+
+    const size_t count = better - old_count;
+    if (count == 0)
+        return;
+
+    struct match *tmp = xmalloc(count * sizeof(tmp[0]));
+    memcpy(tmp, &v[old_count], count * sizeof(tmp[0]));
+    sort_matches(tmp, count);
+
+    /* Make room for them after the sorted prefix */
+    memmove(&v[sorted + count], &v[sorted],
+            (old_count - sorted) * sizeof(v[0]));
+
+    /* Merge, from the back */
+    ssize_t i = sorted - 1;
+    ssize_t j = count - 1;
+    size_t out = sorted + count;
+
+    while (j >= 0) {
+        if (i >= 0 && match_compar(&v[i], &tmp[j]) > 0)
+            v[--out] = v[i--];
+        else
+            v[--out] = tmp[j--];
+    }
+
+    free(tmp);
+    matches->sorted_count = sorted + count;
+
+    LOG_DBG("merged %zu new matches into %zu sorted ones", count, sorted);
+}
+
+/* Sorts everything up to, and including, the selected match's page */
+static void
+matches_sort_selected_page(struct matches *matches)
 {
-    if (matches->selected + 1 < matches->match_count) {
-        matches->selected++;
-        return true;
-    } else if (wrap && matches->match_count > 1) {
-        matches->selected = 0;
-        return true;
-    }
+    const size_t per_page = matches->max_matches_per_page;
+    const size_t selected = matches->selected;
 
-    return false;
+    matches_sort_upto(
+        matches,
+        per_page > 0 ? (selected / per_page + 1) * per_page : selected + 1);
 }
 
-bool
-matches_selected_prev_page(struct matches *matches, bool scrolling)
+/*
+ * Matches are written directly to matches->matches when running
+ * single threaded ('worker' is NULL). Worker threads append to their
+ * own buffers, which are merged once all workers are done.
+ */
+static void
+add_match(struct matches *matches, struct match_worker *worker,
+          const struct match *m)
 {
-    const size_t page_no = matches_get_page(matches);
-    if (page_no > 0) {
-        assert(matches->selected >= matches->max_matches_per_page);
-        matches->selected -= matches->max_matches_per_page;
-        return true;
-    } else if (!scrolling && matches->selected > 0) {
-        matches->selected = 0;
-        return true;
+    if (worker == NULL) {
+        const size_t idx = matches->match_count++;
+
+        free(matches->matches[idx].pos);
+        matches->matches[idx] = *m;
+        return;
     }
 
-    return false;
+    if (worker->result_count >= worker->result_size) {
+        worker->result_size = worker->result_size > 0
+            ? worker->result_size * 2 : 1024;
+        worker->results = xreallocarray(
+            worker->results, worker->result_size, sizeof(worker->results[0]));
+    }
+
+    worker->results[worker->result_count++] = *m;
 }
 
-bool
-matches_selected_next_page(struct matches *matches, bool scrolling)
+static void
+add_fuzzy_narrow(struct matches *matches, struct match_worker *worker,
+                 size_t idx)
 {
-    const size_t page_no = matches_get_page(matches);
-    if (page_no + 1 < matches->page_count) {
-        matches->selected = min(
-            matches->selected + matches->max_matches_per_page,
-            matches->match_count - 1);
-        return true;
-    } else if (!scrolling && matches->selected < matches->match_count - 1) {
-        matches->selected = matches->match_count - 1;
-        return true;
+    if (worker == NULL) {
+        matches->fuzzy_narrow.ids[matches->fuzzy_narrow.count++] = idx;
+        return;
     }
 
-    return false;
+    if (worker->fuzzy_narrow_count >= worker->fuzzy_narrow_size) {
+        worker->fuzzy_narrow_size = worker->fuzzy_narrow_size > 0
+            ? worker->fuzzy_narrow_size * 2 : 1024;
+        worker->fuzzy_narrow = xreallocarray(
+            worker->fuzzy_narrow, worker->fuzzy_narrow_size,
+            sizeof(worker->fuzzy_narrow[0]));
+    }
+
+    worker->fuzzy_narrow[worker->fuzzy_narrow_count++] = idx;
 }
 
-static int
-match_compar(const void *_a, const void *_b)
+enum utf8_match {
+    UTF8_NO_MATCH,
+    UTF8_MATCH,
+    UTF8_UNDECIDED,  /* Must be matched on the decoded title */
+};
+
+/*
+ * Matches the tokens against a UTF-8 title, without decoding it. This
+ * fully decides exact and fzf matches of ASCII tokens (and exact
+ * matches in fuzzy mode), with '*pos' converted to code point
+ * offsets. Other tokens are only used to reject the title: non-ASCII
+ * fzf tokens by their bytes not all being in it, in order, and fuzzy
+ * mode tokens too short for fuzzy matching by not being in it.
+ */
+static enum utf8_match
+match_title_utf8(struct matches *matches, struct match_worker *worker,
+                 size_t idx, size_t tok_count,
+                 struct match_substring **pos, size_t *pos_count,
+                 bool *word_boundary)
 {
-    const struct match *a = _a;
-    const struct match *b = _b;
+    size_t len;
+    const char *text = corpus_title_utf8(matches->corpus, idx, &len);
 
-    if (a->matched_type != b->matched_type) {
-        if (a->matched_type == MATCHED_EXACT)
-            return -1;
-        else
-            return 1;
-    }
+    if (text == NULL || tok_count == 0)
+        return UTF8_UNDECIDED;
 
-    if (a->application->count > b->application->count)
-        return -1;
-    /* Prioritize matches at word boundaries */
-    else if (a->word_boundary != b->word_boundary) {
-        return a->word_boundary ? -1 : 1;
+    bool undecided = false;
+
+    for (size_t t = 0; t < tok_count; t++) {
+        const struct utf8_token *tok = &matches->utf8_tokens[t];
+
+        if (matches->mode == MATCH_MODE_FZF) {
+            if (!tok->ascii) {
+                if (!utf8_is_subsequence(text, len, tok->text, tok->len))
+                    goto no_match;
+                undecided = true;
+                continue;
+            }
+
+            enum matched_type match_type = MATCHED_NONE;
+            match_fzf_utf8(
+                text, len, tok->text, tok->len, pos, pos_count, &match_type);
+
+            if (match_type == MATCHED_NONE)
+                goto no_match;
+            continue;
+        }
+
+        const char *m = memmem(text, len, tok->text, tok->len);
+
+        if (m == NULL) {
+            if (matches->mode == MATCH_MODE_FUZZY &&
+                tok->len >= matches->fuzzy_min_length)
+            {
+                /* May still match fuzzily; that needs the decoded title */
+                undecided = true;
+                continue;
+            }
+
+            if (matches->mode == MATCH_MODE_FUZZY && t == tok_count - 1) {
+                /* Short last token; it may match once it has grown */
+                add_fuzzy_narrow(matches, worker, idx);
+            }
+
+            goto no_match;
+        }
+
+        if (!tok->ascii) {
+            undecided = true;
+            continue;
+        }
+
+        const size_t ofs = m - text;
+
+        if (*pos_count > 0 &&
+            ofs == (*pos)[*pos_count - 1].start + (*pos)[*pos_count - 1].len)
+        {
+            /* Extend last match position */
+            (*pos)[*pos_count - 1].len += tok->len;
+        } else {
+            (*pos_count)++;
+            *pos = xreallocarray(*pos, *pos_count, sizeof((*pos)[0]));
+            (*pos)[*pos_count - 1].start = ofs;
+            (*pos)[*pos_count - 1].len = tok->len;
+        }
     }
-    else if (a->score > b->score)
-        return -1;
-    else if (a->score < b->score)
-        return 1;
-    /* Prioritize matches at word boundaries (when scores are equal) */
-    else if (a->word_boundary != b->word_boundary) {
-        return a->word_boundary ? -1 : 1;
+
+    if (undecided) {
+        free(*pos);
+        *pos = NULL;
+        *pos_count = 0;
+        return UTF8_UNDECIDED;
     }
-    else if (a->pos_count < b->pos_count)
-        return -1;
-    else if (a->pos_count > b->pos_count)
-        return 1;
-    else if (a->application->count < b->application->count)
-        return 1;
-    else if (a->pos_count > 0 && b->pos_count > 0 && a->pos[0].start < b->pos[0].start)
-        return -1;
-    else if (a->pos_count > 0 && b->pos_count > 0 && a->pos[0].start > b->pos[0].start)
-        return 1;
-    else if (a->pos_count > 0 && b->pos_count > 0 &&
-             a->application->title != NULL && b->application->title != NULL)
-    {
-        return a->application->title_len > b->application->title_len;
-    } else
-        return 0;
+
+    /* Byte offsets to code point offsets (lengths are ASCII, i.e. equal) */
+    if (*pos_count > 0)
+        *word_boundary = is_word_boundary_utf8(text, (*pos)[0].start);
+
+    for (size_t i = 0; i < *pos_count; i++)
+        (*pos)[i].start = utf8_code_points(text, (*pos)[i].start);
+
+    return UTF8_MATCH;
+
+no_match:
+    free(*pos);
+    *pos = NULL;
+    *pos_count = 0;
+    return UTF8_NO_MATCH;
 }
 
 static void
-match_app(struct matches *matches, struct application *app,
+match_app(struct matches *matches, struct match_worker *worker,
+          size_t idx,
           size_t tok_count, const char32_t *const tokens[static tok_count],
           const size_t tok_lengths[static tok_count],
           bool match_name,
@@ -868,39 +2062,107 @@ match_app(struct matches *matches, struct application *app,
           bool match_categories,
           bool match_nth)
 {
+    const struct corpus *corpus = matches->corpus;
+
+    size_t title_len, translated_name_len, basename_len, generic_name_len;
+    size_t wexec_len, comment_len, match_nth_len;
+
+    const char32_t *translated_name = corpus_text(
+        corpus, CORPUS_TRANSLATED_NAME, idx, &translated_name_len);
+    const char32_t *basename = corpus_text(
+        corpus, CORPUS_BASENAME, idx, &basename_len);
+    const char32_t *generic_name = corpus_text(
+        corpus, CORPUS_GENERIC_NAME, idx, &generic_name_len);
+    const char32_t *wexec = corpus_text(
+        corpus, CORPUS_EXEC, idx, &wexec_len);
+    const char32_t *comment = corpus_text(
+        corpus, CORPUS_COMMENT, idx, &comment_len);
+    const char32_t *match_nth_text = corpus_text(
+        corpus, CORPUS_MATCH_NTH, idx, &match_nth_len);
+
+    const size_t keyword_count = corpus_list_count(corpus->keywords, idx);
+    const size_t category_count = corpus_list_count(corpus->categories, idx);
+
     size_t pos_count = 0;
     struct match_substring *pos = NULL;
+    bool may_match_longer = false;
+    bool word_boundary = false;
 
     enum matched_type match_type_name = MATCHED_NONE;
+
+    const char32_t *title = NULL;
+    title_len = 0;
+
+    /* Title matched as UTF-8; 'pos' and 'word_boundary' are set */
+    bool title_matched = false;
+
+    if (matches->utf8_tokens != NULL &&
+        translated_name == NULL && basename == NULL && generic_name == NULL &&
+        wexec == NULL && comment == NULL && match_nth_text == NULL &&
+        keyword_count == 0 && category_count == 0)
+    {
+        /*
+         * The title is all there is to match (dmenu). Match it as
+         * UTF-8, and only decode the titles that can't be decided
+         * that way.
+         */
+        switch (match_title_utf8(matches, worker, idx, tok_count,
+                                 &pos, &pos_count, &word_boundary))
+        {
+        case UTF8_NO_MATCH:
+            return;
+
+        case UTF8_MATCH:
+            match_type_name = MATCHED_EXACT;
+            title_matched = true;
+            break;
+
+        case UTF8_UNDECIDED:
+            break;
+        }
+    }
+
+    if (match_name && !title_matched) {
+        title = worker != NULL
+            ? corpus_title(corpus, idx, &worker->title_buf,
+                           &worker->title_buf_size, &title_len)
+            : corpus_title(corpus, idx, &matches->title_buf,
+                           &matches->title_buf_size, &title_len);
+    }
+
     enum matched_type match_type_filename = MATCHED_NONE;
     enum matched_type match_type_generic = MATCHED_NONE;
     enum matched_type match_type_exec = MATCHED_NONE;
     enum matched_type match_type_comment = MATCHED_NONE;
     enum matched_type match_type_nth = MATCHED_NONE;
-    enum matched_type match_type_keywords[tll_length(app->keywords)];
-    enum matched_type match_type_categories[tll_length(app->categories)];
+    enum matched_type match_type_keywords[keyword_count];
+    enum matched_type match_type_categories[category_count];
 
     if (match_keywords) {
-        for (size_t k = 0; k < tll_length(app->keywords); k++)
+        for (size_t k = 0; k < keyword_count; k++)
             match_type_keywords[k] = MATCHED_NONE;
     }
     if (match_categories) {
-        for (size_t k = 0; k < tll_length(app->categories); k++)
+        for (size_t k = 0; k < category_count; k++)
             match_type_categories[k] = MATCHED_NONE;
     }
 
     for (size_t t = 0; t < tok_count; t++) {
         const char32_t *const tok = tokens[t];
         const size_t tok_len = tok_lengths[t];
+        const struct levenshtein_pattern *const fuzzy_pat =
+            matches->fuzzy_patterns != NULL ? &matches->fuzzy_patterns[t] : NULL;
 
-        if (match_name && (t == 0 || match_type_name != MATCHED_NONE)) {
+        if (match_name && !title_matched &&
+            (t == 0 || match_type_name != MATCHED_NONE))
+        {
             const char32_t *m = NULL;
             size_t match_len = 0;
             enum matched_type match_type = MATCHED_NONE;
 
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
-                m = match_exact(app->title_lowercase, app->title_len, tok, tok_len);
+                m = match_exact(title, title_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
@@ -908,19 +2170,19 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->title_lowercase, app->title_len,
+                match_fzf(title, title_len,
                           tok, tok_len, &pos, &pos_count, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
-                m = match_exact(app->title_lowercase, app->title_len, tok, tok_len);
+                m = match_exact(title, title_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->title_lowercase, app->title_len,
-                        tok, tok_len, &match_len);
+                        matches, title, title_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -930,7 +2192,7 @@ match_app(struct matches *matches, struct application *app,
             if (match_len > 0) {
                 assert(matches->mode != MATCH_MODE_FZF);
 
-                if (pos_count > 0 && m == &app->title_lowercase[pos[pos_count - 1].start +
+                if (pos_count > 0 && m == &title[pos[pos_count - 1].start +
                                                                 pos[pos_count - 1].len]) {
                     /* Extend last match position */
                     pos[pos_count - 1].len += match_len;
@@ -938,7 +2200,7 @@ match_app(struct matches *matches, struct application *app,
                     pos_count += 1;
                     pos = xreallocarray(pos, pos_count, sizeof(pos[0]));
 
-                    pos[pos_count - 1].start = m - app->title_lowercase;
+                    pos[pos_count - 1].start = m - title;
                     pos[pos_count - 1].len = match_len;
                 }
             }
@@ -951,7 +2213,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_name = match_type;
         }
 
-        if (match_nth && app->dmenu_match_nth != NULL &&
+        if (match_nth && match_nth_text != NULL &&
             (t == 0 || match_type_nth != MATCHED_NONE))
         {
             const char32_t *m = NULL;
@@ -961,7 +2223,7 @@ match_app(struct matches *matches, struct application *app,
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
                 m = match_exact(
-                    app->dmenu_match_nth, app->dmenu_match_nth_len, tok, tok_len);
+                    match_nth_text, match_nth_len, tok, tok_len);
 
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
@@ -970,21 +2232,21 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->dmenu_match_nth, app->dmenu_match_nth_len,
+                match_fzf(match_nth_text, match_nth_len,
                           tok, tok_len, NULL, NULL, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
                 m = match_exact(
-                    app->dmenu_match_nth, app->dmenu_match_nth_len, tok, tok_len);
+                    match_nth_text, match_nth_len, tok, tok_len);
 
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->dmenu_match_nth, app->dmenu_match_nth_len,
-                        tok, tok_len, &match_len);
+                        matches, match_nth_text, match_nth_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -999,7 +2261,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_nth = match_type;
         }
 
-        if (match_filename && app->basename != NULL &&
+        if (match_filename && basename != NULL &&
             (t == 0 || match_type_filename != MATCHED_NONE))
         {
             const char32_t *m = NULL;
@@ -1008,7 +2270,7 @@ match_app(struct matches *matches, struct application *app,
 
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
-                m = match_exact(app->basename, app->basename_len, tok, tok_len);
+                m = match_exact(basename, basename_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
@@ -1016,19 +2278,19 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->basename, app->basename_len, tok, tok_len,
+                match_fzf(basename, basename_len, tok, tok_len,
                           NULL, NULL, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
-                m = match_exact(app->basename, app->basename_len, tok, tok_len);
+                m = match_exact(basename, basename_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->basename, app->basename_len,
-                        tok, tok_len, &match_len);
+                        matches, basename, basename_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -1043,7 +2305,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_filename = match_type;
         }
 
-        if (match_generic && app->generic_name != NULL &&
+        if (match_generic && generic_name != NULL &&
             (t == 0 || match_type_generic != MATCHED_NONE))
         {
             const char32_t *m = NULL;
@@ -1052,7 +2314,7 @@ match_app(struct matches *matches, struct application *app,
 
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
-                m = match_exact(app->generic_name, app->generic_name_len, tok, tok_len);
+                m = match_exact(generic_name, generic_name_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
@@ -1060,19 +2322,19 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->generic_name, app->generic_name_len,
+                match_fzf(generic_name, generic_name_len,
                           tok, tok_len, NULL, NULL, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
-                m = match_exact(app->generic_name, app->generic_name_len, tok, tok_len);
+                m = match_exact(generic_name, generic_name_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->generic_name, app->generic_name_len,
-                        tok, tok_len, &match_len);
+                        matches, generic_name, generic_name_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -1087,7 +2349,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_generic = match_type;
         }
 
-        if (match_exec && app->wexec != NULL &&
+        if (match_exec && wexec != NULL &&
             (t == 0 || match_type_exec != MATCHED_NONE))
         {
             const char32_t *m = NULL;
@@ -1096,7 +2358,7 @@ match_app(struct matches *matches, struct application *app,
 
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
-                m = match_exact(app->wexec, app->wexec_len, tok, tok_len);
+                m = match_exact(wexec, wexec_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
@@ -1104,19 +2366,19 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->wexec, app->wexec_len, tok, tok_len,
+                match_fzf(wexec, wexec_len, tok, tok_len,
                           NULL, NULL, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
-                m = match_exact(app->wexec, app->wexec_len, tok, tok_len);
+                m = match_exact(wexec, wexec_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->wexec, app->wexec_len,
-                        tok, tok_len, &match_len);
+                        matches, wexec, wexec_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -1131,7 +2393,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_exec = match_type;
         }
 
-        if (match_comment && app->comment != NULL &&
+        if (match_comment && comment != NULL &&
             (t == 0 || match_type_comment != MATCHED_NONE))
         {
             const char32_t *m = NULL;
@@ -1140,7 +2402,7 @@ match_app(struct matches *matches, struct application *app,
 
             switch (matches->mode) {
             case MATCH_MODE_EXACT:
-                m = match_exact(app->comment, app->comment_len, tok, tok_len);
+                m = match_exact(comment, comment_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
@@ -1148,19 +2410,19 @@ match_app(struct matches *matches, struct application *app,
                 break;
 
             case MATCH_MODE_FZF:
-                match_fzf(app->comment, app->comment_len, tok, tok_len,
+                match_fzf(comment, comment_len, tok, tok_len,
                           NULL, NULL, &match_type);
                 break;
 
             case MATCH_MODE_FUZZY:
-                m = match_exact(app->comment, app->comment_len, tok, tok_len);
+                m = match_exact(comment, comment_len, tok, tok_len);
                 if (m != NULL) {
                     match_type = MATCHED_EXACT;
                     match_len = tok_len;
                 } else {
                     m = match_levenshtein(
-                        matches, app->comment, app->comment_len,
-                        tok, tok_len, &match_len);
+                        matches, comment, comment_len,
+                        fuzzy_pat, &match_len, &may_match_longer);
                     if (m != NULL)
                         match_type = MATCHED_FUZZY;
                 }
@@ -1175,7 +2437,7 @@ match_app(struct matches *matches, struct application *app,
                 match_type_comment = match_type;
         }
 
-        if (match_name && app->translated_name &&
+        if (match_name && translated_name &&
             (t == 0 || match_type_name != MATCHED_NONE)) {
                 const char32_t *m = NULL;
                 size_t match_len = 0;
@@ -1183,7 +2445,7 @@ match_app(struct matches *matches, struct application *app,
 
                 switch (matches->mode) {
                     case MATCH_MODE_EXACT:
-                        m = match_exact(app->translated_name, app->translated_name_len, tok,
+                        m = match_exact(translated_name, translated_name_len, tok,
                                         tok_len);
                         if (m != NULL) {
                             match_type = MATCHED_EXACT;
@@ -1192,20 +2454,20 @@ match_app(struct matches *matches, struct application *app,
                         break;
 
                     case MATCH_MODE_FZF:
-                        match_fzf(app->translated_name, app->translated_name_len, tok,
+                        match_fzf(translated_name, translated_name_len, tok,
                                   tok_len, &pos, &pos_count, &match_type);
                         break;
 
                     case MATCH_MODE_FUZZY:
-                        m = match_exact(app->translated_name, app->translated_name_len, tok,
+                        m = match_exact(translated_name, translated_name_len, tok,
                                         tok_len);
                         if (m != NULL) {
                             match_type = MATCHED_EXACT;
                             match_len = tok_len;
                         } else {
-                            m = match_levenshtein(matches, app->translated_name,
-                                                  app->translated_name_len, tok, tok_len,
-                                                  &match_len);
+                            m = match_levenshtein(matches, translated_name,
+                                                  translated_name_len, fuzzy_pat,
+                                                  &match_len, &may_match_longer);
                             if (m != NULL)
                                 match_type = MATCHED_FUZZY;
                         }
@@ -1221,18 +2483,21 @@ match_app(struct matches *matches, struct application *app,
             }
 
         if (match_keywords) {
-            size_t k = 0;
-            tll_foreach(app->keywords, it) {
+            for (size_t k = 0; k < keyword_count; k++) {
                 if (!(t == 0 || match_type_keywords[k] != MATCHED_NONE))
                     continue;
 
+                size_t item_len;
+                const char32_t *item = corpus_list_item(
+                    corpus, corpus->keywords, idx, k, &item_len);
+
                 const char32_t *m = NULL;
                 size_t match_len = 0;
                 enum matched_type match_type = MATCHED_NONE;
 
                 switch (matches->mode) {
                 case MATCH_MODE_EXACT:
-                    m = match_exact(it->item, c32len(it->item), tok, tok_len);
+                    m = match_exact(item, item_len, tok, tok_len);
                     if (m != NULL) {
                         match_type = MATCHED_EXACT;
                         match_len = tok_len;
@@ -1240,19 +2505,19 @@ match_app(struct matches *matches, struct application *app,
                     break;
 
                 case MATCH_MODE_FZF:
-                    match_fzf(it->item, c32len(it->item), tok, tok_len,
+                    match_fzf(item, item_len, tok, tok_len,
                               NULL, NULL, &match_type);
                     break;
 
                 case MATCH_MODE_FUZZY:
-                    m = match_exact(it->item, c32len(it->item), tok, tok_len);
+                    m = match_exact(item, item_len, tok, tok_len);
                     if (m != NULL) {
                         match_type = MATCHED_EXACT;
                         match_len = tok_len;
                     } else {
                         m = match_levenshtein(
-                            matches, it->item, c32len(it->item),
-                            tok, tok_len, &match_len);
+                            matches, item, item_len,
+                            fuzzy_pat, &match_len, &may_match_longer);
                         if (m != NULL)
                             match_type = MATCHED_FUZZY;
                     }
@@ -1265,24 +2530,25 @@ match_app(struct matches *matches, struct application *app,
                     match_type_keywords[k] = MATCHED_NONE;
                 else if (match_type_keywords[k] == MATCHED_EXACT)
                     match_type_keywords[k] = match_type;
-
-                k++;
             }
         }
 
         if (match_categories) {
-            size_t k = 0;
-            tll_foreach(app->categories, it) {
+            for (size_t k = 0; k < category_count; k++) {
                 if (!(t == 0 || match_type_categories[k] != MATCHED_NONE))
                     continue;
 
+                size_t item_len;
+                const char32_t *item = corpus_list_item(
+                    corpus, corpus->categories, idx, k, &item_len);
+
                 const char32_t *m = NULL;
                 size_t match_len = 0;
                 enum matched_type match_type = MATCHED_NONE;
 
                 switch (matches->mode) {
                 case MATCH_MODE_EXACT:
-                    m = match_exact(it->item, c32len(it->item), tok, tok_len);
+                    m = match_exact(item, item_len, tok, tok_len);
                     if (m != NULL) {
                         match_type = MATCHED_EXACT;
                         match_len = tok_len;
@@ -1290,19 +2556,19 @@ match_app(struct matches *matches, struct application *app,
                     break;
 
                 case MATCH_MODE_FZF:
-                    match_fzf(it->item, c32len(it->item), tok, tok_len,
+                    match_fzf(item, item_len, tok, tok_len,
                               NULL, NULL, &match_type);
                     break;
 
                 case MATCH_MODE_FUZZY:
-                    m = match_exact(it->item, c32len(it->item), tok, tok_len);
+                    m = match_exact(item, item_len, tok, tok_len);
                     if (m != NULL) {
                         match_type = MATCHED_EXACT;
                         match_len = tok_len;
                     } else {
                         m = match_levenshtein(
-                            matches, it->item, c32len(it->item),
-                            tok, tok_len, &match_len);
+                            matches, item, item_len,
+                            fuzzy_pat, &match_len, &may_match_longer);
                         if (m != NULL)
                             match_type = MATCHED_FUZZY;
                     }
@@ -1315,8 +2581,6 @@ match_app(struct matches *matches, struct application *app,
                     match_type_categories[k] = MATCHED_NONE;
                 else if (match_type_categories[k] == MATCHED_EXACT)
                     match_type_categories[k] = match_type;
-
-                k++;
             }
         }
     }
@@ -1324,7 +2588,7 @@ match_app(struct matches *matches, struct application *app,
     enum matched_type match_type_keywords_final = MATCHED_NONE;
 
     if (match_keywords) {
-        for (size_t k = 0; k < tll_length(app->keywords); k++) {
+        for (size_t k = 0; k < keyword_count; k++) {
             if (match_type_keywords[k] != MATCHED_NONE) {
                 /* match_type_keywords_final represents the combined
                    result of all keywords; if a single keyword matched
@@ -1339,7 +2603,7 @@ match_app(struct matches *matches, struct application *app,
     enum matched_type match_type_categories_final = MATCHED_NONE;
 
     if (match_categories) {
-        for (size_t k = 0; k < tll_length(app->categories); k++) {
+        for (size_t k = 0; k < category_count; k++) {
             if (match_type_categories[k] != MATCHED_NONE) {
                 /* match_type_categories_final represents the combined
                    result of all keywords; if a single keyword matched
@@ -1388,41 +2652,69 @@ match_app(struct matches *matches, struct application *app,
     else if (match_type_nth != MATCHED_NONE)
         app_match_type = match_type_nth;
 
+    if (matches->mode == MATCH_MODE_FUZZY &&
+        (app_match_type != MATCHED_NONE || may_match_longer))
+    {
+        add_fuzzy_narrow(matches, worker, idx);
+    }
+
     if (app_match_type == MATCHED_NONE) {
         free(pos);
         return;
     }
 
     /* Check if match starts at word boundary */
-    bool word_boundary = false;
-    if (match_name && pos_count > 0) {
+    if (match_name && !title_matched && pos_count > 0) {
         /* Check if first match position is at a word boundary in the title */
-        word_boundary = is_word_boundary(app->title_lowercase, pos[0].start);
+        word_boundary = is_word_boundary(title, pos[0].start);
     }
 
     struct match m = {
         .matched_type = app_match_type,
-        .application = app,
+        .application = applications_get(matches->applications, idx),
+        .entry = idx,
         .pos = pos,
         .pos_count = pos_count,
         .score = score,
         .word_boundary = word_boundary,
     };
+    m.sort_key = match_sort_key(&m);
+
+    add_match(matches, worker, &m);
+}
+
+/* Steals a slice from one of the other workers */
+static bool
+steal_slice(struct match_worker *worker, uint64_t *slice)
+{
+    struct matches *matches = worker->matches;
+    const size_t count = matches->workers.count;
+
+    for (size_t i = 1; i < count; i++) {
+        struct match_worker *victim =
+            matches->workers.state[(worker->my_id - 1 + i) % count];
 
-    const size_t idx = matches->match_count++;
+        enum ws_steal_result res;
+        do {
+            res = ws_deque_steal(&victim->deque, slice);
+        } while (res == WS_STEAL_RETRY);
+
+        if (res == WS_STEAL_SUCCESS) {
+            worker->stolen++;
+            return true;
+        }
+    }
 
-    free(matches->matches[idx].pos);
-    matches->matches[idx] = m;
+    return false;
 }
 
 /* THREAD */
 static int
 match_thread(void *_ctx)
 {
-    struct thread_context *ctx = _ctx;
-    struct matches *matches = ctx->matches;
-    const int my_id = ctx->my_id;
-    free(ctx);
+    struct match_worker *worker = _ctx;
+    struct matches *matches = worker->matches;
+    const int my_id = worker->my_id;
 
     sigset_t mask;
     sigfillset(&mask);
@@ -1448,74 +2740,107 @@ match_thread(void *_ctx)
     const bool match_categories = fields & MATCH_CATEGORIES;
     const bool match_nth = fields & MATCH_NTH;
 
-    sem_t *start = &matches->workers.start;
+    sem_t *start = &worker->start;
     sem_t *done = &matches->workers.done;
-    mtx_t *lock = &matches->workers.lock;
 
     while (true) {
         sem_wait(start);
 
+        if (matches->workers.exit)
+            return 0;
+
         bool incremental = matches->workers.incremental;
         const size_t tok_count = matches->workers.tok_count;
         const char32_t *const *tokens = matches->workers.tokens;
         const size_t *tok_lengths = matches->workers.tok_lengths;
+        const uint32_t *candidates = matches->workers.candidates;
+        const uint32_t *fuzzy_candidates = matches->workers.fuzzy_candidates;
         struct match *prev_matches = matches->workers.old_matches;
+        const uint32_t grain = matches->workers.grain;
+
+        worker->time_start = time_begin();
+        worker->result_count = 0;
+        worker->fuzzy_narrow_count = 0;
+        worker->searched = 0;
+        worker->slices = 0;
+        worker->stolen = 0;
+
+        uint64_t slice;
+        while (ws_deque_pop(&worker->deque, &slice) ||
+               steal_slice(worker, &slice))
+        {
+            uint32_t slice_start = slice;
+            uint32_t slice_end = slice >> 32;
+
+            /*
+             * Split off the upper half, for idle workers to steal,
+             * until what remains is small enough to search.
+             */
+            while (slice_end - slice_start > grain) {
+                const uint32_t mid = slice_start + (slice_end - slice_start) / 2;
+                if (!ws_deque_push(&worker->deque,
+                                   (uint64_t)slice_end << 32 | mid))
+                {
+                    break;
+                }
+                slice_end = mid;
+            }
 
-        bool match_done = false;
-
-        while (!match_done) {
-            mtx_lock(lock);
-            assert(tll_length(matches->workers.queue) > 0);
-
-            const uint64_t slice_start_and_end =
-                tll_pop_front(matches->workers.queue);
-
-            const uint32_t slice_start = slice_start_and_end;
-            const uint32_t slice_end = slice_start_and_end >> 32;
-
-            mtx_unlock(lock);
-
-            if (slice_start == (uint32_t)-1) {
-                match_done = true;
-                sem_post(done);
-            } else if (slice_start == (uint32_t)-2) {
-                /* Exit */
-                return 0;
-            } else {
-                struct application **apps = matches->applications->v;
-                struct application **a = &apps[slice_start];
-                struct match *m = &prev_matches[slice_start];
+            worker->slices++;
+            worker->searched += slice_end - slice_start;
 
-                for (size_t i = slice_start; i < slice_end; i++) {
-                    struct application *app;
+            const bool *visible = matches->corpus->visible;
 
-                    if (incremental) {
-                        app = m->application;
-                        m++;
-                        assert(app->visible);
-                    } else {
-                        app = *a;
-                        a++;
+            for (size_t i = slice_start; i < slice_end; i++) {
+                size_t idx;
 
-                        if (!app->visible)
-                            continue;
-                    }
+                if (incremental) {
+                    idx = prev_matches[i].entry;
+                    assert(visible[idx]);
+                } else if (candidates != NULL) {
+                    idx = candidates[i];
+                    assert(visible[idx]);
+                } else if (fuzzy_candidates != NULL) {
+                    idx = fuzzy_candidates[i];
+                    assert(visible[idx]);
+                } else {
+                    idx = i;
 
-                    match_app(matches, app, tok_count, tokens, tok_lengths,
-                              match_name, match_filename, match_generic, match_exec,
-                              match_comment, match_keywords, match_categories,
-                              match_nth);
+                    if (!visible[idx])
+                        continue;
                 }
+
+                match_app(matches, worker, idx, tok_count, tokens, tok_lengths,
+                          match_name, match_filename, match_generic, match_exec,
+                          match_comment, match_keywords, match_categories,
+                          match_nth);
             }
         }
+
+        worker->time_stop = time_end();
+        sem_post(done);
     }
 
     return -1;
 }
 
+/* Records that all entries have been matched against 'ptext' */
+static void
+matches_set_matched(struct matches *matches, const char32_t *ptext)
+{
+    if (matches->matched.prompt == NULL ||
+        c32cmp(matches->matched.prompt, ptext) != 0)
+    {
+        free(matches->matched.prompt);
+        matches->matched.prompt = xc32dup(ptext);
+    }
+
+    matches->matched.count = matches->matches_size;
+}
 
 static void
-matches_update_internal(struct matches *matches, bool incremental)
+matches_update_internal(struct matches *matches, bool incremental,
+                        bool appended)
 {
     if (matches->applications == NULL)
         return;
@@ -1524,37 +2849,60 @@ matches_update_internal(struct matches *matches, bool incremental)
 
     const char32_t *ptext = prompt_text(matches->prompt);
 
+    /*
+     * Only new entries need to be matched, if the others have already
+     * been matched against the current prompt.
+     */
+    size_t first = 0;
+    if (appended &&
+        matches->matched.prompt != NULL &&
+        matches->matched.count <= matches->matches_size &&
+        c32cmp(matches->matched.prompt, ptext) == 0)
+    {
+        first = matches->matched.count;
+        incremental = false;
+    }
+
+    const size_t old_match_count = first > 0 ? matches->match_count : 0;
+
     /* Nothing entered; all programs found matches */
     if (ptext[0] == '\0') {
-        matches->match_count = 0;
-        for (size_t i = 0; i < matches->matches_size; i++) {
-            if (!matches->applications->v[i]->visible)
+        matches->fuzzy_narrow.valid = false;
+        matches->match_count = old_match_count;
+        for (size_t i = first; i < matches->matches_size; i++) {
+            if (!matches->corpus->visible[i])
                 continue;
 
             free(matches->matches[matches->match_count].pos);
 
-            matches->matches[matches->match_count++] = (struct match){
+            struct match *m = &matches->matches[matches->match_count++];
+            *m = (struct match){
                 .matched_type = MATCHED_NONE,
-                .application = matches->applications->v[i],
+                .application = applications_get(matches->applications, i),
+                .entry = i,
                 .pos = NULL,
                 .pos_count = 0,
                 .word_boundary = false,
             };
+            m->sort_key = match_sort_key(m);
         }
 
-        /* Sort */
-        if (matches->sort_result && matches->all_apps_loaded) {
-            qsort(matches->matches, matches->match_count,
-                  sizeof(matches->matches[0]), &match_compar);
-        }
+        /* Sort (lazily; only what's visible) */
+        matches->sorted_count =
+            matches->sort_result && matches->all_apps_loaded
+                ? 0 : matches->match_count;
 
         if (matches->selected >= matches->match_count && matches->selected > 0)
             matches->selected = matches->match_count - 1;
 
+        matches_sort_selected_page(matches);
+
         matches->page_count = matches->max_matches_per_page > 0
             ? ((matches->match_count + (matches->max_matches_per_page - 1)) /
                matches->max_matches_per_page)
             : 1;
+
+        matches_set_matched(matches, ptext);
         goto unlock_and_return;
     }
 
@@ -1583,6 +2931,8 @@ matches_update_internal(struct matches *matches, bool incremental)
     LOG_DBG("match update begin");
 
     char32_t *copy = xc32dup(ptext);
+    toc32lower_n(copy, copy, c32len(copy));
+
     char32_t **tokens = xmalloc(sizeof(tokens[0]));
     size_t *tok_lengths = xmalloc(sizeof(tok_lengths[0]));
     size_t tok_count = 1;
@@ -1591,7 +2941,6 @@ matches_update_internal(struct matches *matches, bool incremental)
 
     for (char32_t *p = copy; *p != U'\0'; p++) {
         if (*p != U' ') {
-            *p = toc32lower(*p);
             tok_lengths[tok_count - 1]++;
             continue;
         }
@@ -1623,21 +2972,131 @@ matches_update_internal(struct matches *matches, bool incremental)
         assert(c32len(tokens[i]) == tok_lengths[i]);
 #endif
 
-    const size_t search_count =
-        incremental ? matches->match_count : matches->matches_size;
+    struct timespec *start = time_begin();
+
+    if (match_name && matches->corpus->utf8_titles) {
+        size_t text_size = 0;
+        for (size_t i = 0; i < tok_count; i++)
+            text_size += tok_lengths[i] * 4;
+
+        matches->utf8_tokens = xmalloc(
+            max(tok_count, 1) * sizeof(matches->utf8_tokens[0]));
+        matches->utf8_token_text = xmalloc(max(text_size, 1));
+
+        char *text = matches->utf8_token_text;
+        for (size_t i = 0; i < tok_count; i++) {
+            const size_t len = c32ntoutf8(text, tokens[i], tok_lengths[i]);
+            matches->utf8_tokens[i] = (struct utf8_token){
+                .text = text,
+                .len = len,
+                .ascii = len == tok_lengths[i],
+            };
+            text += len;
+        }
+    }
+
+    uint32_t *fuzzy_candidates = NULL;
+    size_t fuzzy_candidate_count = 0;
+
+    if (matches->mode == MATCH_MODE_FUZZY) {
+        matches->fuzzy_patterns = xmalloc(
+            max(tok_count, 1) * sizeof(matches->fuzzy_patterns[0]));
+
+        for (size_t i = 0; i < tok_count; i++) {
+            levenshtein_pattern_init(
+                &matches->fuzzy_patterns[i], tokens[i], tok_lengths[i]);
+            matches->fuzzy_patterns[i].last = i == tok_count - 1;
+        }
+
+        /*
+         * Narrowing is only valid if the prompt has grown at the end;
+         * characters inserted elsewhere may change any token.
+         */
+        const char32_t *prev_prompt = matches->fuzzy_narrow.prompt;
+
+        if (first > 0) {
+            /* Make room for extending the narrowed set with the new entries */
+            matches->fuzzy_narrow.ids = xreallocarray(
+                matches->fuzzy_narrow.ids,
+                max(matches->fuzzy_narrow.count + matches->matches_size - first, 1),
+                sizeof(matches->fuzzy_narrow.ids[0]));
+        } else {
+            if (incremental &&
+                matches->fuzzy_narrow.valid &&
+                matches->fuzzy_narrow.apps_size == matches->matches_size &&
+                c32len(prev_prompt) <= c32len(ptext) &&
+                memcmp(prev_prompt, ptext,
+                       c32len(prev_prompt) * sizeof(ptext[0])) == 0)
+            {
+                fuzzy_candidates = matches->fuzzy_narrow.ids;
+                fuzzy_candidate_count = matches->fuzzy_narrow.count;
+            } else
+                free(matches->fuzzy_narrow.ids);
+
+            matches->fuzzy_narrow.ids = xmalloc(
+                max(fuzzy_candidates != NULL
+                    ? fuzzy_candidate_count
+                    : matches->matches_size, 1) *
+                sizeof(matches->fuzzy_narrow.ids[0]));
+            matches->fuzzy_narrow.count = 0;
+            matches->fuzzy_narrow.valid = true;
+        }
+
+        /* The previous matches are not a superset of the new ones */
+        incremental = false;
+    }
+
+    /*
+     * Use the n-gram index (if it has been built) to find the subset
+     * of entries that *may* match. These are then verified by
+     * match_app(), just like in a full update.
+     */
+    uint32_t *candidates = NULL;
+    size_t candidate_count = 0;
+
+    if (matches->index.ready && first == 0) {
+        candidates = ngram_index_query(
+            matches->index.ngrams, tok_count, (const char32_t *const *)tokens,
+            tok_lengths, matches->mode == MATCH_MODE_FZF, &candidate_count);
+
+        if (candidates != NULL && incremental &&
+            candidate_count >= matches->match_count)
+        {
+            /* Previous result is a smaller set to search */
+            free(candidates);
+            candidates = NULL;
+        }
+
+        if (candidates != NULL)
+            incremental = false;
+    }
 
-    const size_t slice_size = 4096;
-    const size_t slice_count = (search_count + slice_size - 1) / slice_size;
-    assert(search_count == 0 || slice_count >= 1);
+    const size_t search_count = candidates != NULL
+        ? candidate_count
+        : fuzzy_candidates != NULL
+            ? fuzzy_candidate_count
+            : incremental ? matches->match_count : matches->matches_size - first;
 
-    const bool use_threads = /*!incremental && */matches->workers.count > 0 && slice_count > 1;
+    const bool use_threads =
+        matches->workers.count > 0 && search_count > THREADS_MIN_ENTRIES;
 
     if (use_threads) {
-        mtx_lock(&matches->workers.lock);
+        const size_t worker_count = matches->workers.count;
+
         matches->workers.incremental = incremental;
         matches->workers.tok_count = tok_count;
         matches->workers.tokens = (const char32_t *const *)tokens;
         matches->workers.tok_lengths = tok_lengths;
+        matches->workers.candidates = candidates;
+        matches->workers.fuzzy_candidates = fuzzy_candidates;
+
+        /*
+         * Slices are split in halves until no larger than this. Aim
+         * for enough slices to balance the load, without making them
+         * so small that the (per-slice) overhead dominates.
+         */
+        matches->workers.grain =
+            max(search_count / (worker_count * 32), (size_t)256);
 
         if (incremental) {
             matches->workers.old_matches =
@@ -1650,63 +3109,106 @@ matches_update_internal(struct matches *matches, bool incremental)
                    matches->match_count * sizeof(matches->matches[0]));
         }
 
-        for (size_t i = 0; i < matches->workers.count; i++)
-            sem_post(&matches->workers.start);
-    }
+        /* Give each worker an equal share; the rest is up to stealing */
+        for (size_t i = 0; i < worker_count; i++) {
+            const uint64_t slice_start =
+                first + search_count * i / worker_count;
+            const uint64_t slice_end =
+                first + search_count * (i + 1) / worker_count;
+
+            if (slice_end > slice_start) {
+                bool pushed = ws_deque_push(
+                    &matches->workers.state[i]->deque,
+                    slice_end << 32 | slice_start);
+                assert(pushed);
+                (void)pushed;
+            }
+        }
 
-    matches->match_count = 0;
+        for (size_t i = 0; i < worker_count; i++)
+            sem_post(&matches->workers.state[i]->start);
+    }
 
-    for (size_t i = 0, slice_start_idx = 0; i < slice_count; i++, slice_start_idx += slice_size) {
-        const size_t count = min(search_count - slice_start_idx, slice_size);
+    matches->match_count = old_match_count;
 
-        if (use_threads) {
-            tll_push_back(
-                matches->workers.queue,
-                (uint64_t)(slice_start_idx + count) << 32 | slice_start_idx);
-        } else {
-            for (size_t j = 0; j < count; j++) {
-                struct application *app = NULL;
-                const size_t idx = slice_start_idx + j;
+    if (!use_threads) {
+        const bool *visible = matches->corpus->visible;
 
-                if (incremental) {
-                    app = matches->matches[idx].application;
-                    assert(app->visible);
-                } else {
-                    app = matches->applications->v[idx];
+        for (size_t i = first; i < first + search_count; i++) {
+            size_t idx;
 
-                    if (!app->visible)
-                        continue;
-                }
+            if (incremental) {
+                idx = matches->matches[i].entry;
+                assert(visible[idx]);
+            } else if (candidates != NULL) {
+                idx = candidates[i];
+                assert(visible[idx]);
+            } else if (fuzzy_candidates != NULL) {
+                idx = fuzzy_candidates[i];
+                assert(visible[idx]);
+            } else {
+                idx = i;
 
-                match_app(matches, app,
-                          tok_count, (const char32_t *const *)tokens, tok_lengths,
-                          match_name, match_filename, match_generic, match_exec,
-                          match_comment, match_keywords, match_categories, match_nth);
+                if (!visible[idx])
+                    continue;
             }
-        }
-    }
 
-    if (use_threads) {
+            match_app(matches, NULL, idx,
+                      tok_count, (const char32_t *const *)tokens, tok_lengths,
+                      match_name, match_filename, match_generic, match_exec,
+                      match_comment, match_keywords, match_categories, match_nth);
+        }
+    } else {
         for (size_t i = 0; i < matches->workers.count; i++)
-            tll_push_back(matches->workers.queue, (uint64_t)-1);
+            sem_wait(&matches->workers.done);
+
+        /* Merge the per-worker results */
+        for (size_t i = 0; i < matches->workers.count; i++) {
+            struct match_worker *worker = matches->workers.state[i];
 
-        mtx_unlock(&matches->workers.lock);
+            for (size_t j = 0; j < worker->result_count; j++) {
+                const size_t idx = matches->match_count++;
 
-        for (size_t i = 0; i < matches->workers.count; i++)
-            sem_wait(&matches->workers.done);
+                free(matches->matches[idx].pos);
+                matches->matches[idx] = worker->results[j];
+            }
+
+            if (matches->mode == MATCH_MODE_FUZZY) {
+                memcpy(&matches->fuzzy_narrow.ids[matches->fuzzy_narrow.count],
+                       worker->fuzzy_narrow,
+                       worker->fuzzy_narrow_count * sizeof(worker->fuzzy_narrow[0]));
+                matches->fuzzy_narrow.count += worker->fuzzy_narrow_count;
+            }
+
+            time_finish(worker->time_start, worker->time_stop,
+                        "match worker %d: %zu entries in %zu slices "
+                        "(%zu stolen), %zu matches",
+                        worker->my_id, worker->searched, worker->slices,
+                        worker->stolen, worker->result_count);
+
+            worker->time_start = worker->time_stop = NULL;
+        }
 
         matches->workers.tok_count = 0;
         matches->workers.tokens = NULL;
         matches->workers.tok_lengths = NULL;
+        matches->workers.candidates = NULL;
+        matches->workers.fuzzy_candidates = NULL;
     }
 
     LOG_DBG("match update done");
 
-    /* Sort */
-    if (matches->sort_result) {
-        qsort(matches->matches, matches->match_count,
-              sizeof(matches->matches[0]), &match_compar);
-    }
+    /*
+     * Sort. Only the selected page (and the ones before it) is sorted
+     * here; the rest is sorted on demand, when the selection moves
+     * there.
+     */
+    if (!matches->sort_result)
+        matches->sorted_count = matches->match_count;
+    else if (first > 0)
+        matches_merge_appended(matches, old_match_count);
+    else
+        matches->sorted_count = 0;
 
     matches->page_count = matches->max_matches_per_page
         ? ((matches->match_count + (matches->max_matches_per_page - 1)) /
@@ -1716,6 +3218,31 @@ matches_update_internal(struct matches *matches, bool incremental)
     if (matches->selected >= matches->match_count && matches->selected > 0)
         matches->selected = matches->match_count - 1;
 
+    matches_sort_selected_page(matches);
+
+    time_finish(start, NULL, "%zu matches (%zu entries searched)",
+                (size_t)matches->match_count, search_count);
+
+    free(matches->utf8_tokens);
+    free(matches->utf8_token_text);
+    matches->utf8_tokens = NULL;
+    matches->utf8_token_text = NULL;
+
+    if (matches->mode == MATCH_MODE_FUZZY) {
+        free(matches->fuzzy_patterns);
+        matches->fuzzy_patterns = NULL;
+
+        free(fuzzy_candidates);
+        free(matches->fuzzy_narrow.prompt);
+        matches->fuzzy_narrow.prompt = xc32dup(ptext);
+        matches->fuzzy_narrow.apps_size = matches->matches_size;
+        matches->fuzzy_narrow.valid =
+            matches->fuzzy_narrow.valid && tok_count > 0;
+    }
+
+    matches_set_matched(matches, ptext);
+
+    free(candidates);
     free(tok_lengths);
     free(tokens);
     free(copy);
@@ -1754,20 +3281,24 @@ matches_update(struct matches *matches)
             return;
     }
 
-    matches_update_internal(matches, false);
+    matches_update_internal(matches, false, false);
 }
 
 void
 matches_update_no_delay(struct matches *matches)
 {
-    matches_update_internal(matches, false);
+    matches_update_internal(matches, false, false);
 }
 
 void
-matches_update_incremental(struct matches *matches)
+matches_update_appended(struct matches *matches)
 {
-    const bool need_full_update = matches->mode == MATCH_MODE_FUZZY;
+    matches_update_internal(matches, false, true);
+}
 
+void
+matches_update_incremental(struct matches *matches)
+{
     if (matches->delay_ms > 0 &&
         matches->match_count > matches->delay_limit &&
         matches->delayed_update_type != DELAYED_UPDATE_IN_PROGRESS)
@@ -1775,8 +3306,7 @@ matches_update_incremental(struct matches *matches)
         switch (matches->delayed_update_type) {
         case DELAYED_NO_UPDATE:
         case DELAYED_INCREMENTAL_UPDATE:
-            matches->delayed_update_type = need_full_update
-                ? DELAYED_FULL_UPDATE : DELAYED_INCREMENTAL_UPDATE;
+            matches->delayed_update_type = DELAYED_INCREMENTAL_UPDATE;
             break;
 
         case DELAYED_FULL_UPDATE:
@@ -1791,5 +3321,5 @@ matches_update_incremental(struct matches *matches)
             return;
     }
 
-    matches_update_internal(matches, !need_full_update);
+    matches_update_internal(matches, true, false);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #include "application.h"
@@ -22,10 +23,12 @@ struct match_substring {
 struct match {
     enum matched_type matched_type;
     struct application *application;
+    size_t entry;  /* Index of 'application' in the application list */
     struct match_substring *pos;
     size_t pos_count;
     size_t score;
     bool word_boundary;  /* True if match starts at word boundary */
+    uint64_t sort_key;   /* Lower sorts first; see match_sort_key() */
 };
 
 struct wayland;
@@ -54,6 +57,9 @@ void matches_max_matches_per_page_set(
 
 void matches_update(struct matches *matches);
 void matches_update_no_delay(struct matches *matches);
+
+/* Like matches_update_no_delay(), but only matches newly loaded entries, if possible */
+void matches_update_appended(struct matches *matches);
 void matches_update_incremental(struct matches *matches);
 
 size_t matches_get_page_count(const struct matches *matches);
@@ -66,6 +72,14 @@ size_t matches_get_count(const struct matches *matches); /* Matches on current p
 size_t matches_get_total_count(const struct matches *matches);
 size_t matches_get_match_index(const struct matches *matches);
 
+/*
+ * Application list indices of the matches on the current page,
+ * followed by those on the next page (which is sorted first, if
+ * needed). Returns the number written to 'entries' (at most 'max').
+ */
+size_t matches_get_upcoming_entries(
+    struct matches *matches, size_t *entries, size_t max);
+
 bool matches_selected_select(struct matches *matches, const char *string);
 bool matches_idx_select(struct matches *matches, size_t idx);
 
@@ -0,0 +1,301 @@
+#include "ngram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "ngram"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "xmalloc.h"
+
+struct posting_list {
+    uint64_t key;  /* 0 means empty bucket */
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t size;
+};
+
+struct ngram_index {
+    struct posting_list *buckets;
+    size_t bucket_bits;
+    size_t used;
+
+    size_t entry_count;
+    uint32_t last_id;
+};
+
+/* Code points fit in 21 bits; three of them fit in a 64-bit key */
+#define CP_MASK ((uint64_t)0x1fffff)
+#define UNIGRAM_TAG ((uint64_t)1 << 63)
+
+static inline uint64_t
+unigram_key(char32_t c)
+{
+    return UNIGRAM_TAG | (c & CP_MASK);
+}
+
+static inline uint64_t
+trigram_key(const char32_t *s)
+{
+    return ((s[0] & CP_MASK) << 42) | ((s[1] & CP_MASK) << 21) | (s[2] & CP_MASK);
+}
+
+static inline size_t
+bucket_of(const struct ngram_index *idx, uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15ull) >> (64 - idx->bucket_bits);
+}
+
+struct ngram_index *
+ngram_index_init(void)
+{
+    struct ngram_index *idx = xmalloc(sizeof(*idx));
+    *idx = (struct ngram_index){
+        .bucket_bits = 12,
+    };
+
+    idx->buckets = xcalloc(
+        (size_t)1 << idx->bucket_bits, sizeof(idx->buckets[0]));
+    return idx;
+}
+
+void
+ngram_index_destroy(struct ngram_index *idx)
+{
+    if (idx == NULL)
+        return;
+
+    const size_t bucket_count = (size_t)1 << idx->bucket_bits;
+    for (size_t i = 0; i < bucket_count; i++)
+        free(idx->buckets[i].ids);
+
+    free(idx->buckets);
+    free(idx);
+}
+
+size_t
+ngram_index_entry_count(const struct ngram_index *idx)
+{
+    return idx->entry_count;
+}
+
+static struct posting_list *
+lookup(const struct ngram_index *idx, uint64_t key)
+{
+    const size_t mask = ((size_t)1 << idx->bucket_bits) - 1;
+
+    for (size_t i = bucket_of(idx, key); ; i = (i + 1) & mask) {
+        struct posting_list *list = &idx->buckets[i];
+        if (list->key == key)
+            return list;
+        if (list->key == 0)
+            return NULL;
+    }
+}
+
+static void
+grow(struct ngram_index *idx)
+{
+    const size_t old_count = (size_t)1 << idx->bucket_bits;
+    struct posting_list *old = idx->buckets;
+
+    idx->bucket_bits++;
+    idx->buckets = xcalloc(old_count * 2, sizeof(idx->buckets[0]));
+
+    const size_t mask = old_count * 2 - 1;
+
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i].key == 0)
+            continue;
+
+        size_t j = bucket_of(idx, old[i].key);
+        while (idx->buckets[j].key != 0)
+            j = (j + 1) & mask;
+
+        idx->buckets[j] = old[i];
+    }
+
+    free(old);
+}
+
+static void
+add_posting(struct ngram_index *idx, uint64_t key, uint32_t id)
+{
+    xassert(key != 0);
+
+    /* Keep load factor below 50% */
+    if ((idx->used + 1) * 2 > ((size_t)1 << idx->bucket_bits))
+        grow(idx);
+
+    const size_t mask = ((size_t)1 << idx->bucket_bits) - 1;
+
+    size_t i = bucket_of(idx, key);
+    while (idx->buckets[i].key != 0 && idx->buckets[i].key != key)
+        i = (i + 1) & mask;
+
+    struct posting_list *list = &idx->buckets[i];
+
+    if (list->key == 0) {
+        list->key = key;
+        idx->used++;
+    }
+
+    /* IDs are added in order; this de-duplicates within an entry */
+    if (list->count > 0 && list->ids[list->count - 1] == id)
+        return;
+
+    if (list->count >= list->size) {
+        list->size = list->size > 0 ? list->size * 2 : 4;
+        list->ids = xreallocarray(list->ids, list->size, sizeof(list->ids[0]));
+    }
+
+    list->ids[list->count++] = id;
+}
+
+void
+ngram_index_add(struct ngram_index *idx, uint32_t id,
+                const char32_t *text, size_t len)
+{
+    xassert(idx->entry_count == 0 || id >= idx->last_id);
+
+    if (idx->entry_count == 0 || id != idx->last_id) {
+        idx->entry_count++;
+        idx->last_id = id;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        add_posting(idx, unigram_key(text[i]), id);
+        if (i + 2 < len)
+            add_posting(idx, trigram_key(&text[i]), id);
+    }
+}
+
+static int
+posting_list_compar(const void *_a, const void *_b)
+{
+    const struct posting_list *const *a = _a;
+    const struct posting_list *const *b = _b;
+
+    if ((*a)->count < (*b)->count)
+        return -1;
+    if ((*a)->count > (*b)->count)
+        return 1;
+    return 0;
+}
+
+static bool
+contains(const uint32_t *ids, size_t count, uint32_t id)
+{
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else if (ids[mid] > id)
+            hi = mid;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+/* Intersects 'result' with 'list', in-place. Returns the new count */
+static size_t
+intersect(uint32_t *result, size_t count, const struct posting_list *list)
+{
+    size_t out = 0;
+
+    if (list->count > count * 16) {
+        /* Much longer list; binary search each candidate */
+        for (size_t i = 0; i < count; i++) {
+            if (contains(list->ids, list->count, result[i]))
+                result[out++] = result[i];
+        }
+    } else {
+        size_t j = 0;
+        for (size_t i = 0; i < count && j < list->count; ) {
+            if (result[i] < list->ids[j])
+                i++;
+            else if (result[i] > list->ids[j])
+                j++;
+            else {
+                result[out++] = result[i];
+                i++;
+                j++;
+            }
+        }
+    }
+
+    return out;
+}
+
+uint32_t *
+ngram_index_query(const struct ngram_index *idx, size_t tok_count,
+                  const char32_t *const tokens[static tok_count],
+                  const size_t tok_lengths[static tok_count],
+                  bool unordered_chars, size_t *count)
+{
+    if (tok_count == 0)
+        return NULL;
+
+    size_t key_count = 0;
+    for (size_t t = 0; t < tok_count; t++) {
+        const size_t len = tok_lengths[t];
+        key_count += unordered_chars || len < 3 ? len : len - 2;
+    }
+
+    if (key_count == 0)
+        return NULL;
+
+    const struct posting_list **lists = xmalloc(key_count * sizeof(lists[0]));
+    size_t list_count = 0;
+
+    for (size_t t = 0; t < tok_count; t++) {
+        const char32_t *tok = tokens[t];
+        const size_t len = tok_lengths[t];
+        const bool use_unigrams = unordered_chars || len < 3;
+
+        for (size_t i = 0; i < (use_unigrams ? len : len - 2); i++) {
+            const uint64_t key = use_unigrams
+                ? unigram_key(tok[i])
+                : trigram_key(&tok[i]);
+
+            const struct posting_list *list = lookup(idx, key);
+
+            if (list == NULL) {
+                /* N-gram not in any entry; nothing can match */
+                free(lists);
+                *count = 0;
+                return xmalloc(sizeof(uint32_t));
+            }
+
+            lists[list_count++] = list;
+        }
+    }
+
+    /* Start with the shortest list, to keep the intermediate result small */
+    qsort(lists, list_count, sizeof(lists[0]), &posting_list_compar);
+
+    uint32_t *result = xmalloc(
+        (lists[0]->count > 0 ? lists[0]->count : 1) * sizeof(result[0]));
+    memcpy(result, lists[0]->ids, lists[0]->count * sizeof(result[0]));
+
+    size_t result_count = lists[0]->count;
+
+    for (size_t i = 1; i < list_count && result_count > 0; i++) {
+        if (lists[i] == lists[i - 1])
+            continue;
+        result_count = intersect(result, result_count, lists[i]);
+    }
+
+    LOG_DBG("%zu n-grams, %zu candidates (of %zu entries)",
+            list_count, result_count, idx->entry_count);
+
+    free(lists);
+    *count = result_count;
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
+
+/*
+ * Inverted n-gram index, mapping uni- and trigrams to a (sorted) list
+ * of entry IDs containing them.
+ *
+ * Used to narrow down the set of entries that needs to be verified
+ * with the "real" matching functions. Queries return a *superset* of
+ * the matching entries; never a subset.
+ */
+struct ngram_index;
+
+struct ngram_index *ngram_index_init(void);
+void ngram_index_destroy(struct ngram_index *idx);
+
+/*
+ * Adds all n-grams of 'text' to the index. Entry IDs must be added in
+ * ascending order. Adding multiple strings for the same entry ID is
+ * allowed, as long as it is done consecutively.
+ */
+void ngram_index_add(struct ngram_index *idx, uint32_t id,
+                     const char32_t *text, size_t len);
+
+size_t ngram_index_entry_count(const struct ngram_index *idx);
+
+/*
+ * Returns a sorted array of candidate entry IDs (to be free:d by the
+ * caller), or NULL if the index cannot be used to narrow down the
+ * search (in which case all entries must be searched).
+ *
+ * In exact mode, each token is required to be present as a
+ * sub-string. In 'unordered_chars' mode (used for fzf matching), we
+ * can only require each token character to be present, somewhere.
+ */
+uint32_t *ngram_index_query(
+    const struct ngram_index *idx, size_t tok_count,
+    const char32_t *const tokens[static tok_count],
+    const size_t tok_lengths[static tok_count],
+    bool unordered_chars, size_t *count);
@@ -16,6 +16,7 @@
 #include "log.h"
 #include "xdg.h"
 #include "char32.h"
+#include "strset.h"
 #include "xmalloc.h"
 
 void
@@ -30,6 +31,9 @@ path_find_programs(struct application_list *applications)
     char *ctx = NULL;
     tll(struct application *) entries = tll_init();
 
+    /* Titles of 'entries'; the first executable with a given name wins */
+    struct strset *titles = strset_init(1024);
+
     for (const char *tok = strtok_r(copy, ":", &ctx);
          tok != NULL;
          tok = strtok_r(NULL, ":", &ctx))
@@ -49,54 +53,52 @@ path_find_programs(struct application_list *applications)
             if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
                 continue;
 
+            size_t wtitle_len;
+            char32_t *wtitle = ambstoc32_len(e->d_name, &wtitle_len);
+            if (wtitle == NULL)
+                continue;
+
+            /* Already found in an earlier PATH directory; no need to stat it */
+            if (strset_find(titles, wtitle, wtitle_len * sizeof(wtitle[0])) != NULL) {
+                free(wtitle);
+                continue;
+            }
+
             struct stat st;
             if (fstatat(fd, e->d_name, &st, 0) == -1) {
                 LOG_WARN("%s: failed to stat: %s", e->d_name, strerror(errno));
+                free(wtitle);
                 continue;
             }
             if (S_ISREG(st.st_mode) && st.st_mode & S_IXUSR) {
-                char32_t *wtitle = ambstoc32(e->d_name);
-                if (wtitle == NULL)
-                    continue;
-                bool already_exist = false;
-                tll_foreach(entries, it) {
-                    if (c32cmp(wtitle, it->item->title) == 0) {
-                        already_exist = true;
-                        break;
-                    }
-                };
-                if (already_exist) {
-                    free(wtitle);
-                    continue;
-                }
+                strset_add(titles, wtitle, wtitle_len * sizeof(wtitle[0]), NULL);
 
                 char32_t *lowercase = xc32dup(wtitle);
-                for (size_t i = 0; i < c32len(lowercase); i++)
-                    lowercase[i] = toc32lower(lowercase[i]);
+                toc32lower_n(lowercase, lowercase, wtitle_len);
 
                 struct application *app = xmalloc(sizeof(*app));
                 *app = (struct application){
                     .index = 0,  /* Not used in application mode */
                     .title = wtitle,
                     .title_lowercase = lowercase,
-                    .title_len = c32len(lowercase),
+                    .title_len = wtitle_len,
                     .exec = xstrjoin3(tok, "/", e->d_name),
                     .visible = true,
                 };
 
                 tll_push_back(entries, app);
-            }
+            } else
+                free(wtitle);
         }
         closedir(d);
     }
     free(copy);
-
-    applications->v = xreallocarray(
-        applications->v, applications->count + tll_length(entries), sizeof(applications->v[0]));
+    strset_destroy(titles);
 
     tll_foreach(entries, it) {
-        applications->v[applications->count++] = it->item;
-        applications->visible_count++;
+        applications_append(applications, it->item);
         tll_remove(entries, it);
     }
+
+    applications_publish(applications);
 }
@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <dlfcn.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <threads.h>
 
@@ -24,6 +25,10 @@ typedef const char *(*l10n_plugin_translate)(const char *);
 
 static void *l10n_handle = NULL;
 static l10n_plugin_translate l10n_func = NULL;
+static char *l10n_path = NULL;
+
+/* Plugins aren't required to be thread safe */
+static mtx_t l10n_lock;
 
 void
 l10n_plugin_load(const char *path)
@@ -55,6 +60,16 @@ l10n_plugin_load(const char *path)
         fprintf(stderr, "%s\n", error);
         l10n_func = NULL;
     }
+
+    if (l10n_func != NULL) {
+        if (mtx_init(&l10n_lock, mtx_plain) != thrd_success) {
+            fprintf(stderr, "failed to initialize plugin lock\n");
+            l10n_func = NULL;
+            return;
+        }
+
+        l10n_path = strdup(path);
+    }
 }
 
 char32_t *
@@ -64,10 +79,18 @@ l10n_translate(const char *src)
         return NULL;
     }
 
+    /* The result may be owned by the plugin, until its next call */
+    mtx_lock(&l10n_lock);
+
     const char *translated = l10n_func(src);
-    if (translated) {
-        return ambstoc32(translated);
-    }
+    char32_t *ret = translated != NULL ? ambstoc32(translated) : NULL;
+
+    mtx_unlock(&l10n_lock);
+    return ret;
+}
 
-    return NULL;
+const char *
+l10n_plugin_path(void)
+{
+    return l10n_func != NULL ? l10n_path : NULL;
 }
@@ -4,3 +4,6 @@
 
 void l10n_plugin_load(const char *path);
 char32_t *l10n_translate(const char *src);
+
+/* Path of the loaded plugin, or NULL if none is loaded */
+const char *l10n_plugin_path(void);
@@ -0,0 +1,612 @@
+#include "popularity-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOG_MODULE "popularity-cache"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "cache-file.h"
+#include "char32.h"
+#include "strset.h"
+#include "timing.h"
+#include "xdg.h"
+#include "xmalloc.h"
+
+#define CACHE_FILE_NAME "fuzzel"
+#define CACHE_MAGIC "fzlpop"
+#define CACHE_VERSION 1
+
+#define NO_ENTRY UINT32_MAX
+
+/*
+ * File layout: the header, followed by 'entry_count' entries,
+ * 'slot_count' slots, and finally the (not NUL terminated) keys, in
+ * entry order. A key ends where the next one begins.
+ *
+ * Each slot holds the index (plus one; zero is an empty slot) of the
+ * first entry with a given key. Entries with the same key (e.g. all
+ * actions of a desktop file share its ID) are chained with 'next', in
+ * the order they were saved, and are assigned to applications in that
+ * same order.
+ */
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;         /* Total file size */
+    uint32_t entry_count;
+    uint32_t slot_count;   /* Power of two, larger than 'entry_count' */
+};
+
+struct entry {
+    uint32_t hash;         /* Upper half of strset_hash() of the key */
+    uint32_t key_offset;   /* Relative to the start of the file */
+    uint32_t count;
+    uint32_t next;         /* Next entry with the same key, or NO_ENTRY */
+};
+
+struct map {
+    const char *data;
+    size_t size;
+    const struct header *hdr;
+    const struct entry *entries;
+    const uint32_t *slots;
+};
+
+static size_t
+entries_offset(void)
+{
+    return (sizeof(struct header) + alignof(struct entry) - 1) &
+        ~(alignof(struct entry) - 1);
+}
+
+static size_t
+slots_offset(size_t entry_count)
+{
+    return entries_offset() + entry_count * sizeof(struct entry);
+}
+
+static size_t
+keys_offset(size_t entry_count, size_t slot_count)
+{
+    return slots_offset(entry_count) + slot_count * sizeof(uint32_t);
+}
+
+static void
+map_init(struct map *map, const char *data, size_t size)
+{
+    const struct header *hdr = (const struct header *)data;
+
+    *map = (struct map){
+        .data = data,
+        .size = size,
+        .hdr = hdr,
+        .entries = (const struct entry *)&data[entries_offset()],
+        .slots = (const uint32_t *)&data[slots_offset(hdr->entry_count)],
+    };
+}
+
+static size_t
+key_len(const struct map *map, size_t idx)
+{
+    const size_t end = idx + 1 < map->hdr->entry_count
+        ? map->entries[idx + 1].key_offset
+        : map->size;
+    return end - map->entries[idx].key_offset;
+}
+
+/* Returns the slot holding 'key', or the empty slot it would go in */
+static size_t
+probe(const struct map *map, const void *key, size_t len, uint64_t hash)
+{
+    const size_t mask = map->hdr->slot_count - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const uint32_t slot = map->slots[i];
+
+        if (slot == 0)
+            return i;
+
+        const struct entry *e = &map->entries[slot - 1];
+        if (e->hash == (uint32_t)(hash >> 32) &&
+            key_len(map, slot - 1) == len &&
+            memcmp(&map->data[e->key_offset], key, len) == 0)
+        {
+            return i;
+        }
+    }
+}
+
+static bool
+map_valid(const struct map *map)
+{
+    const struct header *hdr = map->hdr;
+
+    if (map->size < sizeof(*hdr) ||
+        memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        hdr->version != CACHE_VERSION ||
+        hdr->size != map->size ||
+        hdr->slot_count == 0 ||
+        (hdr->slot_count & (hdr->slot_count - 1)) != 0 ||
+        hdr->entry_count >= hdr->slot_count ||
+        keys_offset(hdr->entry_count, hdr->slot_count) > map->size)
+    {
+        return false;
+    }
+
+    size_t key_end = keys_offset(hdr->entry_count, hdr->slot_count);
+
+    for (size_t i = 0; i < hdr->entry_count; i++) {
+        const struct entry *e = &map->entries[i];
+
+        /* Keys are consecutive, and in entry order */
+        if (e->key_offset < key_end || e->key_offset > map->size)
+            return false;
+        key_end = e->key_offset;
+
+        /* Chains only go forward, and thus always end */
+        if (e->next != NO_ENTRY &&
+            (e->next <= i || e->next >= hdr->entry_count))
+        {
+            return false;
+        }
+    }
+
+    /* At least one slot must be empty, for probing to terminate */
+    size_t used_slots = 0;
+    for (size_t i = 0; i < hdr->slot_count; i++) {
+        if (map->slots[i] > hdr->entry_count)
+            return false;
+        if (map->slots[i] != 0)
+            used_slots++;
+    }
+
+    return used_slots < hdr->slot_count;
+}
+
+struct key {
+    const char *key;
+    size_t len;
+    unsigned count;
+    char *owned;  /* Set if 'key' was allocated */
+};
+
+/* Lays out 'keys' in the file format. Returns NULL if too large */
+static char *
+build(const struct key *keys, size_t count, size_t *size)
+{
+    size_t slot_count = 16;
+    while (slot_count < count * 2)
+        slot_count *= 2;
+
+    const size_t keys_start = keys_offset(count, slot_count);
+
+    size_t total = keys_start;
+    for (size_t i = 0; i < count; i++)
+        total += keys[i].len;
+
+    if (total > UINT32_MAX)
+        return NULL;
+
+    /* Zeroed; i.e. all slots are empty */
+    char *data = xcalloc(1, total);
+
+    struct header *hdr = (struct header *)data;
+    *hdr = (struct header){
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .size = total,
+        .entry_count = count,
+        .slot_count = slot_count,
+    };
+
+    struct map map;
+    map_init(&map, data, total);
+
+    struct entry *entries = (struct entry *)&data[entries_offset()];
+    uint32_t *slots = (uint32_t *)&data[slots_offset(count)];
+
+    /* Last entry of each chain, indexed by the first entry */
+    uint32_t *tails = xcalloc(count, sizeof(tails[0]));
+
+    size_t key_offset = keys_start;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct key *k = &keys[i];
+        const uint64_t hash = strset_hash(k->key, k->len);
+
+        memcpy(&data[key_offset], k->key, k->len);
+        entries[i] = (struct entry){
+            .hash = hash >> 32,
+            .key_offset = key_offset,
+            .count = k->count,
+            .next = NO_ENTRY,
+        };
+        key_offset += k->len;
+
+        const size_t slot = probe(&map, k->key, k->len, hash);
+
+        if (slots[slot] == 0) {
+            slots[slot] = i + 1;
+            tails[i] = i;
+        } else {
+            const uint32_t first = slots[slot] - 1;
+            entries[tails[first]].next = i;
+            tails[first] = i;
+        }
+    }
+
+    free(tails);
+
+    *size = total;
+    return data;
+}
+
+/*
+ * Parses the old, text based, format. Each line is "<id>|<count>",
+ * where the ID may itself contain '|' (dmenu entries)
+ */
+static char *
+build_from_text(const char *path, const char *data, size_t size,
+                size_t *built_size)
+{
+    struct key *keys = NULL;
+    size_t count = 0;
+    size_t keys_size = 0;
+
+    for (const char *line = data; line < data + size;) {
+        const char *end = memchr(line, '\n', data + size - line);
+        if (end == NULL)
+            end = data + size;
+
+        const char *sep = memrchr(line, '|', end - line);
+
+        if (sep == NULL || sep == line || sep + 1 == end) {
+            LOG_ERR("%s: invalid cache entry (cache corrupt?): %.*s",
+                    path, (int)(end - line), line);
+            line = end + 1;
+            continue;
+        }
+
+        unsigned launch_count = 0;
+        for (const char *c = sep + 1; c < end && *c >= '0' && *c <= '9'; c++)
+            launch_count = launch_count * 10 + (*c - '0');
+
+        if (count >= keys_size) {
+            keys_size = keys_size > 0 ? keys_size * 2 : 64;
+            keys = xreallocarray(keys, keys_size, sizeof(keys[0]));
+        }
+
+        keys[count++] = (struct key){
+            .key = line,
+            .len = sep - line,
+            .count = launch_count,
+        };
+
+        line = end + 1;
+    }
+
+    char *built = build(keys, count, built_size);
+    free(keys);
+    return built;
+}
+
+/*
+ * The key an application's launch count is stored under: the desktop
+ * file ID, or the dmenu entry's title (as UTF-8, or whatever the
+ * locale's encoding is). Returns NULL if there is none
+ */
+static bool
+application_key(const struct application *app, bool dmenu, struct key *key)
+{
+    *key = (struct key){.count = app->count};
+
+    if (!dmenu) {
+        if (app->id == NULL)
+            return false;
+
+        key->key = app->id;
+        key->len = strlen(app->id);
+        return true;
+    }
+
+    if (!application_has_title(app))
+        return false;
+
+    if (app->dmenu_line_lowercase != NULL) {
+        /* The title is the (UTF-8) line itself; no need to decode it */
+        key->key = app->dmenu_line;
+        key->len = app->dmenu_line_len;
+        return true;
+    }
+
+    key->owned = ac32tombs(app->title);
+    if (key->owned == NULL)
+        return false;
+
+    key->key = key->owned;
+    key->len = strlen(key->owned);
+    return true;
+}
+
+static char *
+cache_file_path(const char *path)
+{
+    if (path != NULL)
+        return xstrdup(path);
+
+    const char *cache_dir = xdg_cache_dir();
+    if (cache_dir == NULL)
+        return NULL;
+
+    return xasprintf("%s/" CACHE_FILE_NAME, cache_dir);
+}
+
+struct popularity_cache {
+    void *data;       /* The mapped file */
+    size_t size;
+    char *converted;  /* Old format caches, converted to the new one */
+    struct map map;
+    bool dmenu;
+    bool *used;       /* Entries already assigned to an application */
+};
+
+struct popularity_cache *
+popularity_cache_open(const char *_path, bool dmenu)
+{
+    if (_path == NULL && dmenu) {
+        /* Don't thrash "normal" cache in dmenu mode */
+        return NULL;
+    }
+
+    char *path = cache_file_path(_path);
+    if (path == NULL) {
+        LOG_WARN("failed to get cache directory: not loading popularity cache");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            LOG_ERRNO("%s: failed to open", path);
+        free(path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG_ERRNO("%s: failed to stat", path);
+        close(fd);
+        free(path);
+        return NULL;
+    }
+
+    /* E.g. /dev/null, to disable caching */
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        free(path);
+        return NULL;
+    }
+
+    struct timespec *start = time_begin();
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        LOG_ERRNO("%s: failed to mmap", path);
+        free(start);
+        free(path);
+        return NULL;
+    }
+
+    struct popularity_cache *cache = xmalloc(sizeof(*cache));
+    *cache = (struct popularity_cache){
+        .data = data,
+        .size = st.st_size,
+        .dmenu = dmenu,
+    };
+
+    if ((size_t)st.st_size >= sizeof(struct header) &&
+        memcmp(data, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0)
+    {
+        map_init(&cache->map, data, st.st_size);
+
+        if (!map_valid(&cache->map)) {
+            LOG_ERR("%s: invalid cache (cache corrupt?)", path);
+            goto err;
+        }
+    } else {
+        size_t size;
+        cache->converted = build_from_text(path, data, st.st_size, &size);
+
+        if (cache->converted == NULL) {
+            LOG_ERR("%s: too large", path);
+            goto err;
+        }
+
+        map_init(&cache->map, cache->converted, size);
+    }
+
+    const size_t entry_count = cache->map.hdr->entry_count;
+    cache->used = xcalloc(entry_count > 0 ? entry_count : 1,
+                          sizeof(cache->used[0]));
+
+    time_finish(start, NULL, "popularity cache loaded (%zu entries)",
+                entry_count);
+    free(path);
+    return cache;
+
+err:
+    free(start);
+    free(path);
+    popularity_cache_close(cache);
+    return NULL;
+}
+
+void
+popularity_cache_close(struct popularity_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    free(cache->used);
+    free(cache->converted);
+    munmap(cache->data, cache->size);
+    free(cache);
+}
+
+void
+popularity_cache_apply(struct popularity_cache *cache,
+                       struct application *app)
+{
+    const struct map *map = &cache->map;
+
+    if (map->hdr->entry_count == 0)
+        return;
+
+    struct key key;
+    if (!application_key(app, cache->dmenu, &key))
+        return;
+
+    const uint64_t hash = strset_hash(key.key, key.len);
+    const uint32_t slot = map->slots[probe(map, key.key, key.len, hash)];
+    free(key.owned);
+
+    if (slot == 0)
+        return;
+
+    /* First, not yet assigned, entry with this key */
+    uint32_t j = slot - 1;
+    while (j != NO_ENTRY && cache->used[j])
+        j = map->entries[j].next;
+
+    if (j != NO_ENTRY) {
+        app->count = map->entries[j].count;
+        cache->used[j] = true;
+    }
+}
+
+void
+popularity_cache_load(const char *path, struct application_list *apps,
+                      bool dmenu)
+{
+    struct popularity_cache *cache = popularity_cache_open(path, dmenu);
+    if (cache == NULL)
+        return;
+
+    for (size_t i = 0; i < apps->count; i++)
+        popularity_cache_apply(cache, applications_get(apps, i));
+
+    popularity_cache_close(cache);
+}
+
+static bool
+file_equals(int fd, size_t file_size, const char *data, size_t size)
+{
+    if (file_size != size)
+        return false;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+
+    const bool equal = memcmp(map, data, size) == 0;
+    munmap(map, size);
+    return equal;
+}
+
+static void
+write_file(const char *path, const char *data, size_t size)
+{
+    struct stat st;
+    const bool exists = stat(path, &st) == 0;
+
+    if (exists && !S_ISREG(st.st_mode)) {
+        /* E.g. /dev/null, to disable caching; nothing to replace */
+        int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || !cache_write_all(fd, data, size))
+            LOG_ERRNO("%s: failed to write cache", path);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    if (exists) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            const bool unchanged = file_equals(fd, st.st_size, data, size);
+            close(fd);
+
+            if (unchanged) {
+                LOG_DBG("%s: unchanged", path);
+                return;
+            }
+        }
+    }
+
+    /* Replace the symlink's target, not the symlink */
+    char *target = exists ? realpath(path, NULL) : NULL;
+    if (target == NULL)
+        target = xstrdup(path);
+
+    /* Keep the permissions of the cache being replaced */
+    if (cache_file_replace(target, data, size, exists ? st.st_mode : 0644)) {
+        LOG_DBG("%s: saved (%zu bytes)", target, size);
+    }
+
+    free(target);
+}
+
+void
+popularity_cache_save(const char *_path, const struct application_list *apps,
+                      bool dmenu)
+{
+    if (_path == NULL && dmenu) {
+        /* Don't thrash "normal" cache in dmenu mode */
+        return;
+    }
+
+    char *path = cache_file_path(_path);
+    if (path == NULL) {
+        LOG_WARN("failed to get cache directory: not saving popularity cache");
+        return;
+    }
+
+    struct key *keys = xmalloc((apps->count > 0 ? apps->count : 1) *
+                               sizeof(keys[0]));
+    size_t count = 0;
+
+    for (size_t i = 0; i < apps->count; i++) {
+        const struct application *app = applications_get(apps, i);
+
+        if (app->count == 0 || !app->visible)
+            continue;
+
+        if (application_key(app, dmenu, &keys[count]))
+            count++;
+    }
+
+    size_t size;
+    char *data = build(keys, count, &size);
+
+    if (data != NULL)
+        write_file(path, data, size);
+    else
+        LOG_ERR("%s: too large, not saving popularity cache", path);
+
+    for (size_t i = 0; i < count; i++)
+        free(keys[i].owned);
+    free(keys);
+    free(data);
+    free(path);
+}
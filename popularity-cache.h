@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "application.h"
+
+/*
+ * The popularity cache: how many times each application (desktop file
+ * ID), or dmenu entry, has been launched. Stored in
+ * $XDG_CACHE_HOME/fuzzel, or the path given with --cache.
+ *
+ * The file is binary, and mapped when loaded. It holds an open
+ * addressing hash table, keyed on the hashed ID (or dmenu entry),
+ * that applications are looked up in directly. Caches in the old,
+ * text based, format ("<id>|<count>" lines) are still read, and are
+ * converted the next time the cache is saved.
+ *
+ * In dmenu mode, nothing is loaded, or saved, unless a path has been
+ * given (so as not to thrash the application cache).
+ */
+
+void popularity_cache_load(
+    const char *path, struct application_list *apps, bool dmenu);
+
+/*
+ * For entries that are published while they're still being loaded
+ * (dmenu mode): the cache is opened first, and each entry's launch
+ * count is looked up before it's published. Entries must be applied
+ * in application order. Returns NULL if there's nothing to load.
+ */
+struct popularity_cache;
+
+struct popularity_cache *popularity_cache_open(const char *path, bool dmenu);
+void popularity_cache_apply(
+    struct popularity_cache *cache, struct application *app);
+void popularity_cache_close(struct popularity_cache *cache);
+
+/*
+ * Writes the launch count of all visible, launched, applications. The
+ * file is replaced atomically, and isn't written at all if its
+ * contents would be unchanged.
+ */
+void popularity_cache_save(
+    const char *path, const struct application_list *apps, bool dmenu);
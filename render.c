@@ -1712,12 +1712,13 @@ render_one_match_entry(struct render *render, const struct matches *matches,
     /* Replace newlines in title, with spaces (basic support for
      * multiline entries) */
     if (match->application->render_title == NULL) {
-        char32_t *newline = c32chr(match->application->title, U'\n');
+        char32_t *title = application_title(match->application);
+        char32_t *newline = c32chr(title, U'\n');
 
         if (newline != NULL) {
-            char32_t *render_title = xc32dup(match->application->title);
+            char32_t *render_title = xc32dup(title);
 
-            newline = render_title + (newline - match->application->title);
+            newline = render_title + (newline - title);
             *newline = U' ';
 
             while ((newline = c32chr(newline, U'\n')) != NULL)
@@ -1726,7 +1727,7 @@ render_one_match_entry(struct render *render, const struct matches *matches,
             match->application->render_title = render_title;
         } else {
             /* No newlines, use title as-is */
-            match->application->render_title = match->application->title;
+            match->application->render_title = title;
         }
     }
 
@@ -1759,7 +1760,12 @@ render_match_list(struct render *render, struct buffer *buf,
 
     assert(match_count == 0 || selected < match_count);
 
-    bool render_icons = mtx_trylock(render->icon_lock) == thrd_success;
+    /*
+     * Icons are resolved off-lock, and the lock is only held while
+     * handing them over (or on this thread, when the font changes),
+     * so waiting for it is short
+     */
+    bool render_icons = mtx_lock(render->icon_lock) == thrd_success;
 
     if (render->workers.count > 0) {
         mtx_lock(&render->workers.lock);
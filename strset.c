@@ -0,0 +1,159 @@
+#include "strset.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+
+struct slot {
+    const void *key;  /* NULL: empty slot */
+    size_t len;
+    uint64_t hash;
+    void *value;
+};
+
+struct strset {
+    struct slot *slots;
+    size_t mask;   /* Slot count - 1; the slot count is a power of two */
+    size_t count;
+};
+
+static uint64_t
+mix(uint64_t h)
+{
+    h ^= h >> 31;
+    h *= 0x7fb5d329728ea185ull;
+    h ^= h >> 27;
+    h *= 0x81dadef4bc2dd44dull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t
+strset_hash(const void *key, size_t len)
+{
+    const unsigned char *p = key;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+
+    for (; len >= sizeof(uint64_t); p += sizeof(uint64_t), len -= sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        h = (h ^ v) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, len);
+    return mix(h ^ tail);
+}
+
+/* The table is kept at most half full, to keep probe sequences short */
+static size_t
+slot_count_for(size_t count)
+{
+    size_t slots = 16;
+    while (slots < count * 2)
+        slots *= 2;
+    return slots;
+}
+
+struct strset *
+strset_init(size_t expected)
+{
+    const size_t slots = slot_count_for(expected);
+
+    struct strset *set = xmalloc(sizeof(*set));
+    *set = (struct strset){
+        .slots = xcalloc(slots, sizeof(set->slots[0])),
+        .mask = slots - 1,
+    };
+    return set;
+}
+
+void
+strset_destroy(struct strset *set)
+{
+    if (set == NULL)
+        return;
+
+    free(set->slots);
+    free(set);
+}
+
+/* Returns the slot holding 'key', or the empty slot it would go in */
+static struct slot *
+probe(const struct strset *set, const void *key, size_t len, uint64_t hash)
+{
+    for (size_t i = hash & set->mask; ; i = (i + 1) & set->mask) {
+        struct slot *slot = &set->slots[i];
+
+        if (slot->key == NULL)
+            return slot;
+
+        if (slot->hash == hash && slot->len == len &&
+            memcmp(slot->key, key, len) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+static void
+grow(struct strset *set)
+{
+    struct slot *old = set->slots;
+    const size_t old_count = set->mask + 1;
+    const size_t new_count = old_count * 2;
+
+    set->slots = xcalloc(new_count, sizeof(set->slots[0]));
+    set->mask = new_count - 1;
+
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i].key == NULL)
+            continue;
+
+        *probe(set, old[i].key, old[i].len, old[i].hash) = old[i];
+    }
+
+    free(old);
+}
+
+bool
+strset_add(struct strset *set, const void *key, size_t len, void *value)
+{
+    /* Empty strings are valid keys, but NULL marks empty slots */
+    if (key == NULL)
+        key = "";
+
+    const uint64_t hash = strset_hash(key, len);
+    struct slot *slot = probe(set, key, len, hash);
+
+    if (slot->key != NULL)
+        return false;
+
+    if ((set->count + 1) * 2 > set->mask + 1) {
+        grow(set);
+        slot = probe(set, key, len, hash);
+    }
+
+    *slot = (struct slot){.key = key, .len = len, .hash = hash, .value = value};
+    set->count++;
+    return true;
+}
+
+void **
+strset_find(const struct strset *set, const void *key, size_t len)
+{
+    if (key == NULL)
+        key = "";
+
+    struct slot *slot = probe(set, key, len, strset_hash(key, len));
+    return slot->key != NULL ? &slot->value : NULL;
+}
+
+size_t
+strset_count(const struct strset *set)
+{
+    return set->count;
+}
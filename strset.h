@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Open addressing (linear probing) hash set of strings.
+ *
+ * Strings are byte sequences with an explicit length (e.g. UTF-8, or
+ * UTF-32 with the length in bytes), and are *not* copied; they must
+ * outlive the set.
+ *
+ * Each string carries a value, making the set usable as a map.
+ */
+struct strset;
+
+/* 'expected' is the number of strings, to size the table up front */
+struct strset *strset_init(size_t expected);
+void strset_destroy(struct strset *set);
+
+/* Adds 'key', unless already present. Returns false if it was */
+bool strset_add(struct strset *set, const void *key, size_t len, void *value);
+
+/*
+ * Returns a pointer to the value of 'key' (which may be updated), or
+ * NULL if 'key' isn't in the set
+ */
+void **strset_find(const struct strset *set, const void *key, size_t len);
+
+size_t strset_count(const struct strset *set);
+
+/*
+ * The hash function used by the set. Also stored in the popularity
+ * cache; changing it requires bumping that file's version
+ */
+uint64_t strset_hash(const void *key, size_t len);
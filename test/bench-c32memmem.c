@@ -0,0 +1,158 @@
+/*
+ * Compares the scalar, SSE2 and AVX2 variants of c32memchr() and
+ * c32memmem(), by searching application title sized haystacks for
+ * single code points, and short needles, the way exact and fzf
+ * matching do.
+ */
+
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../char32.h"
+
+#define TITLE_COUNT (64 * 1024)
+#define MAX_TITLE_LEN 64
+#define ROUNDS 20
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct title {
+    char32_t text[MAX_TITLE_LEN];
+    size_t len;
+};
+
+/* Random words, 12 to 64 code points long in total */
+static void
+fill(struct title *titles, const char32_t *alphabet, size_t alphabet_len)
+{
+    for (size_t i = 0; i < TITLE_COUNT; i++) {
+        struct title *t = &titles[i];
+        const size_t len = 12 + rand() % (MAX_TITLE_LEN - 12 + 1);
+
+        for (size_t j = 0; j < len; j++) {
+            t->text[j] = rand() % 6 == 0
+                ? U' '
+                : alphabet[rand() % alphabet_len];
+        }
+
+        t->len = len;
+    }
+}
+
+static const char *const impl_names[] = {
+    [C32_IMPL_SCALAR] = "scalar",
+    [C32_IMPL_SSE2] = "sse2",
+    [C32_IMPL_AVX2] = "avx2",
+};
+
+/* A needle of length one is searched for with c32memchr() */
+static size_t
+search(enum c32_impl impl, const struct title *titles,
+       const char32_t *needle, size_t needle_len, size_t *offsets)
+{
+    size_t matches = 0;
+
+    for (size_t i = 0; i < TITLE_COUNT; i++) {
+        const char32_t *m = needle_len == 1
+            ? c32memchr_using(impl, titles[i].text, needle[0], titles[i].len)
+            : c32memmem_using(
+                impl, titles[i].text, titles[i].len, needle, needle_len);
+
+        offsets[i] = m != NULL ? (size_t)(m - titles[i].text) : SIZE_MAX;
+        if (m != NULL)
+            matches++;
+    }
+
+    return matches;
+}
+
+static int
+bench(const char *name, const struct title *titles, const char32_t *needle)
+{
+    const size_t needle_len = c32len(needle);
+
+    size_t *expected = malloc(TITLE_COUNT * sizeof(expected[0]));
+    size_t *offsets = malloc(TITLE_COUNT * sizeof(offsets[0]));
+    size_t matches = search(C32_IMPL_SCALAR, titles, needle, needle_len, expected);
+
+    int ret = EXIT_SUCCESS;
+    printf("%-6s %-6s needle=%-2zu matches=%-6zu",
+           needle_len == 1 ? "memchr" : "memmem", name, needle_len, matches);
+
+    for (enum c32_impl impl = C32_IMPL_SCALAR;
+         impl <= C32_IMPL_AVX2;
+         impl++)
+    {
+        if (!c32_impl_supported(impl)) {
+            printf("  %6s: %8s", impl_names[impl], "n/a");
+            continue;
+        }
+
+        const double start = now();
+        for (size_t r = 0; r < ROUNDS; r++)
+            search(impl, titles, needle, needle_len, offsets);
+        const double elapsed = now() - start;
+
+        for (size_t i = 0; i < TITLE_COUNT; i++) {
+            if (offsets[i] != expected[i]) {
+                fprintf(stderr, "%s: %s: title #%zu: got %zu, expected %zu\n",
+                        name, impl_names[impl], i, offsets[i], expected[i]);
+                ret = EXIT_FAILURE;
+                break;
+            }
+        }
+
+        printf("  %6s: %5.1f Mt/s",
+               impl_names[impl], (double)TITLE_COUNT * ROUNDS / 1e6 / elapsed);
+    }
+
+    printf("\n");
+    free(expected);
+    free(offsets);
+    return ret;
+}
+
+int
+main(int argc, const char *const *argv)
+{
+    setlocale(LC_CTYPE, "C.UTF-8");
+    srand(1);
+
+    struct title *titles = malloc(TITLE_COUNT * sizeof(titles[0]));
+
+    static const char32_t ascii[] = U"abcdefghijklmnopqrstuvwxyz0123456789-_.";
+    static const char32_t mixed[] = U"abcdefgh αβγδ абвг åäö 日本語";
+
+    static const char32_t *const ascii_needles[] = {
+        U"e", U"q", U"fi", U"ter", U"term", U"firefox", U"libreoffice-calc",
+    };
+    static const char32_t *const mixed_needles[] = {
+        U"α", U"日", U"аб", U"日本", U"efgh", U"ab åä",
+    };
+
+    int ret = EXIT_SUCCESS;
+
+    fill(titles, ascii, c32len(ascii));
+    for (size_t i = 0; i < sizeof(ascii_needles) / sizeof(ascii_needles[0]); i++) {
+        if (bench("ascii", titles, ascii_needles[i]) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+    }
+
+    fill(titles, mixed, c32len(mixed));
+    for (size_t i = 0; i < sizeof(mixed_needles) / sizeof(mixed_needles[0]); i++) {
+        if (bench("mixed", titles, mixed_needles[i]) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+    }
+
+    free(titles);
+    return ret;
+}
@@ -0,0 +1,111 @@
+/*
+ * Compares towlower() with the table driven toc32lower() and
+ * toc32lower_n(), on ASCII, Latin and mixed script text.
+ */
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wctype.h>
+
+#include "../char32.h"
+
+#define TEXT_LEN (1024 * 1024)
+#define ROUNDS 50
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fill(char32_t *text, const char32_t *alphabet, size_t alphabet_len)
+{
+    for (size_t i = 0; i < TEXT_LEN; i++)
+        text[i] = alphabet[rand() % alphabet_len];
+}
+
+static int
+bench(const char *name, const char32_t *text, char32_t *out)
+{
+    double start = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < TEXT_LEN; i++)
+            out[i] = (char32_t)towlower((wint_t)text[i]);
+    }
+    const double wlower = now() - start;
+
+    char32_t *expected = malloc(TEXT_LEN * sizeof(expected[0]));
+    for (size_t i = 0; i < TEXT_LEN; i++)
+        expected[i] = out[i];
+
+    start = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < TEXT_LEN; i++)
+            out[i] = toc32lower(text[i]);
+    }
+    const double single = now() - start;
+
+    start = now();
+    for (size_t r = 0; r < ROUNDS; r++)
+        toc32lower_n(out, text, TEXT_LEN);
+    const double bulk = now() - start;
+
+    int ret = EXIT_SUCCESS;
+    for (size_t i = 0; i < TEXT_LEN; i++) {
+        if (out[i] != expected[i]) {
+            fprintf(stderr, "%s: U+%04X: got U+%04X, expected U+%04X\n",
+                    name, (unsigned)text[i], (unsigned)out[i],
+                    (unsigned)expected[i]);
+            ret = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    free(expected);
+
+    const double mcp = (double)TEXT_LEN * ROUNDS / 1e6;
+    printf("%-8s towlower: %7.1f Mcp/s, toc32lower: %7.1f Mcp/s, "
+           "toc32lower_n: %7.1f Mcp/s\n",
+           name, mcp / wlower, mcp / single, mcp / bulk);
+    return ret;
+}
+
+int
+main(int argc, const char *const *argv)
+{
+    setlocale(LC_CTYPE, "C.UTF-8");
+    srand(1);
+
+    char32_t *text = malloc(TEXT_LEN * sizeof(text[0]));
+    char32_t *out = malloc(TEXT_LEN * sizeof(out[0]));
+
+    static const char32_t ascii[] =
+        U"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -_./";
+    static const char32_t latin[] =
+        U"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ ÅÄÖåäöÉéÜüßİ";
+    static const char32_t mixed[] =
+        U"abcXYZ ΑΒΓαβγ АБВабв ÅÄÖ 日本語 カタカナ 한국어 ⅠⅡⅢ ⓐⒶ 𐐀𐐨";
+
+    int ret = EXIT_SUCCESS;
+
+    fill(text, ascii, c32len(ascii));
+    if (bench("ascii", text, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    fill(text, latin, c32len(latin));
+    if (bench("latin", text, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    fill(text, mixed, c32len(mixed));
+    if (bench("mixed", text, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    free(text);
+    free(out);
+    return ret;
+}
@@ -0,0 +1,35 @@
+#!/usr/bin/fish
+
+# Pipes $FUZZEL_BENCH_LINES (default 10 million) lines through
+# fuzzel --dmenu, and reports how many lines per second were loaded.
+# The load time is the "apps loaded" time from --print-timing-info,
+# i.e. until fuzzel has received EVENT_APPS_ALL_LOADED.
+
+set lines 10000000
+if set -q FUZZEL_BENCH_LINES
+    set lines $FUZZEL_BENCH_LINES
+end
+
+set input (mktemp)
+seq -f 'line %.0f' 1 $lines >$input
+
+# The search term only matches the last line, so --auto-select exits
+# once all lines have been loaded
+set timing (cat $input |
+            $FUZZEL_TEST_BIN --dmenu \
+                             --print-timing-info \
+                             --match-mode=exact \
+                             --auto-select \
+                             --search="line $lines" 2>&1 >/dev/null |
+            string match -r 'apps loaded in (\d+)s (\d+)µs')
+
+rm -f $input
+
+if test (count $timing) -ne 3
+    echo "failed to get load time from fuzzel" >&2
+    exit 1
+end
+
+set secs (math "$timing[2] + $timing[3] / 1000000")
+printf "%d lines loaded in %.3fs: %.0f lines/s\n" \
+    $lines $secs (math "$lines / $secs")
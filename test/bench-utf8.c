@@ -0,0 +1,135 @@
+/*
+ * Compares decoding with mbrtoc32() one character at a time, with
+ * ambstoc32_len(), on ASCII, Latin and mixed script text.
+ */
+
+#include <locale.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "../char32.h"
+
+#define TEXT_LEN (1024 * 1024)
+#define ROUNDS 50
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fills 'text' with random words from 'alphabet', returns its length */
+static size_t
+fill(char *text, const char *const *alphabet, size_t alphabet_len)
+{
+    size_t len = 0;
+
+    while (true) {
+        const char *s = alphabet[rand() % alphabet_len];
+        const size_t s_len = strlen(s);
+
+        if (len + s_len >= TEXT_LEN)
+            break;
+
+        memcpy(&text[len], s, s_len);
+        len += s_len;
+    }
+
+    text[len] = '\0';
+    return len;
+}
+
+static int
+bench(const char *name, const char *text, size_t text_len, char32_t *out)
+{
+    size_t expected_len = 0;
+
+    double start = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        mbstate_t ps = {0};
+        const char *in = text;
+        size_t rc;
+
+        expected_len = 0;
+        while ((rc = mbrtoc32(
+                    &out[expected_len], in, text_len + 1 - (in - text), &ps)) != 0)
+        {
+            in += rc;
+            expected_len++;
+        }
+    }
+    const double mbr = now() - start;
+
+    char32_t *decoded = NULL;
+    size_t decoded_len = 0;
+
+    start = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        free(decoded);
+        decoded = ambstoc32_len(text, &decoded_len);
+    }
+    const double simd = now() - start;
+
+    int ret = EXIT_SUCCESS;
+    if (decoded == NULL || decoded_len != expected_len ||
+        memcmp(decoded, out, expected_len * sizeof(out[0])) != 0)
+    {
+        fprintf(stderr, "%s: ambstoc32_len() differs from mbrtoc32()\n", name);
+        ret = EXIT_FAILURE;
+    }
+
+    free(decoded);
+
+    const double mb = (double)text_len * ROUNDS / 1e6;
+    printf("%-8s mbrtoc32: %7.1f MB/s, ambstoc32_len: %7.1f MB/s\n",
+           name, mb / mbr, mb / simd);
+    return ret;
+}
+
+int
+main(int argc, const char *const *argv)
+{
+    setlocale(LC_CTYPE, "C.UTF-8");
+    char32_init();
+    srand(1);
+
+    char *text = malloc(TEXT_LEN);
+    char32_t *out = malloc(TEXT_LEN * sizeof(out[0]));
+
+    static const char *const ascii[] = {
+        "firefox ", "org.gnome.Nautilus ", "/usr/bin/", "Text Editor ",
+        "libreoffice-writer ", "x", "-", "_", "\n",
+    };
+    static const char *const latin[] = {
+        "firefox ", "Å", "ä", "ö", "Textredigerare ", "é", "ß", "Ü", " ",
+    };
+    static const char *const mixed[] = {
+        "abc ", "ΑΒΓαβγ ", "АБВабв ", "日本語 ", "カタカナ ", "한국어 ",
+        "𐐀𐐨 ", "😀",
+    };
+
+    int ret = EXIT_SUCCESS;
+    size_t len;
+
+    len = fill(text, ascii, sizeof(ascii) / sizeof(ascii[0]));
+    if (bench("ascii", text, len, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    len = fill(text, latin, sizeof(latin) / sizeof(latin[0]));
+    if (bench("latin", text, len, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    len = fill(text, mixed, sizeof(mixed) / sizeof(mixed[0]));
+    if (bench("mixed", text, len, out) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+
+    free(text);
+    free(out);
+    return ret;
+}
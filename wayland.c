@@ -766,7 +766,7 @@ execute_binding(struct seat *seat, const struct key_binding *binding, bool *refr
         prompt_erase_all(wayl->prompt);
 
         if (wayl->conf->dmenu.enabled) {
-            char *chars = ac32tombs(match->application->title);
+            char *chars = ac32tombs(application_title(match->application));
             if (chars != NULL) {
                 prompt_insert_chars(wayl->prompt, chars, strlen(chars));
                 *refresh = true;
@@ -0,0 +1,74 @@
+#include "wsdeque.h"
+
+#include <stdatomic.h>
+
+/*
+ * All accesses to 'top', 'bottom' and the items are sequentially
+ * consistent (the default for _Atomic objects), which is what the
+ * original Chase-Lev algorithm assumes.
+ */
+
+void
+ws_deque_init(struct ws_deque *deque)
+{
+    deque->top = 0;
+    deque->bottom = 0;
+}
+
+bool
+ws_deque_push(struct ws_deque *deque, uint64_t item)
+{
+    const int64_t b = deque->bottom;
+    const int64_t t = deque->top;
+
+    if (b - t >= WS_DEQUE_SIZE)
+        return false;
+
+    deque->items[b % WS_DEQUE_SIZE] = item;
+    deque->bottom = b + 1;
+    return true;
+}
+
+bool
+ws_deque_pop(struct ws_deque *deque, uint64_t *item)
+{
+    const int64_t b = deque->bottom - 1;
+    deque->bottom = b;
+
+    int64_t t = deque->top;
+
+    if (t > b) {
+        /* Empty */
+        deque->bottom = b + 1;
+        return false;
+    }
+
+    *item = deque->items[b % WS_DEQUE_SIZE];
+
+    if (t == b) {
+        /* Last item; race against thieves for it */
+        const bool won = atomic_compare_exchange_strong(&deque->top, &t, t + 1);
+        deque->bottom = b + 1;
+        return won;
+    }
+
+    return true;
+}
+
+enum ws_steal_result
+ws_deque_steal(struct ws_deque *deque, uint64_t *item)
+{
+    int64_t t = deque->top;
+    const int64_t b = deque->bottom;
+
+    if (t >= b)
+        return WS_STEAL_EMPTY;
+
+    const uint64_t stolen = deque->items[t % WS_DEQUE_SIZE];
+
+    if (!atomic_compare_exchange_strong(&deque->top, &t, t + 1))
+        return WS_STEAL_RETRY;
+
+    *item = stolen;
+    return WS_STEAL_SUCCESS;
+}
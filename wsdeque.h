@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fixed size Chase-Lev work-stealing deque, holding opaque 64-bit
+ * items.
+ *
+ * The owning thread pushes and pops at the bottom. Any other thread
+ * may steal from the top. When the owner is not running (e.g. before
+ * the workers are started), any single thread may push.
+ */
+#define WS_DEQUE_SIZE 64
+
+struct ws_deque {
+    _Atomic int64_t top;
+    char pad[64 - sizeof(int64_t)];  /* Keep thieves off the owner's line */
+    _Atomic int64_t bottom;
+    _Atomic uint64_t items[WS_DEQUE_SIZE];
+};
+
+enum ws_steal_result {
+    WS_STEAL_SUCCESS,
+    WS_STEAL_EMPTY,
+    WS_STEAL_RETRY,  /* Lost a race with another thread; try again */
+};
+
+void ws_deque_init(struct ws_deque *deque);
+
+/* Owner only. Returns false if the deque is full */
+bool ws_deque_push(struct ws_deque *deque, uint64_t item);
+
+/* Owner only. Returns false if the deque is empty */
+bool ws_deque_pop(struct ws_deque *deque, uint64_t *item);
+
+enum ws_steal_result ws_deque_steal(struct ws_deque *deque, uint64_t *item);
@@ -16,16 +16,21 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <pwd.h>
+#include <stdatomic.h>
+#include <threads.h>
 
 #define LOG_MODULE "xdg"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "char32.h"
+#include "desktop-cache.h"
 #include "icon.h"
 #include "macros.h"
 #include "xmalloc.h"
 #include "xsnprintf.h"
 #include "plugin.h"
+#include "strset.h"
+#include "timing.h"
 
 typedef tll(struct application *) application_llist_t;
 
@@ -39,8 +44,10 @@ struct locale_variants {
 struct action {
     char32_t *name;
     char32_t *generic_name;
+    size_t generic_name_len;
     char *app_id;
     char32_t *comment;
+    size_t comment_len;
     char32_t* translated_name;
     char32_list_t keywords;
     char32_list_t categories;
@@ -56,6 +63,7 @@ struct action {
     char *icon;
     char *exec;
     char32_t *wexec;
+    size_t wexec_len;
 
     char *path;
     bool visible;
@@ -174,8 +182,10 @@ parse_desktop_file(int fd, char *id, const char32_t *file_basename_lowercase,
                         action->generic_name =
                             default_action->generic_name != NULL
                             ? xc32dup(default_action->generic_name) : NULL;
+                        action->generic_name_len = default_action->generic_name_len;
                         action->comment = default_action->comment != NULL
                             ? xc32dup(default_action->comment) : NULL;
+                        action->comment_len = default_action->comment_len;
                         action->path = default_action->path != NULL
                             ? xstrdup(default_action->path) : NULL;
                         action->icon = default_action->icon != NULL
@@ -276,7 +286,7 @@ parse_desktop_file(int fd, char *id, const char32_t *file_basename_lowercase,
                 free(action->exec);
                 free(action->wexec);
                 action->exec = xstrdup(value);
-                action->wexec = ambstoc32(value);
+                action->wexec = ambstoc32_len(value, &action->wexec_len);
             }
 
             else if (strcmp(key, "Path") == 0) {
@@ -287,7 +297,8 @@ parse_desktop_file(int fd, char *id, const char32_t *file_basename_lowercase,
             else if (strcmp(key, "GenericName") == 0) {
                 if (locale_score > action->generic_name_locale_score) {
                     free(action->generic_name);
-                    action->generic_name = ambstoc32(value);
+                    action->generic_name = ambstoc32_len(
+                        value, &action->generic_name_len);
                     action->generic_name_locale_score = locale_score;
                 }
             }
@@ -305,7 +316,7 @@ parse_desktop_file(int fd, char *id, const char32_t *file_basename_lowercase,
             else if (strcmp(key, "Comment") == 0) {
                 if (locale_score > action->comment_locale_score) {
                     free(action->comment);
-                    action->comment = ambstoc32(value);
+                    action->comment = ambstoc32_len(value, &action->comment_len);
                     action->comment_locale_score = locale_score;
                 }
             }
@@ -487,37 +498,27 @@ parse_desktop_file(int fd, char *id, const char32_t *file_basename_lowercase,
         const size_t basename_len = file_basename_lowercase != NULL
             ? c32len(file_basename_lowercase)
             : 0;
-        const size_t wexec_len = action->wexec != NULL
-            ? c32len(action->wexec)
+        const size_t wexec_len = a->wexec != NULL ? a->wexec_len : 0;
+        const size_t generic_name_len = a->generic_name != NULL
+            ? a->generic_name_len
             : 0;
-        const size_t generic_name_len = action->generic_name != NULL
-            ? c32len(action->generic_name)
+        const size_t comment_len = a->comment != NULL
+            ? a->comment_len
             : 0;
-        const size_t comment_len = action->comment != NULL
-            ? c32len(action->comment)
-            : 0;
-        const size_t translated_name_len = action->translated_name != NULL
-            ? c32len(action->translated_name)
+        const size_t translated_name_len = a->translated_name != NULL
+            ? c32len(a->translated_name)
             : 0;
 
         char32_t *title_lowercase = xc32dup(title);
-        for (size_t i = 0; i < title_len; i++)
-            title_lowercase[i] = toc32lower(title_lowercase[i]);
-
-        for (size_t i = 0; i < wexec_len; i++)
-            action->wexec[i] = toc32lower(action->wexec[i]);
-        for (size_t i = 0; i < generic_name_len; i++)
-            action->generic_name[i] = toc32lower(action->generic_name[i]);
-        for (size_t i = 0; i < comment_len; i++)
-            action->comment[i] = toc32lower(action->comment[i]);
-        tll_foreach(a->keywords, it) {
-            for (size_t i = 0; i < c32len(it->item); i++)
-                it->item[i] = toc32lower(it->item[i]);
-        }
-        tll_foreach(a->categories, it) {
-            for (size_t i = 0; i < c32len(it->item); i++)
-                it->item[i] = toc32lower(it->item[i]);
-        }
+        toc32lower_n(title_lowercase, title_lowercase, title_len);
+
+        toc32lower_n(a->wexec, a->wexec, wexec_len);
+        toc32lower_n(a->generic_name, a->generic_name, generic_name_len);
+        toc32lower_n(a->comment, a->comment, comment_len);
+        tll_foreach(a->keywords, it)
+            toc32lower_n(it->item, it->item, c32len(it->item));
+        tll_foreach(a->categories, it)
+            toc32lower_n(it->item, it->item, c32len(it->item));
 
         struct application *app = xmalloc(sizeof(*app));
         *app = (struct application){
@@ -587,51 +588,93 @@ new_id(const char *base_id, const char *new_part)
 }
 
 static void
-scan_dir(int base_fd, const char *terminal, bool include_actions,
-         bool filter_desktop, char_list_t *desktops,
-         application_llist_t *applications, const char *base_id, const char *base_path)
+locale_variants_init(struct locale_variants *lc_messages)
 {
+    const char *locale = setlocale(LC_MESSAGES, NULL);
+    *lc_messages = (struct locale_variants){NULL};
+
+    if (locale == NULL)
+        return;
+
+    char *lang = xstrdup(locale);
+    char *country_start = strchr(lang, '_');
+    char *encoding_start = strchr(lang, '.');
+    char *modifier_start = strchr(lang, '@');
+
+    // Replace found delimiters with null terminators and skip past them
+    if (country_start != NULL)
+        *country_start++ = '\0';
+    if (encoding_start != NULL)
+        *encoding_start++ = '\0';
+    if (modifier_start != NULL)
+        *modifier_start++ = '\0';
+
+    lc_messages->lang = lang;
+    if (country_start != NULL)
+        lc_messages->lang_country = xstrjoin3(lang, "_", country_start);
+
+    if (modifier_start != NULL)
+        lc_messages->lang_modifier = xstrjoin3(lang, "@", modifier_start);
+
+    if (country_start != NULL && modifier_start != NULL)
+        lc_messages->lang_country_modifier = xstrjoin3(
+                lc_messages->lang_country, "@", modifier_start);
+
+    LOG_DBG("lang=%s, lang_country=%s, lang@modifier=%s, lang_country@modifier=%s",
+            lc_messages->lang,
+            loggable_str(lc_messages->lang_country),
+            loggable_str(lc_messages->lang_modifier),
+            loggable_str(lc_messages->lang_country_modifier));
+}
+
+static void
+locale_variants_destroy(struct locale_variants *lc_messages)
+{
+    free(lc_messages->lang);
+    free(lc_messages->lang_country);
+    free(lc_messages->lang_modifier);
+    free(lc_messages->lang_country_modifier);
+}
+
+/* A desktop file found by scan_dir(), to be parsed */
+struct desktop_file {
+    char *id;
+    char *path;
+    char32_t *basename;  /* Lower cased, without the ".desktop" suffix */
+
+    application_llist_t applications;  /* Parse result */
+};
+
+struct desktop_files {
+    struct desktop_file *files;
+    size_t count;
+    size_t size;
+
+    struct strset *ids;  /* Desktop File IDs of 'files' */
+};
+
+/*
+ * Finds all desktop files, without parsing them. Files are added in
+ * precedence order; a file whose Desktop File ID has already been
+ * seen is shadowed by the earlier one, and skipped.
+ */
+static void
+scan_dir(int base_fd, const char *base_id, const char *base_path,
+         struct desktop_files *files, struct desktop_cache *cache)
+{
+    struct stat dir_st;
+    if (fstat(base_fd, &dir_st) < 0) {
+        LOG_ERRNO("%s: failed to stat", base_path);
+        return;
+    }
+
     DIR *d = fdopendir(base_fd);
     if (d == NULL) {
         LOG_ERRNO("failed to open directory");
         return;
     }
 
-    const char *locale = setlocale(LC_MESSAGES, NULL);
-    struct locale_variants lc_messages = {NULL};
-
-    if (locale != NULL) {
-        char *lang = xstrdup(locale);
-        char *country_start = strchr(lang, '_');
-        char *encoding_start = strchr(lang, '.');
-        char *modifier_start = strchr(lang, '@');
-
-        // Replace found delimiters with null terminators and skip past them
-        if (country_start != NULL)
-            *country_start++ = '\0';
-        if (encoding_start != NULL)
-            *encoding_start++ = '\0';
-        if (modifier_start != NULL)
-            *modifier_start++ = '\0';
-
-        lc_messages.lang = lang;
-        if (country_start != NULL)
-            lc_messages.lang_country = xstrjoin3(lang, "_", country_start);
-
-        if (modifier_start != NULL)
-            lc_messages.lang_modifier = xstrjoin3(lang, "@", modifier_start);
-
-        if (country_start != NULL && modifier_start != NULL)
-            lc_messages.lang_country_modifier = xstrjoin3(
-                    lc_messages.lang_country, "@", modifier_start);
-
-        LOG_DBG("lang=%s, lang_country=%s, lang@modifier=%s, lang_country@modifier=%s",
-                lc_messages.lang,
-                loggable_str(lc_messages.lang_country),
-                loggable_str(lc_messages.lang_modifier),
-                loggable_str(lc_messages.lang_country_modifier));
-    }
-
+    desktop_cache_add_dir(cache, base_path, &dir_st);
 
     for (const struct dirent *e = readdir(d); e != NULL; e = readdir(d)) {
         if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
@@ -653,9 +696,7 @@ scan_dir(int base_fd, const char *terminal, bool include_actions,
             char *nested_base_id = new_id(base_id, e->d_name);
             char nested_base_path[PATH_MAX];
             xsnprintf(nested_base_path, sizeof(nested_base_path), "%s/%s", base_path, e->d_name);
-            scan_dir(dir_fd, terminal, include_actions,
-                     filter_desktop, desktops,
-                     applications, nested_base_id, nested_base_path);
+            scan_dir(dir_fd, nested_base_id, nested_base_path, files, cache);
             free(nested_base_id);
             close(dir_fd);
         } else if (S_ISREG(st.st_mode)) {
@@ -668,64 +709,147 @@ scan_dir(int base_fd, const char *terminal, bool include_actions,
             if (strcmp(&e->d_name[name_len - desktop_len], ".desktop") != 0)
                 continue;
 
+            char *id = new_id(base_id, e->d_name);
+            if (!strset_add(files->ids, id, strlen(id), NULL)) {
+                free(id);
+                continue;
+            }
+
             //LOG_DBG("%s", e->d_name);
-            int fd = openat(base_fd, e->d_name, O_RDONLY | O_CLOEXEC);
-            if (fd == -1)
-                LOG_WARN("%s: failed to open: %s", e->d_name, strerror(errno));
-            else {
-                const char *file_basename = strrchr(e->d_name, '/');
-                if (file_basename == NULL)
-                    file_basename = e->d_name;
-                else
-                    file_basename++;
+            const char *file_basename = strrchr(e->d_name, '/');
+            if (file_basename == NULL)
+                file_basename = e->d_name;
+            else
+                file_basename++;
+
+            const char *extension = strrchr(file_basename, '.');
+            if (extension == NULL)
+                extension = file_basename + strlen(file_basename);
+
+            int chars = mbsntoc32(NULL, file_basename, extension - file_basename, 0);
+            assert(chars >= 0);
+
+            char32_t *wfile_basename = xmalloc((chars + 1) * sizeof(wfile_basename[0]));
+            mbsntoc32(wfile_basename, file_basename, extension - file_basename, chars);
+            wfile_basename[chars] = U'\0';
+
+            toc32lower_n(wfile_basename, wfile_basename, chars);
+
+            /* Construct full desktop file path */
+            char desktop_file_path[PATH_MAX];
+            xsnprintf(desktop_file_path, sizeof(desktop_file_path), "%s/%s", base_path, e->d_name);
+            desktop_cache_add_file(cache, desktop_file_path, &st);
+
+            if (files->count >= files->size) {
+                files->size = files->size > 0 ? files->size * 2 : 256;
+                files->files = xreallocarray(
+                    files->files, files->size, sizeof(files->files[0]));
+            }
 
-                const char *extension = strrchr(file_basename, '.');
-                if (extension == NULL)
-                    extension = file_basename + strlen(file_basename);
+            files->files[files->count++] = (struct desktop_file){
+                .id = id,
+                .path = xstrdup(desktop_file_path),
+                .basename = wfile_basename,
+                .applications = tll_init(),
+            };
+        }
+    }
 
-                int chars = mbsntoc32(NULL, file_basename, extension - file_basename, 0);
-                assert(chars >= 0);
+    closedir(d);
+}
 
-                char32_t wfile_basename[chars + 1];
-                mbsntoc32(wfile_basename, file_basename, extension - file_basename, chars);
-                wfile_basename[chars] = U'\0';
+/*
+ * Desktop files are parsed in parallel. Each thread grabs the next
+ * unparsed file, and stores the result in the file itself, so that
+ * no locking is needed.
+ */
+struct parse_pool {
+    struct desktop_file *files;
+    size_t count;
+    atomic_size_t next;
+
+    const char *terminal;
+    bool include_actions;
+    bool filter_desktops;
+    char_list_t *desktops;
+    const struct locale_variants *lc_messages;
+};
 
-                for (size_t i = 0; i < chars; i++)
-                    wfile_basename[i] = toc32lower(wfile_basename[i]);
+/* THREAD */
+static int
+parse_thread(void *_pool)
+{
+    struct parse_pool *pool = _pool;
 
-                char *id = new_id(base_id, e->d_name);
+    while (true) {
+        const size_t idx = atomic_fetch_add(&pool->next, 1);
+        if (idx >= pool->count)
+            break;
 
-                bool already_added = false;
-                tll_foreach(*applications, it) {
-                    if (strcmp(it->item->id, id) == 0) {
-                        already_added = true;
-                        break;
-                    }
-                }
+        struct desktop_file *file = &pool->files[idx];
 
-                if (!already_added) {
-                    /* Construct full desktop file path */
-                    char desktop_file_path[PATH_MAX];
-                    xsnprintf(desktop_file_path, sizeof(desktop_file_path), "%s/%s", base_path, e->d_name);
-
-                    parse_desktop_file(
-                        fd, id, wfile_basename, terminal, include_actions,
-                        filter_desktop, desktops,
-                        &lc_messages, applications, desktop_file_path);
-                    /* fd closed by parse_desktop_file() */
-                } else {
-                    free(id);
-                    close(fd);
-                }
-            }
+        int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            LOG_WARN("%s: failed to open: %s", file->path, strerror(errno));
+            continue;
         }
+
+        parse_desktop_file(
+            fd, xstrdup(file->id), file->basename, pool->terminal,
+            pool->include_actions, pool->filter_desktops, pool->desktops,
+            pool->lc_messages, &file->applications, file->path);
+        /* fd closed by parse_desktop_file() */
     }
 
-    free(lc_messages.lang);
-    free(lc_messages.lang_country);
-    free(lc_messages.lang_modifier);
-    free(lc_messages.lang_country_modifier);
-    closedir(d);
+    return 0;
+}
+
+/* Don't spin up a thread for less than this many files */
+#define FILES_PER_PARSE_THREAD 32
+
+static void
+parse_desktop_files(struct desktop_files *files, const char *terminal,
+                    bool include_actions, bool filter_desktops,
+                    char_list_t *desktops, size_t *thread_count)
+{
+    struct locale_variants lc_messages;
+    locale_variants_init(&lc_messages);
+
+    struct parse_pool pool = {
+        .files = files->files,
+        .count = files->count,
+        .terminal = terminal,
+        .include_actions = include_actions,
+        .filter_desktops = filter_desktops,
+        .desktops = desktops,
+        .lc_messages = &lc_messages,
+    };
+    atomic_init(&pool.next, 0);
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = files->count / FILES_PER_PARSE_THREAD;
+    if (cpu_count > 0 && max_threads > (size_t)cpu_count)
+        max_threads = cpu_count;
+
+    /* The calling thread is one of the parsers */
+    thrd_t threads[max_threads > 1 ? max_threads - 1 : 1];
+    size_t started = 0;
+
+    for (size_t i = 0; i + 1 < max_threads; i++) {
+        if (thrd_create(&threads[started], &parse_thread, &pool) != thrd_success) {
+            LOG_WARN("failed to create desktop file parser thread");
+            break;
+        }
+        started++;
+    }
+
+    parse_thread(&pool);
+
+    for (size_t i = 0; i < started; i++)
+        thrd_join(threads[i], NULL);
+
+    locale_variants_destroy(&lc_messages);
+    *thread_count = started + 1;
 }
 
 static int
@@ -736,52 +860,142 @@ sort_application_by_title(const void *_a, const void *_b)
     return c32casecmp((*a)->title, (*b)->title);
 }
 
-void
-xdg_find_programs(const char *terminal, bool include_actions,
-                  bool filter_desktop, char_list_t *desktops,
-                  struct application_list *applications)
+/* Everything, other than the desktop files, the parsed entries depend on */
+static char *
+cache_key(const char *terminal, bool include_actions, bool filter_desktop,
+          const char_list_t *desktops, const xdg_data_dirs_t *dirs)
 {
-    application_llist_t apps = tll_init();
+    const char *l10n_plugin = l10n_plugin_path();
+
+    char *key = xasprintf(
+        "LC_CTYPE=%s\nLC_MESSAGES=%s\nterminal=%s\nactions=%d\n"
+        "filter_desktop=%d\nl10n=%s\n",
+        setlocale(LC_CTYPE, NULL), setlocale(LC_MESSAGES, NULL),
+        terminal != NULL ? terminal : "", include_actions, filter_desktop,
+        l10n_plugin != NULL ? l10n_plugin : "");
+
+    if (filter_desktop) {
+        tll_foreach(*desktops, it) {
+            char *new_key = xstrjoin3(key, "desktop=", it->item);
+            free(key);
+            key = xstrjoin(new_key, "\n");
+            free(new_key);
+        }
+    }
 
-    xdg_data_dirs_t dirs = xdg_data_dirs();
-    tll_foreach(dirs, it) {
+    tll_foreach(*dirs, it) {
+        char *new_key = xstrjoin3(key, "dir=", it->item.path);
+        free(key);
+        key = xstrjoin(new_key, "\n");
+        free(new_key);
+    }
+
+    return key;
+}
+
+static void
+find_programs(const char *terminal, bool include_actions,
+              bool filter_desktop, char_list_t *desktops,
+              const xdg_data_dirs_t *dirs, struct desktop_cache *cache,
+              struct application_list *applications)
+{
+    struct desktop_files files = {.ids = strset_init(256)};
+
+    struct timespec *scan_start = time_begin();
+
+    tll_foreach(*dirs, it) {
         char path[strlen(it->item.path) + 1 + strlen("applications") + 1];
         sprintf(path, "%s/applications", it->item.path);
 
         int fd = open(path, O_RDONLY | O_CLOEXEC);
         if (fd != -1) {
-            scan_dir(fd, terminal, include_actions, filter_desktop, desktops, &apps, NULL, path);
+            scan_dir(fd, NULL, path, &files, cache);
             close(fd);
+        } else
+            desktop_cache_add_dir(cache, path, NULL);
+    }
+
+    strset_destroy(files.ids);
+    time_finish(scan_start, NULL, "desktop files scanned (%zu files)",
+                files.count);
+
+    struct timespec *parse_start = time_begin();
+
+    size_t thread_count;
+    parse_desktop_files(&files, terminal, include_actions, filter_desktop,
+                        desktops, &thread_count);
+
+    /* Merge, in precedence order */
+    application_llist_t apps = tll_init();
+    for (size_t i = 0; i < files.count; i++) {
+        struct desktop_file *file = &files.files[i];
+
+        tll_foreach(file->applications, it) {
+            tll_push_back(apps, it->item);
+            tll_remove(file->applications, it);
         }
+
+        free(file->id);
+        free(file->path);
+        free(file->basename);
     }
+    free(files.files);
 
-    mtx_lock(&applications->lock);
-    applications->count = tll_length(apps);
-    if (applications->count > 0) {
-        applications->v = xmalloc(tll_length(apps) * sizeof(applications->v[0]));
-    } else {
+    const size_t count = tll_length(apps);
+    if (count == 0)
         LOG_WARN("No applications found. See SEARCH PATHS in `man fuzzel` for details.");
-        applications->v = NULL;
-    }
+
+    struct application **sorted = xmalloc((count > 0 ? count : 1) * sizeof(sorted[0]));
 
     size_t i = 0;
     tll_foreach(apps, it) {
-        applications->v[i++] = it->item;
-        if (it->item->visible)
-            applications->visible_count++;
+        sorted[i++] = it->item;
         tll_remove(apps, it);
     }
     tll_free(apps);
 
-    qsort(applications->v, applications->count, sizeof(applications->v[0]),
-          &sort_application_by_title);
-    mtx_unlock(&applications->lock);
+    qsort(sorted, count, sizeof(sorted[0]), &sort_application_by_title);
+
+    for (i = 0; i < count; i++)
+        applications_append(applications, sorted[i]);
+    applications_publish(applications);
+    free(sorted);
+
+    time_finish(parse_start, NULL,
+                "desktop files parsed (%zu entries, %zu threads)",
+                count, thread_count);
+
+    cache->count = count;
+}
+
+void
+xdg_find_programs(const char *terminal, bool include_actions,
+                  bool filter_desktop, char_list_t *desktops,
+                  struct application_list *applications,
+                  struct desktop_cache *cache)
+{
+    xdg_data_dirs_t dirs = xdg_data_dirs();
+
+    desktop_cache_init(
+        cache,
+        cache_key(terminal, include_actions, filter_desktop, desktops, &dirs));
+
+    struct timespec *start = time_begin();
+
+    if (desktop_cache_load(cache, applications)) {
+        time_finish(start, NULL, "desktop entry cache loaded (%zu entries)",
+                    cache->count);
+    } else {
+        free(start);
+        find_programs(terminal, include_actions, filter_desktop, desktops,
+                      &dirs, cache, applications);
+    }
 
     xdg_data_dirs_destroy(dirs);
 
 #if defined(_DEBUG) && LOG_ENABLE_DBG && 0
     for (size_t i = 0; i < applications->count; i++) {
-        const struct application *app = &applications->v[i];
+        const struct application *app = applications_get(applications, i);
 
         char32_t keywords[1024];
         char32_t categories[1024];
@@ -833,6 +1047,36 @@ xdg_find_programs(const char *terminal, bool include_actions,
 #endif
 }
 
+void
+xdg_update_cache(const char *terminal, bool include_actions,
+                 bool filter_desktop, char_list_t *desktops,
+                 const struct application_list *applications,
+                 struct desktop_cache *cache)
+{
+    if (cache->map.data == NULL) {
+        /* The cache was missing, or stale, and the entries parsed */
+        desktop_cache_save(cache, applications);
+    } else if (desktop_cache_files_changed(cache)) {
+        /* A desktop file was edited in place; re-parse for the next run */
+        struct application_list *apps = applications_init();
+        if (apps != NULL) {
+            struct desktop_cache fresh;
+            desktop_cache_init(&fresh, xstrdup(cache->key));
+
+            xdg_data_dirs_t dirs = xdg_data_dirs();
+            find_programs(terminal, include_actions, filter_desktop, desktops,
+                          &dirs, &fresh, apps);
+            xdg_data_dirs_destroy(dirs);
+
+            desktop_cache_save(&fresh, apps);
+            desktop_cache_destroy(&fresh);
+            applications_destroy(apps);
+        }
+    }
+
+    desktop_cache_destroy(cache);
+}
+
 xdg_data_dirs_t
 xdg_data_dirs(void)
 {
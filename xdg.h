@@ -1,6 +1,7 @@
 #pragma once
 
 #include "application.h"
+#include "desktop-cache.h"
 #include "icon.h"
 #include "tllist.h"
 
@@ -16,7 +17,25 @@ void xdg_data_dirs_destroy(xdg_data_dirs_t dirs);
 
 const char *xdg_cache_dir(void);
 
+/*
+ * Loads desktop entries from the desktop entry cache when it's up to
+ * date, and parses the desktop files otherwise. Either way, 'cache'
+ * is initialized, and must be passed to xdg_update_cache() later.
+ */
 void xdg_find_programs(
     const char *terminal, bool include_actions,
     bool filter_desktop, char_list_t *desktops,
-    struct application_list *applications);
+    struct application_list *applications,
+    struct desktop_cache *cache);
+
+/*
+ * Writes the desktop entry cache, if it was stale, or re-parses all
+ * desktop files if any of them has changed since it was written. May
+ * be slow; call it once the entries have been displayed. Destroys
+ * 'cache'.
+ */
+void xdg_update_cache(
+    const char *terminal, bool include_actions,
+    bool filter_desktop, char_list_t *desktops,
+    const struct application_list *applications,
+    struct desktop_cache *cache);